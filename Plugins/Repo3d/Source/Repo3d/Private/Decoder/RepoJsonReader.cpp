@@ -0,0 +1,512 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder/RepoJsonReader.h"
+#include <cmath>
+#include <cstdlib>
+
+RepoJsonReader::RepoJsonReader(const char* Data, size_t Size) :
+	Begin(Data),
+	Cursor(Data),
+	Limit(Data + Size),
+	Current(Token::None),
+	CurrentState(State::ExpectValue),
+	Number(0),
+	Depth(0)
+{
+}
+
+RepoJsonReader::Token RepoJsonReader::Fail()
+{
+	Current = Token::Error;
+	return Current;
+}
+
+void RepoJsonReader::SkipWhitespace()
+{
+	while (Cursor < Limit && (*Cursor == ' ' || *Cursor == '\n' || *Cursor == '\r' || *Cursor == '\t'))
+	{
+		Cursor++;
+	}
+}
+
+RepoJsonReader::Token RepoJsonReader::Push(char Container, Token Result)
+{
+	if (Depth >= MaxDepth)
+	{
+		return Fail();
+	}
+	Containers[Depth++] = Container;
+	CurrentState = Container == '{' ? State::ExpectKeyOrEnd : State::ExpectValueOrEnd;
+	Current = Result;
+	return Current;
+}
+
+RepoJsonReader::Token RepoJsonReader::Pop(Token Result)
+{
+	Depth--;
+	CurrentState = Depth > 0 ? State::ExpectCommaOrEnd : State::Done;
+	Current = Result;
+	return Current;
+}
+
+RepoJsonReader::Token RepoJsonReader::Next()
+{
+	if (Current == Token::Error || Current == Token::End)
+	{
+		return Current;
+	}
+
+	SkipWhitespace();
+
+	switch (CurrentState)
+	{
+	case State::Done:
+		if (Cursor != Limit)
+		{
+			return Fail();
+		}
+		Current = Token::End;
+		return Current;
+
+	case State::ExpectCommaOrEnd:
+		if (Cursor >= Limit)
+		{
+			return Fail();
+		}
+		if (*Cursor == ',')
+		{
+			Cursor++;
+			SkipWhitespace();
+			CurrentState = Containers[Depth - 1] == '{' ? State::ExpectKey : State::ExpectValue;
+			break;
+		}
+		if (*Cursor == '}' && Containers[Depth - 1] == '{')
+		{
+			Cursor++;
+			return Pop(Token::EndObject);
+		}
+		if (*Cursor == ']' && Containers[Depth - 1] == '[')
+		{
+			Cursor++;
+			return Pop(Token::EndArray);
+		}
+		return Fail();
+
+	case State::ExpectKeyOrEnd:
+		if (Cursor < Limit && *Cursor == '}')
+		{
+			Cursor++;
+			return Pop(Token::EndObject);
+		}
+		CurrentState = State::ExpectKey;
+		break;
+
+	case State::ExpectValueOrEnd:
+		if (Cursor < Limit && *Cursor == ']')
+		{
+			Cursor++;
+			return Pop(Token::EndArray);
+		}
+		CurrentState = State::ExpectValue;
+		break;
+
+	default:
+		break;
+	}
+
+	if (CurrentState == State::ExpectKey)
+	{
+		if (Cursor >= Limit || *Cursor != '"' || !ParseString())
+		{
+			return Fail();
+		}
+		SkipWhitespace();
+		if (Cursor >= Limit || *Cursor != ':')
+		{
+			return Fail();
+		}
+		Cursor++;
+		CurrentState = State::ExpectValue;
+		Current = Token::Key;
+		return Current;
+	}
+
+	return ReadValue();
+}
+
+RepoJsonReader::Token RepoJsonReader::ReadValue()
+{
+	if (Cursor >= Limit)
+	{
+		return Fail();
+	}
+
+	Token Result;
+	switch (*Cursor)
+	{
+	case '{':
+		Cursor++;
+		return Push('{', Token::BeginObject);
+	case '[':
+		Cursor++;
+		return Push('[', Token::BeginArray);
+	case '"':
+		if (!ParseString())
+		{
+			return Fail();
+		}
+		Result = Token::String;
+		break;
+	case 't':
+		if (!ParseLiteral("true", 4))
+		{
+			return Fail();
+		}
+		Result = Token::True;
+		break;
+	case 'f':
+		if (!ParseLiteral("false", 5))
+		{
+			return Fail();
+		}
+		Result = Token::False;
+		break;
+	case 'n':
+		if (!ParseLiteral("null", 4))
+		{
+			return Fail();
+		}
+		Result = Token::Null;
+		break;
+	default:
+		if (!ParseNumber())
+		{
+			return Fail();
+		}
+		Result = Token::Number;
+		break;
+	}
+
+	CurrentState = Depth > 0 ? State::ExpectCommaOrEnd : State::Done;
+	Current = Result;
+	return Current;
+}
+
+bool RepoJsonReader::ParseLiteral(const char* Literal, size_t Length)
+{
+	if ((size_t)(Limit - Cursor) < Length || memcmp(Cursor, Literal, Length) != 0)
+	{
+		return false;
+	}
+	Cursor += Length;
+	return true;
+}
+
+bool RepoJsonReader::ParseString()
+{
+	Cursor++; // Opening quote
+
+	// Most strings have no escapes, so first try to return a view directly into the input
+
+	const char* Start = Cursor;
+	while (Cursor < Limit && *Cursor != '"' && *Cursor != '\\')
+	{
+		Cursor++;
+	}
+	if (Cursor >= Limit)
+	{
+		return false;
+	}
+	if (*Cursor == '"')
+	{
+		String.Data = Start;
+		String.Size = (size_t)(Cursor - Start);
+		Cursor++;
+		return true;
+	}
+
+	Scratch.assign(Start, Cursor);
+
+	while (Cursor < Limit)
+	{
+		char c = *Cursor++;
+		if (c == '"')
+		{
+			String.Data = Scratch.data();
+			String.Size = Scratch.size();
+			return true;
+		}
+		if (c != '\\')
+		{
+			Scratch.push_back(c);
+			continue;
+		}
+		if (Cursor >= Limit)
+		{
+			return false;
+		}
+		c = *Cursor++;
+		switch (c)
+		{
+		case '"':
+		case '\\':
+		case '/':
+			Scratch.push_back(c);
+			break;
+		case 'b':
+			Scratch.push_back('\b');
+			break;
+		case 'f':
+			Scratch.push_back('\f');
+			break;
+		case 'n':
+			Scratch.push_back('\n');
+			break;
+		case 'r':
+			Scratch.push_back('\r');
+			break;
+		case 't':
+			Scratch.push_back('\t');
+			break;
+		case 'u':
+		{
+			uint32_t Codepoint = 0;
+			for (int Pair = 0; Pair < 2; Pair++)
+			{
+				if (Limit - Cursor < 4)
+				{
+					return false;
+				}
+				uint32_t Unit = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					char h = *Cursor++;
+					Unit <<= 4;
+					if (h >= '0' && h <= '9') Unit |= h - '0';
+					else if (h >= 'a' && h <= 'f') Unit |= h - 'a' + 10;
+					else if (h >= 'A' && h <= 'F') Unit |= h - 'A' + 10;
+					else return false;
+				}
+				if (Pair == 0)
+				{
+					Codepoint = Unit;
+					if (Unit < 0xD800 || Unit > 0xDBFF) // Not a high surrogate, so there is no second unit
+					{
+						break;
+					}
+					if (Limit - Cursor < 2 || Cursor[0] != '\\' || Cursor[1] != 'u')
+					{
+						return false;
+					}
+					Cursor += 2;
+				}
+				else
+				{
+					Codepoint = 0x10000 + ((Codepoint - 0xD800) << 10) + (Unit - 0xDC00);
+				}
+			}
+			AppendCodepoint(Codepoint);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+
+	return false;
+}
+
+void RepoJsonReader::AppendCodepoint(uint32_t Codepoint)
+{
+	if (Codepoint < 0x80)
+	{
+		Scratch.push_back((char)Codepoint);
+	}
+	else if (Codepoint < 0x800)
+	{
+		Scratch.push_back((char)(0xC0 | (Codepoint >> 6)));
+		Scratch.push_back((char)(0x80 | (Codepoint & 0x3F)));
+	}
+	else if (Codepoint < 0x10000)
+	{
+		Scratch.push_back((char)(0xE0 | (Codepoint >> 12)));
+		Scratch.push_back((char)(0x80 | ((Codepoint >> 6) & 0x3F)));
+		Scratch.push_back((char)(0x80 | (Codepoint & 0x3F)));
+	}
+	else
+	{
+		Scratch.push_back((char)(0xF0 | (Codepoint >> 18)));
+		Scratch.push_back((char)(0x80 | ((Codepoint >> 12) & 0x3F)));
+		Scratch.push_back((char)(0x80 | ((Codepoint >> 6) & 0x3F)));
+		Scratch.push_back((char)(0x80 | (Codepoint & 0x3F)));
+	}
+}
+
+bool RepoJsonReader::ParseNumber()
+{
+	const char* Start = Cursor;
+
+	bool bNegative = false;
+	if (Cursor < Limit && *Cursor == '-')
+	{
+		bNegative = true;
+		Cursor++;
+	}
+
+	// Integers are by far the most common numbers in the headers, so accumulate them directly
+
+	uint64_t Integer = 0;
+	int Digits = 0;
+	while (Cursor < Limit && *Cursor >= '0' && *Cursor <= '9')
+	{
+		Integer = Integer * 10 + (uint64_t)(*Cursor - '0');
+		Cursor++;
+		Digits++;
+	}
+	if (Digits == 0)
+	{
+		return false;
+	}
+
+	bool bIsInteger = Digits < 19;
+
+	if (Cursor < Limit && *Cursor == '.')
+	{
+		bIsInteger = false;
+		Cursor++;
+		while (Cursor < Limit && *Cursor >= '0' && *Cursor <= '9')
+		{
+			Cursor++;
+		}
+	}
+	if (Cursor < Limit && (*Cursor == 'e' || *Cursor == 'E'))
+	{
+		bIsInteger = false;
+		Cursor++;
+		if (Cursor < Limit && (*Cursor == '+' || *Cursor == '-'))
+		{
+			Cursor++;
+		}
+		while (Cursor < Limit && *Cursor >= '0' && *Cursor <= '9')
+		{
+			Cursor++;
+		}
+	}
+
+	if (bIsInteger)
+	{
+		Number = bNegative ? -(double)Integer : (double)Integer;
+		return true;
+	}
+
+	char Buffer[64];
+	size_t Length = (size_t)(Cursor - Start);
+	if (Length >= sizeof(Buffer))
+	{
+		return false;
+	}
+	memcpy(Buffer, Start, Length);
+	Buffer[Length] = 0;
+	Number = strtod(Buffer, nullptr);
+	return true;
+}
+
+bool RepoJsonReader::SkipValue()
+{
+	if (Current != Token::BeginObject && Current != Token::BeginArray)
+	{
+		return Current != Token::Error;
+	}
+
+	int Nesting = 1;
+	while (Nesting > 0)
+	{
+		switch (Next())
+		{
+		case Token::BeginObject:
+		case Token::BeginArray:
+			Nesting++;
+			break;
+		case Token::EndObject:
+		case Token::EndArray:
+			Nesting--;
+			break;
+		case Token::Error:
+		case Token::End:
+			return false;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+bool RepoJsonReader::ReadString(RepoJsonString& Out)
+{
+	if (Next() != Token::String)
+	{
+		return false;
+	}
+	Out = String;
+	return true;
+}
+
+bool RepoJsonReader::ReadString(std::string& Out)
+{
+	if (Next() != Token::String)
+	{
+		return false;
+	}
+	Out.assign(String.Data, String.Size);
+	return true;
+}
+
+bool RepoJsonReader::ReadNumber(double& Out)
+{
+	if (Next() != Token::Number)
+	{
+		return false;
+	}
+	Out = Number;
+	return true;
+}
+
+bool RepoJsonReader::ReadUInt64(uint64_t& Out)
+{
+	// Offsets, lengths and counts must be whole and representable, as converting anything else is undefined or
+	// truncates. The comparisons are written so that NaN fails them.
+
+	double Value;
+	if (!ReadNumber(Value) || !(Value >= 0.0) || !(Value < 18446744073709551616.0) || Value != std::floor(Value))
+	{
+		return false;
+	}
+	Out = (uint64_t)Value;
+	return true;
+}
+
+bool RepoJsonReader::ReadUInt32(uint32_t& Out)
+{
+	uint64_t Value;
+	if (!ReadUInt64(Value) || Value > UINT32_MAX)
+	{
+		return false;
+	}
+	Out = (uint32_t)Value;
+	return true;
+}
@@ -0,0 +1,106 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder/RepoSrcArena.h"
+#include <new>
+
+RepoSrcArena::RepoSrcArena(size_t InMinBlockSize) :
+	MinBlockSize(InMinBlockSize)
+{
+}
+
+RepoSrcArena::~RepoSrcArena()
+{
+	FreeBlocks();
+}
+
+void* RepoSrcArena::Allocate(size_t Size, size_t Alignment)
+{
+	// Try the current block, then any later ones left over from a Rewind(), and then allocate a new block
+
+	for (; Current < Blocks.size(); Current++, Offset = 0)
+	{
+		auto& Block = Blocks[Current];
+		auto Address = (uintptr_t)Block.Data + Offset;
+		auto Padding = (Alignment - (Address & (Alignment - 1))) & (Alignment - 1);
+		if (Offset + Padding <= Block.Size && Size <= Block.Size - Offset - Padding)
+		{
+			Offset += Padding + Size;
+			UsedBytes += Padding + Size;
+			ResetUsedBytes = UsedBytes > ResetUsedBytes ? UsedBytes : ResetUsedBytes;
+			PeakUsedBytes = UsedBytes > PeakUsedBytes ? UsedBytes : PeakUsedBytes;
+			return Block.Data + Offset - Size;
+		}
+		UsedBytes += Block.Size - Offset; // The rest of the block is skipped
+	}
+
+	auto BlockSize = Size + Alignment > MinBlockSize ? Size + Alignment : MinBlockSize;
+	auto Data = new (std::nothrow) uint8_t[BlockSize];
+	if (!Data)
+	{
+		return nullptr;
+	}
+	Blocks.push_back({ Data, BlockSize });
+	ReservedBytes += BlockSize;
+	Current = Blocks.size() - 1;
+	Offset = 0;
+	return Allocate(Size, Alignment);
+}
+
+void RepoSrcArena::Reset()
+{
+	// If the last SRC needed more than one block, replace them with one that would have held everything
+
+	if (Blocks.size() > 1)
+	{
+		auto Size = ResetUsedBytes;
+		FreeBlocks();
+		auto Data = new (std::nothrow) uint8_t[Size];
+		if (Data)
+		{
+			Blocks.push_back({ Data, Size });
+			ReservedBytes = Size;
+		}
+	}
+
+	Current = 0;
+	Offset = 0;
+	UsedBytes = 0;
+	ResetUsedBytes = 0;
+}
+
+RepoSrcArena::Marker RepoSrcArena::GetMarker() const
+{
+	return { Current, Offset, UsedBytes };
+}
+
+void RepoSrcArena::Rewind(const Marker& Position)
+{
+	Current = Position.Block;
+	Offset = Position.Offset;
+	UsedBytes = Position.UsedBytes;
+}
+
+void RepoSrcArena::FreeBlocks()
+{
+	for (auto& Block : Blocks)
+	{
+		delete[] Block.Data;
+	}
+	Blocks.clear();
+	ReservedBytes = 0;
+}
@@ -0,0 +1,87 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Decoder/RepoSrcAssetList.h"
+#include "Decoder/RepoJsonReader.h"
+
+bool RepoSrcAssetList::Parse(const char* Data, size_t Size)
+{
+	Models.clear();
+
+	RepoJsonReader Reader(Data, Size);
+
+	return Reader.ReadObject([&](const RepoJsonString& Key)
+	{
+		if (!Key.Equals("models"))
+		{
+			return Reader.SkipMember();
+		}
+
+		return Reader.ReadArray([&](RepoJsonReader::Token Token)
+		{
+			if (Token != RepoJsonReader::Token::BeginObject)
+			{
+				return false;
+			}
+
+			Models.emplace_back();
+			auto& Model = Models.back();
+
+			return Reader.ReadMembers([&](const RepoJsonString& Field)
+			{
+				if (Field.Equals("database"))
+				{
+					return Reader.ReadString(Model.Database);
+				}
+				if (Field.Equals("model"))
+				{
+					return Reader.ReadString(Model.Model);
+				}
+				if (Field.Equals("assets"))
+				{
+					return Reader.ReadArray([&](RepoJsonReader::Token Asset)
+					{
+						if (Asset != RepoJsonReader::Token::String)
+						{
+							return false;
+						}
+						Model.Assets.push_back(Reader.GetString().ToString());
+						return true;
+					});
+				}
+				if (Field.Equals("offset"))
+				{
+					int NumRead = 0;
+					return Reader.ReadArray([&](RepoJsonReader::Token Element)
+					{
+						if (Element != RepoJsonReader::Token::Number)
+						{
+							return false;
+						}
+						if (NumRead < 3)
+						{
+							Model.Offset[NumRead++] = Reader.GetNumber(); // Only the first three components are used
+						}
+						return true;
+					});
+				}
+				return Reader.SkipMember();
+			});
+		});
+	});
+}
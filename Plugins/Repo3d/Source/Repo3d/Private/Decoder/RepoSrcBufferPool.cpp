@@ -0,0 +1,150 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder/RepoSrcBufferPool.h"
+#include <new>
+
+RepoSrcBufferPool::Buffer::Buffer(Buffer&& Other) :
+	Pool(Other.Pool),
+	Data(Other.Data),
+	Capacity(Other.Capacity)
+{
+	Other.Pool = nullptr;
+	Other.Data = nullptr;
+	Other.Capacity = 0;
+}
+
+RepoSrcBufferPool::Buffer& RepoSrcBufferPool::Buffer::operator=(Buffer&& Other)
+{
+	if (this != &Other)
+	{
+		Reset();
+		Pool = Other.Pool;
+		Data = Other.Data;
+		Capacity = Other.Capacity;
+		Other.Pool = nullptr;
+		Other.Data = nullptr;
+		Other.Capacity = 0;
+	}
+	return *this;
+}
+
+RepoSrcBufferPool::Buffer::~Buffer()
+{
+	Reset();
+}
+
+void RepoSrcBufferPool::Buffer::Reset()
+{
+	if (Pool)
+	{
+		Pool->Release(Data, Capacity);
+	}
+	else
+	{
+		delete[] Data;
+	}
+	Pool = nullptr;
+	Data = nullptr;
+	Capacity = 0;
+}
+
+RepoSrcBufferPool::RepoSrcBufferPool(size_t InMaxRetainedBytes) :
+	MaxRetainedBytes(InMaxRetainedBytes)
+{
+}
+
+RepoSrcBufferPool::~RepoSrcBufferPool()
+{
+	Trim();
+}
+
+RepoSrcBufferPool::Buffer RepoSrcBufferPool::Acquire(size_t Size)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		// Take the smallest free buffer that fits, as long as it would not waste more than half of itself
+
+		size_t Best = Free.size();
+		for (size_t i = 0; i < Free.size(); i++)
+		{
+			if (Free[i].Capacity >= Size && Free[i].Capacity / 2 <= Size && (Best == Free.size() || Free[i].Capacity < Free[Best].Capacity))
+			{
+				Best = i;
+			}
+		}
+
+		if (Best != Free.size())
+		{
+			Buffer Result;
+			Result.Pool = this;
+			Result.Data = Free[Best].Data;
+			Result.Capacity = Free[Best].Capacity;
+			RetainedBytes -= Free[Best].Capacity;
+			Free[Best] = Free.back();
+			Free.pop_back();
+			return Result;
+		}
+	}
+
+	Buffer Result = Allocate(Size);
+	if (Result)
+	{
+		Result.Pool = this;
+	}
+	return Result;
+}
+
+RepoSrcBufferPool::Buffer RepoSrcBufferPool::Allocate(size_t Size)
+{
+	Buffer Result;
+	Result.Data = new (std::nothrow) uint8_t[Size > 0 ? Size : 1];
+	Result.Capacity = Result.Data ? Size : 0;
+	return Result;
+}
+
+size_t RepoSrcBufferPool::GetRetainedBytes() const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return RetainedBytes;
+}
+
+void RepoSrcBufferPool::Trim()
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	for (auto& Entry : Free)
+	{
+		delete[] Entry.Data;
+	}
+	Free.clear();
+	RetainedBytes = 0;
+}
+
+void RepoSrcBufferPool::Release(uint8_t* Data, size_t Capacity)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		if (RetainedBytes + Capacity <= MaxRetainedBytes)
+		{
+			Free.push_back({ Data, Capacity });
+			RetainedBytes += Capacity;
+			return;
+		}
+	}
+	delete[] Data;
+}
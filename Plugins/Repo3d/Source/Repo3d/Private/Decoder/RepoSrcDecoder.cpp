@@ -0,0 +1,686 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder/RepoSrcDecoder.h"
+#include "Decoder/RepoJsonReader.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#ifdef THIRD_PARTY_INCLUDES_START // Defined when built as part of the Unreal module
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+#else
+#include <zlib.h>
+#endif
+
+const char* RepoSrcStatusToString(RepoSrcStatus Status)
+{
+	switch (Status)
+	{
+	case RepoSrcStatus::Ok: return "Ok";
+	case RepoSrcStatus::Truncated: return "The SRC is truncated";
+	case RepoSrcStatus::BadMagic: return "SRC magic bit mismatch. Expected 23 or 24";
+	case RepoSrcStatus::BadVersion: return "SRC version mismatch. Expected 42";
+	case RepoSrcStatus::BadHeader: return "The SRC header is malformed or references a missing view";
+	case RepoSrcStatus::InflateFailed: return "The SRC buffer could not be inflated";
+	case RepoSrcStatus::UnsupportedChunks: return "The SRC has a bufferView with no chunks";
+	case RepoSrcStatus::UnsupportedComponentType: return "The SRC has an accessor with an unsupported componentType";
+	case RepoSrcStatus::ChunkLengthMismatch: return "Buffer chunk length mismatch. Possible corruption";
+	case RepoSrcStatus::OutOfBounds: return "A buffer chunk lies outside of the SRC buffer. Possible corruption";
+	case RepoSrcStatus::OutOfMemory: return "Could not allocate memory to gather the chunks of a bufferView";
+	}
+	return "Unknown";
+}
+
+// The state of an incremental inflation, kept out of the header so that it does not need zlib
+struct RepoSrcDecoder::InflateStream
+{
+	z_stream z = {};
+	bool bInitialised = false;
+
+	~InflateStream()
+	{
+		if (bInitialised)
+		{
+			inflateEnd(&z);
+		}
+	}
+};
+
+RepoSrcDecoder::RepoSrcDecoder() = default;
+RepoSrcDecoder::~RepoSrcDecoder() = default;
+
+RepoSrcStatus RepoSrcDecoder::Decode(const uint8_t* Data, size_t Size)
+{
+	auto Status = ReadPreamble(Data, Size);
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Status = ParseHeader();
+	}
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Status = Inflate();
+	}
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Status = ResolveMeshes();
+	}
+	return Status;
+}
+
+RepoSrcStatus RepoSrcDecoder::ReadPreamble(const uint8_t* Data, size_t Size)
+{
+	Input = Data;
+	InputSize = Size;
+
+	if (Size < 12)
+	{
+		return RepoSrcStatus::Truncated;
+	}
+
+	uint32_t Preamble[3];
+	memcpy(Preamble, Data, sizeof(Preamble));
+
+	if (Preamble[0] != MagicUncompressed && Preamble[0] != MagicCompressed)
+	{
+		return RepoSrcStatus::BadMagic;
+	}
+	if (Preamble[1] != Version)
+	{
+		return RepoSrcStatus::BadVersion;
+	}
+
+	bCompressed = Preamble[0] == MagicCompressed;
+
+	HeaderSize = Preamble[2];
+	if (HeaderSize > Size - 12)
+	{
+		return RepoSrcStatus::Truncated;
+	}
+	Header = (const char*)(Data + 12); // The exporter explicitly uses 12
+
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::ParseHeader()
+{
+	MeshEntries.clear();
+	IndexViews.clear();
+	AttributeViews.clear();
+	BufferViews.clear();
+	BufferChunks.clear();
+
+	RepoJsonReader Reader(Header, HeaderSize);
+
+	bool bParsed = Reader.ReadObject([&](const RepoJsonString& Key)
+	{
+		if (Key.Equals("meshes"))
+		{
+			return ParseMeshes(Reader);
+		}
+		if (Key.Equals("accessors"))
+		{
+			return ParseAccessors(Reader);
+		}
+		if (Key.Equals("bufferViews"))
+		{
+			return ParseBufferViews(Reader);
+		}
+		if (Key.Equals("bufferChunks"))
+		{
+			return ParseBufferChunks(Reader);
+		}
+		return Reader.SkipMember();
+	});
+
+	return bParsed ? RepoSrcStatus::Ok : RepoSrcStatus::BadHeader;
+}
+
+bool RepoSrcDecoder::ParseMeshes(RepoJsonReader& Reader)
+{
+	// A 3D Repo scene will have multiple meshes, each delivered as a separate SRC. Within the SRC there are multiple meshes
+	// with correspond to the split parts of the SRC's scene mesh.
+
+	return Reader.ReadObject([&](const RepoJsonString& Name)
+	{
+		MeshEntries.emplace_back();
+		auto& Mesh = MeshEntries.back();
+		Mesh.Name = Name.ToString();
+
+		return Reader.ReadObject([&](const RepoJsonString& Key)
+		{
+			if (Key.Equals("indices"))
+			{
+				return Reader.ReadString(Mesh.Indices);
+			}
+			if (Key.Equals("attributes"))
+			{
+				return Reader.ReadObject([&](const RepoJsonString& Attribute)
+				{
+					if (Attribute.Equals("position"))
+					{
+						return Reader.ReadString(Mesh.Position);
+					}
+					if (Attribute.Equals("normal"))
+					{
+						return Reader.ReadString(Mesh.Normal);
+					}
+					if (Attribute.Equals("texcoord"))
+					{
+						return Reader.ReadString(Mesh.Texcoord);
+					}
+					if (Attribute.Equals("id"))
+					{
+						return Reader.ReadString(Mesh.Id);
+					}
+					return Reader.SkipMember();
+				});
+			}
+			return Reader.SkipMember();
+		});
+	});
+}
+
+bool RepoSrcDecoder::ParseAccessors(RepoJsonReader& Reader)
+{
+	return Reader.ReadObject([&](const RepoJsonString& Key)
+	{
+		if (Key.Equals("indexViews"))
+		{
+			return Reader.ReadObject([&](const RepoJsonString& Name)
+			{
+				auto& View = IndexViews[Name.ToString()];
+				return Reader.ReadObject([&](const RepoJsonString& Field)
+				{
+					if (Field.Equals("byteOffset"))
+					{
+						return Reader.ReadUInt64(View.ByteOffset);
+					}
+					if (Field.Equals("count"))
+					{
+						return Reader.ReadUInt32(View.Count);
+					}
+					if (Field.Equals("componentType"))
+					{
+						return Reader.ReadUInt32(View.ComponentType);
+					}
+					if (Field.Equals("bufferView"))
+					{
+						return Reader.ReadString(View.BufferView);
+					}
+					return Reader.SkipMember();
+				});
+			});
+		}
+		if (Key.Equals("attributeViews"))
+		{
+			return Reader.ReadObject([&](const RepoJsonString& Name)
+			{
+				auto& View = AttributeViews[Name.ToString()];
+				return Reader.ReadObject([&](const RepoJsonString& Field)
+				{
+					if (Field.Equals("byteOffset"))
+					{
+						return Reader.ReadUInt64(View.ByteOffset);
+					}
+					if (Field.Equals("byteStride"))
+					{
+						return Reader.ReadUInt32(View.ByteStride);
+					}
+					if (Field.Equals("count"))
+					{
+						return Reader.ReadUInt32(View.Count);
+					}
+					if (Field.Equals("componentType"))
+					{
+						return Reader.ReadUInt32(View.ComponentType);
+					}
+					if (Field.Equals("type"))
+					{
+						return Reader.ReadString(View.Type);
+					}
+					if (Field.Equals("bufferView"))
+					{
+						return Reader.ReadString(View.BufferView);
+					}
+					return Reader.SkipMember(); // Offset and scale are assumed to be identity
+				});
+			});
+		}
+		return Reader.SkipMember();
+	});
+}
+
+bool RepoSrcDecoder::ParseBufferViews(RepoJsonReader& Reader)
+{
+	return Reader.ReadObject([&](const RepoJsonString& Name)
+	{
+		auto& View = BufferViews[Name.ToString()];
+		return Reader.ReadObject([&](const RepoJsonString& Field)
+		{
+			if (Field.Equals("chunks"))
+			{
+				if (Reader.Next() != RepoJsonReader::Token::BeginArray)
+				{
+					return false;
+				}
+				while (Reader.Next() == RepoJsonReader::Token::String)
+				{
+					View.Chunks.push_back(Reader.GetString().ToString());
+				}
+				return Reader.GetToken() == RepoJsonReader::Token::EndArray;
+			}
+			return Reader.SkipMember();
+		});
+	});
+}
+
+bool RepoSrcDecoder::ParseBufferChunks(RepoJsonReader& Reader)
+{
+	return Reader.ReadObject([&](const RepoJsonString& Name)
+	{
+		auto& Chunk = BufferChunks[Name.ToString()];
+		return Reader.ReadObject([&](const RepoJsonString& Field)
+		{
+			if (Field.Equals("byteOffset"))
+			{
+				return Reader.ReadUInt64(Chunk.ByteOffset);
+			}
+			if (Field.Equals("byteLength"))
+			{
+				return Reader.ReadUInt64(Chunk.ByteLength);
+			}
+			return Reader.SkipMember();
+		});
+	});
+}
+
+RepoSrcStatus RepoSrcDecoder::Inflate()
+{
+	auto Status = BeginInflate();
+	while (Status == RepoSrcStatus::Ok && !IsInflated())
+	{
+		Status = InflateSome(BufferSize - InflatedSize);
+	}
+	return Status;
+}
+
+RepoSrcStatus RepoSrcDecoder::BeginInflate()
+{
+	const uint8_t* Body = Input + 12 + HeaderSize;
+	size_t BodySize = InputSize - 12 - HeaderSize;
+
+	Stream.reset();
+	Inflated.Reset();
+	ClearGatheredViews();
+	Buffer = nullptr;
+	BufferSize = 0;
+	InflatedSize = 0;
+
+	if (!bCompressed)
+	{
+		Buffer = Body;
+		BufferSize = BodySize;
+		InflatedSize = BodySize;
+		return RepoSrcStatus::Ok;
+	}
+
+	// Compressed buffers are prefixed with their uncompressed size
+
+	if (BodySize < 4)
+	{
+		return RepoSrcStatus::Truncated;
+	}
+
+	uint32_t UncompressedSize;
+	memcpy(&UncompressedSize, Body, sizeof(UncompressedSize));
+
+	if (BodySize - 4 > std::numeric_limits<uInt>::max())
+	{
+		return RepoSrcStatus::InflateFailed;
+	}
+
+	Inflated = Pool ? Pool->Acquire(UncompressedSize) : RepoSrcBufferPool::Allocate(UncompressedSize);
+	Stream.reset(new (std::nothrow) InflateStream());
+	if (!Inflated || !Stream)
+	{
+		return FailInflate();
+	}
+
+	auto& z = Stream->z;
+	z.next_in = (Bytef*)(Body + 4);
+	z.avail_in = (uInt)(BodySize - 4);
+	if (inflateInit(&z) != Z_OK)
+	{
+		return FailInflate();
+	}
+	Stream->bInitialised = true;
+
+	Buffer = Inflated.GetData();
+	BufferSize = UncompressedSize;
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::InflateSome(size_t MaxBytes)
+{
+	if (IsInflated())
+	{
+		return RepoSrcStatus::Ok;
+	}
+	if (!Stream)
+	{
+		return RepoSrcStatus::InflateFailed;
+	}
+
+	auto& z = Stream->z;
+	auto Bytes = std::min<size_t>(std::min(MaxBytes, BufferSize - InflatedSize), std::numeric_limits<uInt>::max());
+	z.next_out = Inflated.GetData() + InflatedSize;
+	z.avail_out = (uInt)Bytes;
+
+	auto Result = inflate(&z, Z_SYNC_FLUSH);
+	auto Produced = Bytes - z.avail_out;
+	InflatedSize += Produced;
+
+	if (Result == Z_STREAM_END)
+	{
+		if (InflatedSize != BufferSize)
+		{
+			return FailInflate();
+		}
+		Stream.reset();
+		return RepoSrcStatus::Ok;
+	}
+
+	if ((Result != Z_OK && Result != Z_BUF_ERROR) || Produced == 0)
+	{
+		return FailInflate(); // Corrupt, or the input ended before the buffer was filled
+	}
+
+	if (IsInflated())
+	{
+		// The buffer is full, so the stream must end here, without producing any more output
+
+		uint8_t Extra;
+		z.next_out = &Extra;
+		z.avail_out = 1;
+		if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out != 1)
+		{
+			return FailInflate();
+		}
+		Stream.reset();
+	}
+
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::FailInflate()
+{
+	Stream.reset();
+	Inflated.Reset();
+	Buffer = nullptr;
+	BufferSize = 0;
+	InflatedSize = 0;
+	return RepoSrcStatus::InflateFailed;
+}
+
+void RepoSrcDecoder::ClearGatheredViews()
+{
+	GatheredViews.clear();
+	if (!Arena)
+	{
+		OwnArena.Reset();
+	}
+}
+
+RepoSrcStatus RepoSrcDecoder::ResolveMeshes()
+{
+	Meshes.clear();
+	ClearGatheredViews();
+
+	if (!IsInflated())
+	{
+		return RepoSrcStatus::InflateFailed;
+	}
+
+	Meshes.resize(MeshEntries.size());
+	for (size_t i = 0; i < MeshEntries.size(); i++)
+	{
+		auto Status = ResolveMesh(i, Meshes[i]);
+		if (Status != RepoSrcStatus::Ok)
+		{
+			Meshes.clear();
+			return Status;
+		}
+	}
+
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::GetMeshExtent(size_t Index, uint64_t& Extent) const
+{
+	auto& Entry = MeshEntries[Index];
+
+	Extent = 0;
+
+	auto Indices = IndexViews.find(Entry.Indices);
+	if (Indices == IndexViews.end())
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+	auto Status = GetViewExtent(Indices->second.BufferView, Extent);
+
+	for (auto Attribute : { &Entry.Position, &Entry.Normal, &Entry.Texcoord, &Entry.Id })
+	{
+		if (Status != RepoSrcStatus::Ok || Attribute->empty())
+		{
+			continue;
+		}
+		auto View = AttributeViews.find(*Attribute);
+		if (View == AttributeViews.end())
+		{
+			return RepoSrcStatus::BadHeader;
+		}
+		Status = GetViewExtent(View->second.BufferView, Extent);
+	}
+
+	return Status;
+}
+
+RepoSrcStatus RepoSrcDecoder::GetViewExtent(const std::string& BufferViewName, uint64_t& Extent) const
+{
+	auto View = BufferViews.find(BufferViewName);
+	if (View == BufferViews.end())
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+	for (auto& ChunkName : View->second.Chunks)
+	{
+		auto Chunk = BufferChunks.find(ChunkName);
+		if (Chunk == BufferChunks.end())
+		{
+			return RepoSrcStatus::BadHeader;
+		}
+		if (Chunk->second.ByteLength > std::numeric_limits<uint64_t>::max() - Chunk->second.ByteOffset)
+		{
+			return RepoSrcStatus::OutOfBounds;
+		}
+		Extent = std::max(Extent, Chunk->second.ByteOffset + Chunk->second.ByteLength);
+	}
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::ResolveMesh(size_t Index, RepoSrcMesh& Mesh)
+{
+	auto& Entry = MeshEntries[Index];
+	Mesh = RepoSrcMesh();
+	Mesh.Name = Entry.Name;
+
+	auto Status = ResolveIndices(Entry.Indices, Mesh.Indices);
+	if (Status == RepoSrcStatus::Ok && !Entry.Position.empty())
+	{
+		Status = ResolveAttribute(Entry.Position, 3, Mesh.Positions);
+	}
+	if (Status == RepoSrcStatus::Ok && !Entry.Normal.empty())
+	{
+		Status = ResolveAttribute(Entry.Normal, 3, Mesh.Normals);
+	}
+	if (Status == RepoSrcStatus::Ok && !Entry.Texcoord.empty())
+	{
+		Status = ResolveAttribute(Entry.Texcoord, 2, Mesh.Texcoords);
+	}
+	if (Status == RepoSrcStatus::Ok && !Entry.Id.empty())
+	{
+		Status = ResolveAttribute(Entry.Id, 1, Mesh.Ids);
+	}
+	return Status;
+}
+
+RepoSrcStatus RepoSrcDecoder::ResolveView(const std::string& BufferViewName, uint64_t ViewOffset, uint64_t ViewLength, const uint8_t*& Data)
+{
+	auto View = BufferViews.find(BufferViewName);
+	if (View == BufferViews.end())
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+
+	auto& ChunkNames = View->second.Chunks;
+	if (ChunkNames.empty())
+	{
+		return RepoSrcStatus::UnsupportedChunks;
+	}
+
+	// A bufferView is its chunks, concatenated in order. Exporters write the chunks of a view one after the other, so
+	// they can usually be referenced in place.
+
+	std::vector<const BufferChunk*> Chunks;
+	Chunks.reserve(ChunkNames.size());
+
+	uint64_t Length = 0;
+	bool bContiguous = true;
+	for (auto& ChunkName : ChunkNames)
+	{
+		auto Chunk = BufferChunks.find(ChunkName);
+		if (Chunk == BufferChunks.end())
+		{
+			return RepoSrcStatus::BadHeader;
+		}
+
+		if (Chunk->second.ByteOffset > InflatedSize || Chunk->second.ByteLength > InflatedSize - Chunk->second.ByteOffset)
+		{
+			return RepoSrcStatus::OutOfBounds;
+		}
+
+		if (!Chunks.empty() && Chunks.back()->ByteOffset + Chunks.back()->ByteLength != Chunk->second.ByteOffset)
+		{
+			bContiguous = false;
+		}
+
+		if (Chunk->second.ByteLength > std::numeric_limits<uint64_t>::max() - Length) // A view may list the same chunk many times
+		{
+			return RepoSrcStatus::OutOfBounds;
+		}
+
+		Chunks.push_back(&Chunk->second);
+		Length += Chunk->second.ByteLength;
+	}
+
+	if (ViewOffset > Length || ViewLength != Length - ViewOffset) // Not ViewOffset + ViewLength, which a crafted header could overflow
+	{
+		return RepoSrcStatus::ChunkLengthMismatch;
+	}
+
+	if (bContiguous)
+	{
+		Data = Buffer + Chunks[0]->ByteOffset + ViewOffset;
+		return RepoSrcStatus::Ok;
+	}
+
+	auto& Gathered = GatheredViews[BufferViewName]; // Views may be shared by several accessors
+	if (!Gathered)
+	{
+		auto Destination = (Arena ? Arena : &OwnArena)->Allocate<uint8_t>(Length);
+		if (!Destination)
+		{
+			GatheredViews.erase(BufferViewName);
+			return RepoSrcStatus::OutOfMemory;
+		}
+
+		Gathered = Destination;
+		for (auto Chunk : Chunks)
+		{
+			memcpy(Destination, Buffer + Chunk->ByteOffset, Chunk->ByteLength);
+			Destination += Chunk->ByteLength;
+		}
+	}
+
+	Data = Gathered + ViewOffset;
+	return RepoSrcStatus::Ok;
+}
+
+RepoSrcStatus RepoSrcDecoder::ResolveIndices(const std::string& ViewName, RepoSrcStream& Stream)
+{
+	auto View = IndexViews.find(ViewName);
+	if (View == IndexViews.end())
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+
+	switch (View->second.ComponentType)
+	{
+	case ComponentTypeUInt16:
+		Stream.Stride = sizeof(uint16_t);
+		break;
+	case ComponentTypeUInt32:
+		Stream.Stride = sizeof(uint32_t);
+		break;
+	default:
+		return RepoSrcStatus::UnsupportedComponentType;
+	}
+
+	Stream.Count = View->second.Count;
+	Stream.ComponentType = View->second.ComponentType;
+	return ResolveView(View->second.BufferView, View->second.ByteOffset, (uint64_t)Stream.Stride * Stream.Count, Stream.Data);
+}
+
+RepoSrcStatus RepoSrcDecoder::ResolveAttribute(const std::string& ViewName, uint32_t Components, RepoSrcStream& Stream)
+{
+	auto View = AttributeViews.find(ViewName);
+	if (View == AttributeViews.end())
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+
+	if (View->second.ComponentType != ComponentTypeFloat)
+	{
+		return RepoSrcStatus::UnsupportedComponentType;
+	}
+
+	// Attributes may be interleaved, but every element must at least hold the components the caller expects
+
+	if (View->second.ByteStride < Components * sizeof(float))
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+
+	Stream.Count = View->second.Count;
+	Stream.Stride = View->second.ByteStride;
+	Stream.ComponentType = View->second.ComponentType;
+	return ResolveView(View->second.BufferView, View->second.ByteOffset, (uint64_t)Stream.Stride * Stream.Count, Stream.Data);
+}
@@ -0,0 +1,273 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include "Decoder/RepoSrcGeometryFile.h"
+#include <cstring>
+
+// A geometry file is this header, then the mesh and section records, padded to a page, then the streams. The offsets
+// in the section records are from the start of the file.
+struct RepoSrcGeometryFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t MeshRecordSize; // Guards against reading a file written by a build with a different layout
+	uint32_t SectionRecordSize;
+	uint32_t NumMeshes;
+	uint32_t NumSections;
+	uint64_t FileSize;
+};
+
+static const int NumStreams = 5;
+
+static size_t AlignUp(size_t Value, size_t Alignment)
+{
+	return (Value + Alignment - 1) / Alignment * Alignment;
+}
+
+// The element size and component type of each stream, in the order of SectionRecord::Offsets
+static const uint32_t StreamElementSizes[NumStreams] = { 4, 12, 12, 8, 4 };
+static const uint32_t StreamComponentTypes[NumStreams] = {
+	RepoSrcDecoder::ComponentTypeUInt32,
+	RepoSrcDecoder::ComponentTypeFloat,
+	RepoSrcDecoder::ComponentTypeFloat,
+	RepoSrcDecoder::ComponentTypeFloat,
+	RepoSrcDecoder::ComponentTypeFloat
+};
+
+static RepoSrcStream* GetStream(RepoSrcGeometrySection& Section, int Index)
+{
+	RepoSrcStream* Streams[NumStreams] = { &Section.Indices, &Section.Positions, &Section.Normals, &Section.Texcoords, &Section.Ids };
+	return Streams[Index];
+}
+
+RepoSrcStatus RepoSrcGeometryFile::Open(const uint8_t* InData, size_t Size)
+{
+	Data = nullptr;
+	Meshes.clear();
+	Sections.clear();
+
+	RepoSrcGeometryFileHeader Header;
+	if (Size < sizeof(Header))
+	{
+		return RepoSrcStatus::Truncated;
+	}
+	memcpy(&Header, InData, sizeof(Header));
+
+	if (Header.Magic != Magic)
+	{
+		return RepoSrcStatus::BadMagic;
+	}
+	if (Header.Version != Version)
+	{
+		return RepoSrcStatus::BadVersion;
+	}
+	if (Header.FileSize != Size)
+	{
+		return RepoSrcStatus::Truncated;
+	}
+	if (Header.MeshRecordSize != sizeof(MeshRecord) ||
+		Header.SectionRecordSize != sizeof(SectionRecord) ||
+		(uintptr_t)InData % StreamAlignment != 0 ||
+		Header.NumMeshes > Size / sizeof(MeshRecord) ||
+		Header.NumSections > Size / sizeof(SectionRecord) ||
+		sizeof(Header) + (uint64_t)Header.NumMeshes * sizeof(MeshRecord) + (uint64_t)Header.NumSections * sizeof(SectionRecord) > Size)
+	{
+		return RepoSrcStatus::BadHeader;
+	}
+
+	auto Cursor = InData + sizeof(Header);
+
+	Meshes.resize(Header.NumMeshes);
+	memcpy(Meshes.data(), Cursor, Meshes.size() * sizeof(MeshRecord));
+	Cursor += Meshes.size() * sizeof(MeshRecord);
+
+	Sections.resize(Header.NumSections);
+	memcpy(Sections.data(), Cursor, Sections.size() * sizeof(SectionRecord));
+
+	// The records are only validated, as they were copied as they are
+
+	for (auto& Mesh : Meshes)
+	{
+		if ((uint64_t)Mesh.FirstSection + Mesh.NumSections > Sections.size())
+		{
+			return RepoSrcStatus::OutOfBounds;
+		}
+	}
+
+	for (auto& Section : Sections)
+	{
+		if ((Section.Streams & 3) != 3) // Indices and Positions are required
+		{
+			return RepoSrcStatus::BadHeader;
+		}
+		for (int i = 0; i < NumStreams; i++)
+		{
+			if (!(Section.Streams & (1u << i)))
+			{
+				continue;
+			}
+			auto Count = i == 0 ? Section.NumIndices : Section.NumVertices;
+			auto Offset = Section.Offsets[i];
+			if (Offset % StreamAlignment != 0 || Offset > Size || (uint64_t)Count * StreamElementSizes[i] > Size - Offset)
+			{
+				return RepoSrcStatus::OutOfBounds;
+			}
+		}
+	}
+
+	Data = InData;
+	return RepoSrcStatus::Ok;
+}
+
+void RepoSrcGeometryFile::GetMesh(size_t Index, RepoSrcGeometryMesh& Mesh) const
+{
+	auto& Record = Meshes[Index];
+	Mesh.Sections.resize(Record.NumSections);
+
+	for (uint32_t s = 0; s < Record.NumSections; s++)
+	{
+		auto& Source = Sections[Record.FirstSection + s];
+		auto& Section = Mesh.Sections[s];
+
+		Section.bTranslucent = Source.bTranslucent != 0;
+		memcpy(Section.Bounds, Source.Bounds, sizeof(Section.Bounds));
+
+		for (int i = 0; i < NumStreams; i++)
+		{
+			auto Stream = GetStream(Section, i);
+			*Stream = RepoSrcStream();
+			if (Source.Streams & (1u << i))
+			{
+				Stream->Data = Data + Source.Offsets[i];
+				Stream->Count = i == 0 ? Source.NumIndices : Source.NumVertices;
+				Stream->Stride = StreamElementSizes[i];
+				Stream->ComponentType = StreamComponentTypes[i];
+			}
+		}
+	}
+}
+
+void RepoSrcGeometryWriter::AddMesh(const RepoSrcGeometryMesh& Mesh)
+{
+	// Each mesh begins on a page, so that reading one from a mapped file does not touch the pages of its neighbours
+
+	Streams.resize(AlignUp(Streams.size(), RepoSrcGeometryFile::PageSize));
+
+	RepoSrcGeometryFile::MeshRecord Record;
+	Record.FirstSection = (uint32_t)Sections.size();
+	Record.NumSections = (uint32_t)Mesh.Sections.size();
+	Meshes.push_back(Record);
+
+	for (auto Section : Mesh.Sections) // A copy, so that GetStream() can take it
+	{
+		RepoSrcGeometryFile::SectionRecord Written = {};
+		Written.bTranslucent = Section.bTranslucent;
+		Written.NumVertices = Section.Positions.Count;
+		Written.NumIndices = Section.Indices.Count;
+		memcpy(Written.Bounds, Section.Bounds, sizeof(Written.Bounds));
+
+		for (int i = 0; i < NumStreams; i++)
+		{
+			auto Stream = GetStream(Section, i);
+			auto Count = i == 0 ? Written.NumIndices : Written.NumVertices;
+			if (i < 2 || (Stream->IsValid() && Stream->Count == Count))
+			{
+				Written.Streams |= 1u << i;
+				Written.Offsets[i] = AddStream(*Stream, StreamElementSizes[i]);
+			}
+		}
+
+		Sections.push_back(Written);
+	}
+}
+
+uint64_t RepoSrcGeometryWriter::AddStream(const RepoSrcStream& Stream, size_t ElementSize)
+{
+	auto Offset = AlignUp(Streams.size(), RepoSrcGeometryFile::StreamAlignment);
+	Streams.resize(Offset + (size_t)Stream.Count * ElementSize);
+
+	if (Stream.Count == 0)
+	{
+		return Offset;
+	}
+
+	auto Out = Streams.data() + Offset;
+	if (Stream.Stride == ElementSize)
+	{
+		memcpy(Out, Stream.Data, (size_t)Stream.Count * ElementSize);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < Stream.Count; i++)
+		{
+			memcpy(Out + i * ElementSize, Stream.Data + (size_t)i * Stream.Stride, ElementSize);
+		}
+	}
+
+	return Offset;
+}
+
+size_t RepoSrcGeometryWriter::GetTablesSize() const
+{
+	auto Size = sizeof(RepoSrcGeometryFileHeader) + Meshes.size() * sizeof(RepoSrcGeometryFile::MeshRecord) + Sections.size() * sizeof(RepoSrcGeometryFile::SectionRecord);
+	return AlignUp(Size, RepoSrcGeometryFile::PageSize);
+}
+
+size_t RepoSrcGeometryWriter::GetSize() const
+{
+	return GetTablesSize() + Streams.size();
+}
+
+void RepoSrcGeometryWriter::Write(uint8_t* Out) const
+{
+	auto TablesSize = GetTablesSize();
+
+	RepoSrcGeometryFileHeader Header = {};
+	Header.Magic = RepoSrcGeometryFile::Magic;
+	Header.Version = RepoSrcGeometryFile::Version;
+	Header.MeshRecordSize = sizeof(RepoSrcGeometryFile::MeshRecord);
+	Header.SectionRecordSize = sizeof(RepoSrcGeometryFile::SectionRecord);
+	Header.NumMeshes = (uint32_t)Meshes.size();
+	Header.NumSections = (uint32_t)Sections.size();
+	Header.FileSize = GetSize();
+
+	memset(Out, 0, TablesSize);
+
+	auto Cursor = Out;
+	memcpy(Cursor, &Header, sizeof(Header));
+	Cursor += sizeof(Header);
+
+	memcpy(Cursor, Meshes.data(), Meshes.size() * sizeof(RepoSrcGeometryFile::MeshRecord));
+	Cursor += Meshes.size() * sizeof(RepoSrcGeometryFile::MeshRecord);
+
+	for (auto Section : Sections)
+	{
+		for (int i = 0; i < NumStreams; i++)
+		{
+			if (Section.Streams & (1u << i))
+			{
+				Section.Offsets[i] += TablesSize;
+			}
+		}
+		memcpy(Cursor, &Section, sizeof(Section));
+		Cursor += sizeof(Section);
+	}
+
+	memcpy(Out + TablesSize, Streams.data(), Streams.size());
+}
@@ -0,0 +1,758 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder/RepoSrcKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// The vector paths are chosen at compile time, from the instruction sets the compiler targets. SSE2 is always
+// available on x64, and NEON on arm64. AVX2 is only used if the module is compiled with it enabled (e.g. -mavx2).
+// Define REPO_SRC_KERNELS_SCALAR to build only the scalar implementations.
+
+#if !defined(REPO_SRC_KERNELS_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define REPO_SRC_KERNELS_SSE2 1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define REPO_SRC_KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define REPO_SRC_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+const char* RepoSrcKernels::GetInstructionSet()
+{
+#if defined(REPO_SRC_KERNELS_AVX2)
+	return "AVX2";
+#elif defined(REPO_SRC_KERNELS_SSE2)
+	return "SSE2";
+#elif defined(REPO_SRC_KERNELS_NEON)
+	return "NEON";
+#else
+	return "Scalar";
+#endif
+}
+
+// Resolves a local id through the map, or returns false if it is negative, NaN or outside the map
+static inline bool LookupId(float Id, const uint32_t* LocalToActor, size_t MapSize, uint32_t& Actor)
+{
+	// Compare as floats first, since converting NaN, inf or ids beyond the range of size_t is undefined
+	if (!(Id >= 0.0f) || !(Id < (float)MapSize))
+	{
+		return false;
+	}
+	Actor = LocalToActor[(size_t)Id];
+	return true;
+}
+
+void RepoSrcScalarKernels::WidenIndices(const RepoSrcStream& Indices, int32_t* Out)
+{
+	auto Data = Indices.Data;
+	if (Indices.ComponentType == RepoSrcDecoder::ComponentTypeUInt32)
+	{
+		// Indices above INT32_MAX become negative, and so are rejected by the kernels that range-check them
+		memcpy(Out, Data, (size_t)Indices.Count * sizeof(uint32_t));
+		return;
+	}
+
+	for (uint32_t i = 0; i < Indices.Count; i++)
+	{
+		uint16_t Index;
+		memcpy(&Index, Data + i * sizeof(uint16_t), sizeof(Index));
+		Out[i] = Index;
+	}
+}
+
+bool RepoSrcScalarKernels::CheckIndices(const int32_t* Indices, size_t NumIndices, size_t NumVertices)
+{
+	for (size_t i = 0; i < NumIndices; i++)
+	{
+		if ((uint32_t)Indices[i] >= NumVertices)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void RepoSrcScalarKernels::UnityToUnreal(const RepoSrcStream& Vectors, float* Out)
+{
+	auto Data = Vectors.Data;
+	for (uint32_t i = 0; i < Vectors.Count; i++)
+	{
+		float v[3];
+		memcpy(v, Data, sizeof(v));
+		Data += Vectors.Stride;
+
+		// (x, y, z) -> (-x, -z, y)
+		Out[0] = -v[0];
+		Out[1] = -v[2];
+		Out[2] = v[1];
+		Out += 3;
+	}
+}
+
+bool RepoSrcScalarKernels::GenerateSupermeshMapIndices(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, float* Out)
+{
+	for (size_t i = 0; i < NumIds; i++)
+	{
+		uint32_t Actor;
+		if (!LookupId(Ids[i], LocalToActor, MapSize, Actor))
+		{
+			return false;
+		}
+		Out[i * 2 + 0] = Ids[i];
+		Out[i * 2 + 1] = (float)Actor;
+	}
+	return true;
+}
+
+void RepoSrcScalarKernels::UnityToUnrealInterleaved(const RepoSrcStream& Vectors, uint8_t* Out, size_t OutStride, float* Bounds)
+{
+	float Min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float Max[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+	auto Data = Vectors.Data;
+	for (uint32_t i = 0; i < Vectors.Count; i++)
+	{
+		float v[3];
+		memcpy(v, Data, sizeof(v));
+		Data += Vectors.Stride;
+
+		// (x, y, z) -> (-x, -z, y)
+		float o[3] = { -v[0], -v[2], v[1] };
+		memcpy(Out, o, sizeof(o));
+		Out += OutStride;
+
+		if (Bounds)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				Min[c] = o[c] < Min[c] ? o[c] : Min[c];
+				Max[c] = o[c] > Max[c] ? o[c] : Max[c];
+			}
+		}
+	}
+
+	if (Bounds)
+	{
+		memcpy(Bounds, Min, sizeof(Min));
+		memcpy(Bounds + 3, Max, sizeof(Max));
+	}
+}
+
+void RepoSrcScalarKernels::CopyFloatsInterleaved(const RepoSrcStream& Stream, uint32_t Components, uint8_t* Out, size_t OutStride)
+{
+	auto ElementSize = Components * sizeof(float);
+	auto Data = Stream.Data;
+	for (uint32_t i = 0; i < Stream.Count; i++)
+	{
+		memcpy(Out, Data, ElementSize);
+		Data += Stream.Stride;
+		Out += OutStride;
+	}
+}
+
+bool RepoSrcScalarKernels::GenerateSupermeshMapIndicesInterleaved(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, uint8_t* Out, size_t OutStride)
+{
+	for (size_t i = 0; i < NumIds; i++)
+	{
+		uint32_t Actor;
+		if (!LookupId(Ids[i], LocalToActor, MapSize, Actor))
+		{
+			return false;
+		}
+		float Pair[2] = { Ids[i], (float)Actor };
+		memcpy(Out, Pair, sizeof(Pair));
+		Out += OutStride;
+	}
+	return true;
+}
+
+bool RepoSrcScalarKernels::GenerateTriangleIdMap(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, int32_t* Out)
+{
+	auto NumTriangles = NumIndices / 3;
+	for (size_t i = 0; i < NumTriangles; i++)
+	{
+		auto Index0 = (size_t)Indices[i * 3];
+		if (Index0 >= NumIds)
+		{
+			return false;
+		}
+		uint32_t Actor;
+		if (!LookupId(Ids[Index0], LocalToActor, MapSize, Actor))
+		{
+			return false;
+		}
+		Out[i] = (int32_t)Actor;
+	}
+	return true;
+}
+
+void RepoSrcKernels::WidenIndices(const RepoSrcStream& Indices, int32_t* Out)
+{
+	if (Indices.ComponentType != RepoSrcDecoder::ComponentTypeUInt16)
+	{
+		RepoSrcScalarKernels::WidenIndices(Indices, Out);
+		return;
+	}
+
+	auto Data = Indices.Data;
+	uint32_t i = 0;
+
+#if defined(REPO_SRC_KERNELS_AVX2)
+	for (; i + 16 <= Indices.Count; i += 16)
+	{
+		auto Lo = _mm_loadu_si128((const __m128i*)(Data + i * 2));
+		auto Hi = _mm_loadu_si128((const __m128i*)(Data + i * 2 + 16));
+		_mm256_storeu_si256((__m256i*)(Out + i), _mm256_cvtepu16_epi32(Lo));
+		_mm256_storeu_si256((__m256i*)(Out + i + 8), _mm256_cvtepu16_epi32(Hi));
+	}
+#elif defined(REPO_SRC_KERNELS_SSE2)
+	auto Zero = _mm_setzero_si128();
+	for (; i + 8 <= Indices.Count; i += 8)
+	{
+		auto v = _mm_loadu_si128((const __m128i*)(Data + i * 2));
+		_mm_storeu_si128((__m128i*)(Out + i), _mm_unpacklo_epi16(v, Zero));
+		_mm_storeu_si128((__m128i*)(Out + i + 4), _mm_unpackhi_epi16(v, Zero));
+	}
+#elif defined(REPO_SRC_KERNELS_NEON)
+	for (; i + 8 <= Indices.Count; i += 8)
+	{
+		auto v = vreinterpretq_u16_u8(vld1q_u8(Data + i * 2)); // Byte loads, as the stream may not be aligned
+		vst1q_s32(Out + i, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))));
+		vst1q_s32(Out + i + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v))));
+	}
+#endif
+
+	RepoSrcStream Tail = Indices;
+	Tail.Data = Data + i * sizeof(uint16_t);
+	Tail.Count = Indices.Count - i;
+	RepoSrcScalarKernels::WidenIndices(Tail, Out + i);
+}
+
+bool RepoSrcKernels::CheckIndices(const int32_t* Indices, size_t NumIndices, size_t NumVertices)
+{
+	// The maximum is taken as unsigned, so negative indices compare as out of range. The loop has no early exit, so
+	// the compiler vectorises it.
+
+	uint32_t Max = 0;
+	for (size_t i = 0; i < NumIndices; i++)
+	{
+		Max = std::max(Max, (uint32_t)Indices[i]);
+	}
+	return NumIndices == 0 || Max < NumVertices;
+}
+
+void RepoSrcKernels::UnityToUnreal(const RepoSrcStream& Vectors, float* Out)
+{
+	// Only packed streams are vectorised. Four vertices are three registers: (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3).
+
+	auto Data = Vectors.Data;
+	uint32_t i = 0;
+
+#if defined(REPO_SRC_KERNELS_SSE2)
+	if (Vectors.Stride == sizeof(float) * 3)
+	{
+		auto Sign0 = _mm_castsi128_ps(_mm_setr_epi32(INT32_MIN, INT32_MIN, 0, INT32_MIN));
+		auto Sign1 = _mm_castsi128_ps(_mm_setr_epi32(INT32_MIN, 0, INT32_MIN, INT32_MIN));
+		auto Sign2 = _mm_castsi128_ps(_mm_setr_epi32(0, INT32_MIN, INT32_MIN, 0));
+
+		for (; i + 4 <= Vectors.Count; i += 4)
+		{
+			auto Source = (const float*)(Data + i * 12);
+			auto a = _mm_loadu_ps(Source);
+			auto b = _mm_loadu_ps(Source + 4);
+			auto c = _mm_loadu_ps(Source + 8);
+
+			auto o0 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 2, 0)); // x0 z0 y0 x1
+			auto t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 2, 2)); // x2 x2 z2 z2
+			auto o1 = _mm_shuffle_ps(b, t1, _MM_SHUFFLE(2, 0, 0, 1)); // z1 y1 x2 z2
+			auto t2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 3, 3)); // y2 y2 x3 x3
+			auto o2 = _mm_shuffle_ps(t2, c, _MM_SHUFFLE(2, 3, 2, 0)); // y2 x3 z3 y3
+
+			auto Destination = Out + i * 3;
+			_mm_storeu_ps(Destination, _mm_xor_ps(o0, Sign0));
+			_mm_storeu_ps(Destination + 4, _mm_xor_ps(o1, Sign1));
+			_mm_storeu_ps(Destination + 8, _mm_xor_ps(o2, Sign2));
+		}
+	}
+#elif defined(REPO_SRC_KERNELS_NEON)
+	if (Vectors.Stride == sizeof(float) * 3 && ((uintptr_t)Data % sizeof(float)) == 0)
+	{
+		for (; i + 4 <= Vectors.Count; i += 4)
+		{
+			auto v = vld3q_f32((const float*)(Data + i * 12));
+			float32x4x3_t o;
+			o.val[0] = vnegq_f32(v.val[0]);
+			o.val[1] = vnegq_f32(v.val[2]);
+			o.val[2] = v.val[1];
+			vst3q_f32(Out + i * 3, o);
+		}
+	}
+#endif
+
+	RepoSrcStream Tail = Vectors;
+	Tail.Data = Data + (size_t)i * Vectors.Stride;
+	Tail.Count = Vectors.Count - i;
+	RepoSrcScalarKernels::UnityToUnreal(Tail, Out + i * 3);
+}
+
+void RepoSrcKernels::CopyFloats(const RepoSrcStream& Stream, uint32_t Components, float* Out)
+{
+	auto ElementSize = Components * sizeof(float);
+	if (Stream.Stride == ElementSize)
+	{
+		memcpy(Out, Stream.Data, (size_t)Stream.Count * ElementSize);
+		return;
+	}
+
+	auto Data = Stream.Data;
+	for (uint32_t i = 0; i < Stream.Count; i++)
+	{
+		memcpy(Out, Data, ElementSize);
+		Data += Stream.Stride;
+		Out += Components;
+	}
+}
+
+#if defined(REPO_SRC_KERNELS_SSE2)
+// Writes the first three lanes of v, as one float3 of an interleaved output
+static inline void StoreFloat3(uint8_t* Out, __m128 v)
+{
+	_mm_storel_pi((__m64*)Out, v);
+	_mm_store_ss((float*)(Out + 8), _mm_movehl_ps(v, v));
+}
+#endif
+
+void RepoSrcKernels::UnityToUnrealInterleaved(const RepoSrcStream& Vectors, uint8_t* Out, size_t OutStride, float* Bounds)
+{
+	// As in UnityToUnreal, only packed streams are vectorised, and four vertices are loaded into three registers. With
+	// SSE2 each vertex is then shuffled into a register of its own, and written with an 8 and a 4 byte store. Its
+	// bounds are accumulated a vertex at a time, so they match the scalar kernel's exactly. With NEON the vertices are
+	// de-interleaved into x, y and z, and each is written with a lane store. The bounds are accumulated per lane and
+	// combined at the end, so only the sign of a zero bound can differ from the scalar kernel's.
+	// In both, the bounds are accumulated whether they are wanted or not, as that is cheaper than branching on them.
+
+	float Min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float Max[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+	auto Data = Vectors.Data;
+	uint32_t i = 0;
+
+#if defined(REPO_SRC_KERNELS_SSE2)
+	if (Vectors.Stride == sizeof(float) * 3)
+	{
+		auto Sign = _mm_castsi128_ps(_mm_setr_epi32(INT32_MIN, INT32_MIN, 0, 0));
+		auto MinV = _mm_set1_ps(Min[0]);
+		auto MaxV = _mm_set1_ps(Max[0]);
+
+		for (; i + 4 <= Vectors.Count; i += 4)
+		{
+			auto Source = (const float*)(Data + i * 12);
+			auto a = _mm_loadu_ps(Source); // x0 y0 z0 x1
+			auto b = _mm_loadu_ps(Source + 4); // y1 z1 x2 y2
+			auto c = _mm_loadu_ps(Source + 8); // z2 x3 y3 z3
+
+			__m128 v[4];
+			v[0] = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 2, 0)); // x0 z0 y0 -
+			auto t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 3, 3)); // x1 x1 y1 z1
+			v[1] = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(0, 2, 3, 0)); // x1 z1 y1 -
+			auto t2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 3, 2)); // x2 y2 z2 z2
+			v[2] = _mm_shuffle_ps(t2, t2, _MM_SHUFFLE(0, 1, 2, 0)); // x2 z2 y2 -
+			v[3] = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 2, 3, 1)); // x3 z3 y3 -
+
+			for (int k = 0; k < 4; k++)
+			{
+				auto o = _mm_xor_ps(v[k], Sign);
+				StoreFloat3(Out, o);
+				Out += OutStride;
+
+				// minps and maxps return their second operand when the comparison fails, as the scalar kernel does
+				MinV = _mm_min_ps(o, MinV);
+				MaxV = _mm_max_ps(o, MaxV);
+			}
+		}
+
+		float Lanes[4];
+		_mm_storeu_ps(Lanes, MinV);
+		memcpy(Min, Lanes, sizeof(Min));
+		_mm_storeu_ps(Lanes, MaxV);
+		memcpy(Max, Lanes, sizeof(Max));
+	}
+#elif defined(REPO_SRC_KERNELS_NEON)
+	if (Vectors.Stride == sizeof(float) * 3 && ((uintptr_t)Data % sizeof(float)) == 0)
+	{
+		float32x4x3_t MinV, MaxV;
+		for (int c = 0; c < 3; c++)
+		{
+			MinV.val[c] = vdupq_n_f32(Min[c]);
+			MaxV.val[c] = vdupq_n_f32(Max[c]);
+		}
+
+		for (; i + 4 <= Vectors.Count; i += 4)
+		{
+			auto v = vld3q_f32((const float*)(Data + i * 12));
+			float32x4x3_t o;
+			o.val[0] = vnegq_f32(v.val[0]);
+			o.val[1] = vnegq_f32(v.val[2]);
+			o.val[2] = v.val[1];
+			vst3q_lane_f32((float*)Out, o, 0);
+			vst3q_lane_f32((float*)(Out + OutStride), o, 1);
+			vst3q_lane_f32((float*)(Out + OutStride * 2), o, 2);
+			vst3q_lane_f32((float*)(Out + OutStride * 3), o, 3);
+			Out += OutStride * 4;
+
+			// Selects rather than vminq/vmaxq, which would return NaN where the scalar kernel ignores it
+			for (int c = 0; c < 3; c++)
+			{
+				MinV.val[c] = vbslq_f32(vcltq_f32(o.val[c], MinV.val[c]), o.val[c], MinV.val[c]);
+				MaxV.val[c] = vbslq_f32(vcgtq_f32(o.val[c], MaxV.val[c]), o.val[c], MaxV.val[c]);
+			}
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			float MinLanes[4], MaxLanes[4];
+			vst1q_f32(MinLanes, MinV.val[c]);
+			vst1q_f32(MaxLanes, MaxV.val[c]);
+			for (int Lane = 0; Lane < 4; Lane++)
+			{
+				Min[c] = MinLanes[Lane] < Min[c] ? MinLanes[Lane] : Min[c];
+				Max[c] = MaxLanes[Lane] > Max[c] ? MaxLanes[Lane] : Max[c];
+			}
+		}
+	}
+#endif
+
+	RepoSrcStream Tail = Vectors;
+	Tail.Data = Data + (size_t)i * Vectors.Stride;
+	Tail.Count = Vectors.Count - i;
+	float TailBounds[6];
+	RepoSrcScalarKernels::UnityToUnrealInterleaved(Tail, Out, OutStride, TailBounds);
+
+	if (Bounds)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			Bounds[c] = TailBounds[c] < Min[c] ? TailBounds[c] : Min[c];
+			Bounds[c + 3] = TailBounds[c + 3] > Max[c] ? TailBounds[c + 3] : Max[c];
+		}
+	}
+}
+
+// Copies Count elements of Components floats, with a fixed size copy that compiles to moves rather than a call
+template<uint32_t Components>
+static void CopyElementsInterleaved(const uint8_t* Data, uint32_t Count, size_t Stride, uint8_t* Out, size_t OutStride)
+{
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		memcpy(Out, Data, Components * sizeof(float));
+		Data += Stride;
+		Out += OutStride;
+	}
+}
+
+void RepoSrcKernels::CopyFloatsInterleaved(const RepoSrcStream& Stream, uint32_t Components, uint8_t* Out, size_t OutStride)
+{
+	// Packed float2s, such as texture coordinates, are loaded two registers at a time, and each half written with
+	// one store. Other float2 and float3 streams are copied with fixed size copies.
+
+	auto Data = Stream.Data;
+	uint32_t i = 0;
+
+	if (Components == 3)
+	{
+		CopyElementsInterleaved<3>(Data, Stream.Count, Stream.Stride, Out, OutStride);
+		return;
+	}
+	if (Components != 2)
+	{
+		RepoSrcScalarKernels::CopyFloatsInterleaved(Stream, Components, Out, OutStride);
+		return;
+	}
+
+#if defined(REPO_SRC_KERNELS_SSE2)
+	if (Stream.Stride == sizeof(float) * 2)
+	{
+		for (; i + 4 <= Stream.Count; i += 4)
+		{
+			auto Source = (const float*)(Data + i * 8);
+			auto a = _mm_loadu_ps(Source);
+			auto b = _mm_loadu_ps(Source + 4);
+			_mm_storel_pi((__m64*)Out, a);
+			_mm_storeh_pi((__m64*)(Out + OutStride), a);
+			_mm_storel_pi((__m64*)(Out + OutStride * 2), b);
+			_mm_storeh_pi((__m64*)(Out + OutStride * 3), b);
+			Out += OutStride * 4;
+		}
+	}
+#elif defined(REPO_SRC_KERNELS_NEON)
+	if (Stream.Stride == sizeof(float) * 2)
+	{
+		for (; i + 4 <= Stream.Count; i += 4)
+		{
+			auto a = vreinterpretq_f32_u8(vld1q_u8(Data + i * 8)); // Byte loads, as the stream may not be aligned
+			auto b = vreinterpretq_f32_u8(vld1q_u8(Data + i * 8 + 16));
+			vst1_f32((float*)Out, vget_low_f32(a));
+			vst1_f32((float*)(Out + OutStride), vget_high_f32(a));
+			vst1_f32((float*)(Out + OutStride * 2), vget_low_f32(b));
+			vst1_f32((float*)(Out + OutStride * 3), vget_high_f32(b));
+			Out += OutStride * 4;
+		}
+	}
+#endif
+
+	CopyElementsInterleaved<2>(Data + (size_t)i * Stream.Stride, Stream.Count - i, Stream.Stride, Out, OutStride);
+}
+
+bool RepoSrcKernels::GenerateSupermeshMapIndices(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, float* Out)
+{
+	// All the vertices of an object are written together, so ids come in long runs. The lookup of the current run is
+	// kept, and groups of four vertices that continue it are written without looking up or range-checking each id.
+
+	float RunId = std::numeric_limits<float>::quiet_NaN(); // Never equal to an id, so the first is always looked up
+	float RunActor = 0;
+	size_t i = 0;
+
+#if defined(REPO_SRC_KERNELS_SSE2) || defined(REPO_SRC_KERNELS_NEON)
+	for (; i + 4 <= NumIds; i += 4)
+	{
+#if defined(REPO_SRC_KERNELS_SSE2)
+		auto v = _mm_loadu_ps(Ids + i);
+		if (_mm_movemask_ps(_mm_cmpeq_ps(v, _mm_set1_ps(RunId))) == 0xF)
+		{
+			auto Pair = _mm_setr_ps(RunId, RunActor, RunId, RunActor);
+			_mm_storeu_ps(Out + i * 2, Pair);
+			_mm_storeu_ps(Out + i * 2 + 4, Pair);
+			continue;
+		}
+#else
+		auto Equal = vceqq_f32(vld1q_f32(Ids + i), vdupq_n_f32(RunId));
+		auto Half = vand_u32(vget_low_u32(Equal), vget_high_u32(Equal));
+		if (vget_lane_u32(vpmin_u32(Half, Half), 0) != 0)
+		{
+			float PairValues[4] = { RunId, RunActor, RunId, RunActor };
+			auto Pair = vld1q_f32(PairValues);
+			vst1q_f32(Out + i * 2, Pair);
+			vst1q_f32(Out + i * 2 + 4, Pair);
+			continue;
+		}
+#endif
+		for (size_t j = i; j < i + 4; j++)
+		{
+			if (Ids[j] != RunId)
+			{
+				uint32_t Actor;
+				if (!LookupId(Ids[j], LocalToActor, MapSize, Actor))
+				{
+					return false;
+				}
+				RunId = Ids[j];
+				RunActor = (float)Actor;
+			}
+			Out[j * 2 + 0] = RunId;
+			Out[j * 2 + 1] = RunActor;
+		}
+	}
+#endif
+
+	for (; i < NumIds; i++)
+	{
+		if (Ids[i] != RunId)
+		{
+			uint32_t Actor;
+			if (!LookupId(Ids[i], LocalToActor, MapSize, Actor))
+			{
+				return false;
+			}
+			RunId = Ids[i];
+			RunActor = (float)Actor;
+		}
+		Out[i * 2 + 0] = RunId;
+		Out[i * 2 + 1] = RunActor;
+	}
+	return true;
+}
+
+bool RepoSrcKernels::GenerateTriangleIdMap(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, int32_t* Out)
+{
+	// The first index of each triangle is a strided gather, which does not vectorise without AVX2's gathers, so this
+	// only keeps the lookup of the current run of ids, as GenerateSupermeshMapIndices does.
+
+	float RunId = std::numeric_limits<float>::quiet_NaN();
+	int32_t RunActor = 0;
+
+	auto NumTriangles = NumIndices / 3;
+	for (size_t i = 0; i < NumTriangles; i++)
+	{
+		auto Index0 = (size_t)Indices[i * 3];
+		if (Index0 >= NumIds)
+		{
+			return false;
+		}
+		auto LocalId = Ids[Index0];
+		if (LocalId != RunId)
+		{
+			uint32_t Actor;
+			if (!LookupId(LocalId, LocalToActor, MapSize, Actor))
+			{
+				return false;
+			}
+			RunId = LocalId;
+			RunActor = (int32_t)Actor;
+		}
+		Out[i] = RunActor;
+	}
+	return true;
+}
+
+bool RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, uint8_t* Out, size_t OutStride)
+{
+	// As GenerateSupermeshMapIndices, groups of four vertices that continue the current run are written without
+	// looking up their ids. The ids are interleaved with the actor index in registers, and each pair written with one
+	// store. The ids written are those read, rather than the id of the run, so that a -0 is kept as the scalar kernel
+	// keeps it.
+
+	float RunId = std::numeric_limits<float>::quiet_NaN(); // Never equal to an id, so the first is always looked up
+	float RunActor = 0;
+	size_t i = 0;
+
+#if defined(REPO_SRC_KERNELS_SSE2) || defined(REPO_SRC_KERNELS_NEON)
+	for (; i + 4 <= NumIds; i += 4)
+	{
+#if defined(REPO_SRC_KERNELS_SSE2)
+		auto v = _mm_loadu_ps(Ids + i);
+		if (_mm_movemask_ps(_mm_cmpeq_ps(v, _mm_set1_ps(RunId))) == 0xF)
+		{
+			auto Actor = _mm_set1_ps(RunActor);
+			auto Lo = _mm_unpacklo_ps(v, Actor); // id0 a id1 a
+			auto Hi = _mm_unpackhi_ps(v, Actor); // id2 a id3 a
+			_mm_storel_pi((__m64*)Out, Lo);
+			_mm_storeh_pi((__m64*)(Out + OutStride), Lo);
+			_mm_storel_pi((__m64*)(Out + OutStride * 2), Hi);
+			_mm_storeh_pi((__m64*)(Out + OutStride * 3), Hi);
+			Out += OutStride * 4;
+			continue;
+		}
+#else
+		auto v = vld1q_f32(Ids + i);
+		auto Equal = vceqq_f32(v, vdupq_n_f32(RunId));
+		auto Half = vand_u32(vget_low_u32(Equal), vget_high_u32(Equal));
+		if (vget_lane_u32(vpmin_u32(Half, Half), 0) != 0)
+		{
+			auto Pairs = vzipq_f32(v, vdupq_n_f32(RunActor));
+			vst1_f32((float*)Out, vget_low_f32(Pairs.val[0]));
+			vst1_f32((float*)(Out + OutStride), vget_high_f32(Pairs.val[0]));
+			vst1_f32((float*)(Out + OutStride * 2), vget_low_f32(Pairs.val[1]));
+			vst1_f32((float*)(Out + OutStride * 3), vget_high_f32(Pairs.val[1]));
+			Out += OutStride * 4;
+			continue;
+		}
+#endif
+		for (size_t j = i; j < i + 4; j++)
+		{
+			if (Ids[j] != RunId)
+			{
+				uint32_t Actor;
+				if (!LookupId(Ids[j], LocalToActor, MapSize, Actor))
+				{
+					return false;
+				}
+				RunId = Ids[j];
+				RunActor = (float)Actor;
+			}
+			float Pair[2] = { Ids[j], RunActor };
+			memcpy(Out, Pair, sizeof(Pair));
+			Out += OutStride;
+		}
+	}
+#endif
+
+	for (; i < NumIds; i++)
+	{
+		if (Ids[i] != RunId)
+		{
+			uint32_t Actor;
+			if (!LookupId(Ids[i], LocalToActor, MapSize, Actor))
+			{
+				return false;
+			}
+			RunId = Ids[i];
+			RunActor = (float)Actor;
+		}
+		float Pair[2] = { Ids[i], RunActor };
+		memcpy(Out, Pair, sizeof(Pair));
+		Out += OutStride;
+	}
+	return true;
+}
+
+int64_t RepoSrcKernels::ClassifyTriangles(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint8_t* Classes, size_t NumClasses, uint8_t* Out)
+{
+	int64_t NumInClass = 0;
+	auto NumTriangles = NumIndices / 3;
+	for (size_t i = 0; i < NumTriangles; i++)
+	{
+		auto Index0 = (size_t)Indices[i * 3];
+		if (Index0 >= NumIds)
+		{
+			return -1;
+		}
+		auto LocalId = Ids[Index0];
+		if (!(LocalId >= 0.0f) || !(LocalId < (float)NumClasses))
+		{
+			return -1;
+		}
+		auto Class = Classes[(size_t)LocalId] ? 1 : 0;
+		Out[i] = (uint8_t)Class;
+		NumInClass += Class;
+	}
+	return NumInClass;
+}
+
+int64_t RepoSrcKernels::CompactTriangles(const int32_t* Indices, size_t NumIndices, const uint8_t* TriangleClasses, uint8_t Class, int32_t* Remap, size_t NumVertices, int32_t* OutIndices, int32_t* OutVertices)
+{
+	int64_t NumUsed = 0;
+	auto NumTriangles = NumIndices / 3;
+	for (size_t i = 0; i < NumTriangles; i++)
+	{
+		if (TriangleClasses[i] != Class)
+		{
+			continue;
+		}
+		for (size_t j = 0; j < 3; j++)
+		{
+			auto Index = Indices[i * 3 + j];
+			if ((size_t)Index >= NumVertices)
+			{
+				return -1;
+			}
+			if (Remap[Index] < 0)
+			{
+				Remap[Index] = (int32_t)NumUsed;
+				OutVertices[NumUsed++] = Index;
+			}
+			*OutIndices++ = Remap[Index];
+		}
+	}
+	return NumUsed;
+}
@@ -0,0 +1,426 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Decoder/RepoSrcMapping.h"
+#include <cstdlib>
+#include <cstring>
+
+// Reads an array of exactly Count numbers
+static bool ReadVector(RepoJsonReader& Reader, double* Out, int Count)
+{
+	int NumRead = 0;
+	bool bRead = Reader.ReadArray([&](RepoJsonReader::Token Token)
+	{
+		if (Token != RepoJsonReader::Token::Number || NumRead >= Count)
+		{
+			return false;
+		}
+		Out[NumRead++] = Reader.GetNumber();
+		return true;
+	});
+	return bRead && NumRead == Count;
+}
+
+// Parses up to Count whitespace separated numbers from a string, such as "0.5 0.5 0.5". Returns the number parsed.
+static int ParseNumbers(const RepoJsonString& String, float* Out, int Count)
+{
+	char Buffer[128];
+	auto Size = String.Size < sizeof(Buffer) - 1 ? String.Size : sizeof(Buffer) - 1;
+	memcpy(Buffer, String.Data, Size);
+	Buffer[Size] = 0;
+
+	int NumParsed = 0;
+	char* Cursor = Buffer;
+	while (NumParsed < Count)
+	{
+		char* End;
+		auto Value = strtod(Cursor, &End);
+		if (End == Cursor)
+		{
+			break;
+		}
+		Out[NumParsed++] = (float)Value;
+		Cursor = End;
+	}
+	return NumParsed;
+}
+
+// Exporters write colours as strings of three numbers, but arrays are accepted too
+static bool ReadColour(RepoJsonReader& Reader, float* Out)
+{
+	switch (Reader.Next())
+	{
+	case RepoJsonReader::Token::String:
+		return ParseNumbers(Reader.GetString(), Out, 3) == 3;
+	case RepoJsonReader::Token::BeginArray:
+	{
+		int NumRead = 0;
+		while (Reader.Next() == RepoJsonReader::Token::Number)
+		{
+			if (NumRead < 3)
+			{
+				Out[NumRead] = (float)Reader.GetNumber();
+			}
+			NumRead++;
+		}
+		return Reader.GetToken() == RepoJsonReader::Token::EndArray && NumRead == 3;
+	}
+	default:
+		return false;
+	}
+}
+
+// As with the colours, numbers may be written as strings
+static bool ReadFloat(RepoJsonReader& Reader, float& Out)
+{
+	switch (Reader.Next())
+	{
+	case RepoJsonReader::Token::Number:
+		Out = (float)Reader.GetNumber();
+		return true;
+	case RepoJsonReader::Token::String:
+		return ParseNumbers(Reader.GetString(), &Out, 1) == 1;
+	default:
+		return false;
+	}
+}
+
+// The binary form is this header, followed by the entries and then the appearances (each as they are laid out in
+// memory), and then the string pool, which holds the names of the entries followed by those of the appearances.
+struct RepoSrcMappingBinaryHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t EntrySize; // Guards against reading a file written by a build with a different layout
+	uint32_t NumberOfIds;
+	uint64_t NumEntries;
+	uint64_t NumAppearances;
+	uint64_t NamesSize;
+};
+
+struct RepoSrcMappingBinaryAppearance
+{
+	uint32_t NameOffset;
+	uint32_t NameSize;
+	float Diffuse[3];
+	float Specular[3];
+	float Transparency;
+	uint32_t bDefined;
+};
+
+bool RepoSrcMapping::Parse(const char* Data, size_t Size)
+{
+	NumberOfIds = 0;
+	Entries.clear();
+	Appearances.clear();
+	Names.clear();
+	AppearanceIndices.clear();
+
+	return IsBinary(Data, Size) ? ParseBinary(Data, Size) : ParseJson(Data, Size);
+}
+
+bool RepoSrcMapping::IsBinary(const char* Data, size_t Size)
+{
+	uint32_t Magic;
+	if (Size < sizeof(Magic))
+	{
+		return false;
+	}
+	memcpy(&Magic, Data, sizeof(Magic));
+	return Magic == BinaryMagic; // JSON cannot begin with these bytes
+}
+
+size_t RepoSrcMapping::GetBinarySize() const
+{
+	size_t AppearanceNamesSize = 0;
+	for (auto& Appearance : Appearances)
+	{
+		AppearanceNamesSize += Appearance.Name.size();
+	}
+
+	return sizeof(RepoSrcMappingBinaryHeader) +
+		Entries.size() * sizeof(RepoSrcMappingEntry) +
+		Appearances.size() * sizeof(RepoSrcMappingBinaryAppearance) +
+		Names.size() + AppearanceNamesSize;
+}
+
+void RepoSrcMapping::WriteBinary(uint8_t* Out) const
+{
+	RepoSrcMappingBinaryHeader Header = {};
+	Header.Magic = BinaryMagic;
+	Header.Version = BinaryVersion;
+	Header.EntrySize = sizeof(RepoSrcMappingEntry);
+	Header.NumberOfIds = NumberOfIds;
+	Header.NumEntries = Entries.size();
+	Header.NumAppearances = Appearances.size();
+	Header.NamesSize = Names.size();
+	for (auto& Appearance : Appearances)
+	{
+		Header.NamesSize += Appearance.Name.size();
+	}
+
+	memcpy(Out, &Header, sizeof(Header));
+	Out += sizeof(Header);
+
+	memcpy(Out, Entries.data(), Entries.size() * sizeof(RepoSrcMappingEntry));
+	Out += Entries.size() * sizeof(RepoSrcMappingEntry);
+
+	auto NameOffset = (uint32_t)Names.size();
+	for (auto& Appearance : Appearances)
+	{
+		RepoSrcMappingBinaryAppearance Binary = {};
+		Binary.NameOffset = NameOffset;
+		Binary.NameSize = (uint32_t)Appearance.Name.size();
+		memcpy(Binary.Diffuse, Appearance.Diffuse, sizeof(Binary.Diffuse));
+		memcpy(Binary.Specular, Appearance.Specular, sizeof(Binary.Specular));
+		Binary.Transparency = Appearance.Transparency;
+		Binary.bDefined = Appearance.bDefined;
+
+		memcpy(Out, &Binary, sizeof(Binary));
+		Out += sizeof(Binary);
+		NameOffset += Binary.NameSize;
+	}
+
+	memcpy(Out, Names.data(), Names.size());
+	Out += Names.size();
+
+	for (auto& Appearance : Appearances)
+	{
+		memcpy(Out, Appearance.Name.data(), Appearance.Name.size());
+		Out += Appearance.Name.size();
+	}
+}
+
+bool RepoSrcMapping::ParseBinary(const char* Data, size_t Size)
+{
+	RepoSrcMappingBinaryHeader Header;
+	if (Size < sizeof(Header))
+	{
+		return false;
+	}
+	memcpy(&Header, Data, sizeof(Header));
+
+	if (Header.Version != BinaryVersion ||
+		Header.EntrySize != sizeof(RepoSrcMappingEntry) ||
+		Header.NamesSize > UINT32_MAX ||
+		Header.NumEntries > Size / sizeof(RepoSrcMappingEntry) ||
+		Header.NumAppearances > Size / sizeof(RepoSrcMappingBinaryAppearance) ||
+		sizeof(Header) + Header.NumEntries * sizeof(RepoSrcMappingEntry) + Header.NumAppearances * sizeof(RepoSrcMappingBinaryAppearance) + Header.NamesSize != Size)
+	{
+		return false;
+	}
+
+	NumberOfIds = Header.NumberOfIds;
+
+	auto Cursor = Data + sizeof(Header);
+
+	Entries.resize((size_t)Header.NumEntries);
+	memcpy(Entries.data(), Cursor, Entries.size() * sizeof(RepoSrcMappingEntry));
+	Cursor += Entries.size() * sizeof(RepoSrcMappingEntry);
+
+	auto BinaryAppearances = Cursor;
+	Cursor += Header.NumAppearances * sizeof(RepoSrcMappingBinaryAppearance);
+
+	Names.assign(Cursor, (size_t)Header.NamesSize);
+
+	Appearances.resize((size_t)Header.NumAppearances);
+	for (size_t i = 0; i < Appearances.size(); i++)
+	{
+		RepoSrcMappingBinaryAppearance Binary;
+		memcpy(&Binary, BinaryAppearances + i * sizeof(Binary), sizeof(Binary));
+		if ((uint64_t)Binary.NameOffset + Binary.NameSize > Names.size())
+		{
+			return false;
+		}
+
+		auto& Appearance = Appearances[i];
+		Appearance.Name.assign(Names.data() + Binary.NameOffset, Binary.NameSize);
+		memcpy(Appearance.Diffuse, Binary.Diffuse, sizeof(Binary.Diffuse));
+		memcpy(Appearance.Specular, Binary.Specular, sizeof(Binary.Specular));
+		Appearance.Transparency = Binary.Transparency;
+		Appearance.bDefined = Binary.bDefined != 0;
+	}
+
+	// The entries are only validated, as they were copied as they are
+
+	for (auto& Entry : Entries)
+	{
+		if ((uint64_t)Entry.NameOffset + Entry.NameSize > Names.size() ||
+			(Entry.Appearance != UINT32_MAX && Entry.Appearance >= Appearances.size()))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool RepoSrcMapping::ParseJson(const char* Data, size_t Size)
+{
+	RepoJsonReader Reader(Data, Size);
+
+	return Reader.ReadObject([&](const RepoJsonString& Key)
+	{
+		if (Key.Equals("numberOfIDs"))
+		{
+			return Reader.ReadUInt32(NumberOfIds);
+		}
+		if (Key.Equals("mapping"))
+		{
+			return ParseEntries(Reader, Size);
+		}
+		if (Key.Equals("appearance"))
+		{
+			return ParseAppearances(Reader);
+		}
+		return Reader.SkipMember();
+	});
+}
+
+bool RepoSrcMapping::ParseEntries(RepoJsonReader& Reader, size_t InputSize)
+{
+	// Exporters write numberOfIDs before the mapping, so the arrays can be sized up front. The names are 36 character
+	// UUIDs. Each entry takes well over 32 bytes of JSON, which bounds the reservation for a corrupt count.
+
+	size_t Expected = NumberOfIds < InputSize / 32 ? NumberOfIds : InputSize / 32;
+	Entries.reserve(Expected);
+	Names.reserve(Expected * 36);
+
+	return Reader.ReadArray([&](RepoJsonReader::Token Token)
+	{
+		if (Token != RepoJsonReader::Token::BeginObject)
+		{
+			return false;
+		}
+
+		RepoSrcMappingEntry Entry;
+		bool bHasMin = false;
+		bool bHasMax = false;
+
+		bool bRead = Reader.ReadMembers([&](const RepoJsonString& Key)
+		{
+			RepoJsonString Value;
+			if (Key.Equals("Name"))
+			{
+				if (!Reader.ReadString(Value) || Names.size() + Value.Size > UINT32_MAX)
+				{
+					return false;
+				}
+				Entry.NameOffset = (uint32_t)Names.size();
+				Entry.NameSize = (uint32_t)Value.Size;
+				Names.append(Value.Data, Value.Size);
+				return true;
+			}
+			if (Key.Equals("appearance"))
+			{
+				if (!Reader.ReadString(Value))
+				{
+					return false;
+				}
+				Entry.Appearance = FindOrAddAppearance(Value);
+				return true;
+			}
+			if (Key.Equals("min"))
+			{
+				return bHasMin = ReadVector(Reader, Entry.Min, 3);
+			}
+			if (Key.Equals("max"))
+			{
+				return bHasMax = ReadVector(Reader, Entry.Max, 3);
+			}
+			return Reader.SkipMember();
+		});
+
+		Entry.bHasBounds = bHasMin && bHasMax;
+		Entries.push_back(Entry);
+		return bRead;
+	});
+}
+
+bool RepoSrcMapping::ParseAppearances(RepoJsonReader& Reader)
+{
+	return Reader.ReadArray([&](RepoJsonReader::Token Token)
+	{
+		if (Token != RepoJsonReader::Token::BeginObject)
+		{
+			return false;
+		}
+
+		// The name may follow the material, so the appearance is only looked up once the whole object has been read
+
+		RepoSrcAppearance Appearance;
+		Appearance.bDefined = true;
+
+		bool bRead = Reader.ReadMembers([&](const RepoJsonString& Key)
+		{
+			if (Key.Equals("name"))
+			{
+				RepoJsonString Value;
+				if (!Reader.ReadString(Value))
+				{
+					return false;
+				}
+				Appearance.Name = Value.ToString();
+				return true;
+			}
+			if (Key.Equals("material"))
+			{
+				return Reader.ReadObject([&](const RepoJsonString& Field)
+				{
+					if (Field.Equals("diffuseColor"))
+					{
+						return ReadColour(Reader, Appearance.Diffuse);
+					}
+					if (Field.Equals("specularColor"))
+					{
+						return ReadColour(Reader, Appearance.Specular);
+					}
+					if (Field.Equals("transparency"))
+					{
+						return ReadFloat(Reader, Appearance.Transparency);
+					}
+					return Reader.SkipMember();
+				});
+			}
+			return Reader.SkipMember();
+		});
+
+		if (bRead)
+		{
+			RepoJsonString Name;
+			Name.Data = Appearance.Name.data();
+			Name.Size = Appearance.Name.size();
+			Appearances[FindOrAddAppearance(Name)] = std::move(Appearance);
+		}
+		return bRead;
+	});
+}
+
+uint32_t RepoSrcMapping::FindOrAddAppearance(const RepoJsonString& Name)
+{
+	// Entries refer to appearances by name, and the appearance array may come after the mapping array, so an
+	// appearance is added the first time it is named by either, and filled in when its definition is read.
+
+	auto Inserted = AppearanceIndices.emplace(Name.ToString(), (uint32_t)Appearances.size());
+	if (Inserted.second)
+	{
+		Appearances.emplace_back();
+		Appearances.back().Name = Name.ToString();
+	}
+	return Inserted.first->second;
+}
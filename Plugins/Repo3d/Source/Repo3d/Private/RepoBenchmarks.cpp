@@ -0,0 +1,125 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RepoBenchmarks.h"
+#include "RepoSupermeshActor.h"
+#include "RepoSupermeshMapComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+void RepoBenchmarks::RegisterConsoleCommands()
+{
+	IConsoleManager::Get().RegisterConsoleCommand(
+		TEXT("3drepobenchmarkmap"),
+		TEXT("Compares setting N (default 100000) supermesh map parameters one at a time against one batch. Usage: 3drepobenchmarkmap [N]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateLambda(
+			[](const TArray<FString>& Args, UWorld* World) {
+				int32 Count = 100000;
+				if (Args.Num())
+				{
+					LexFromString(Count, *Args[0]);
+				}
+				SupermeshMapParameters(World, FMath::Max(Count, 1));
+			}),
+		0);
+}
+
+void RepoBenchmarks::Report(const FString& Message)
+{
+	UE_LOG(LogTemp, Log, TEXT("%s"), *Message);
+	if (GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage(-1, 30.0f, FColor::Yellow, Message);
+	}
+}
+
+void RepoBenchmarks::SupermeshMapParameters(UWorld* World, int32 Count)
+{
+	if (!World)
+	{
+		Report(TEXT("3drepobenchmarkmap needs a world to spawn its actor in."));
+		return;
+	}
+
+	auto Actor = World->SpawnActor<ARepoSupermeshActor>();
+	auto Map = Actor->DiffuseMap;
+
+	TArray<FString> Ids;
+	TArray<int32> Indices;
+	TArray<FVector4> Values;
+	Ids.Reserve(Count);
+	Indices.Reserve(Count);
+	Values.Reserve(Count);
+
+	FRandomStream Random(Count);
+	for (int32 i = 0; i < Count; i++)
+	{
+		Ids.Add(FGuid(Random.GetUnsignedInt(), Random.GetUnsignedInt(), Random.GetUnsignedInt(), Random.GetUnsignedInt()).ToString(EGuidFormats::DigitsWithHyphens));
+		Indices.Add(Actor->AddSubmeshId(Ids.Last()));
+		Values.Add(FVector4(Random.FRand(), Random.FRand(), Random.FRand(), 1.0f));
+	}
+
+	Map->UpdateTexture(); // Create the texture up front, so the uploads below take the partial path
+
+	double Start;
+	double SetTime;
+	double UpdateTime;
+
+	auto Measure = [&](const TCHAR* Name, TFunctionRef<void()> Set)
+	{
+		Start = FPlatformTime::Seconds();
+		Set();
+		SetTime = FPlatformTime::Seconds() - Start;
+
+		Start = FPlatformTime::Seconds();
+		Map->UpdateTexture();
+		UpdateTime = FPlatformTime::Seconds() - Start;
+
+		Report(FString::Printf(TEXT("%-28s set %8.2f ms, update %8.2f ms"), Name, SetTime * 1000.0, UpdateTime * 1000.0));
+	};
+
+	Report(FString::Printf(TEXT("Setting %d supermesh map parameters:"), Count));
+
+	Measure(TEXT("SetParameter(FString&) x N"), [&]() {
+		for (int32 i = 0; i < Count; i++)
+		{
+			Map->SetParameter(Ids[i], Values[i]);
+		}
+	});
+
+	Measure(TEXT("SetParameter(int) x N"), [&]() {
+		for (int32 i = 0; i < Count; i++)
+		{
+			Map->SetParameter(Indices[i], Values[i]);
+		}
+	});
+
+	Measure(TEXT("SetParameters(Ids, Values)"), [&]() {
+		Map->SetParameters(Ids, Values);
+	});
+
+	Measure(TEXT("SetParameters(Indices, Values)"), [&]() {
+		Map->SetParameters(Indices, Values);
+	});
+
+	Measure(TEXT("SetParameters(Indices, Value)"), [&]() {
+		Map->SetParameters(Indices, Values[0]);
+	});
+
+	Actor->Destroy();
+}
@@ -0,0 +1,135 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RepoMeshBatcher.h"
+#include "Repo3d.h"
+#include "RepoTrace.h"
+#include "ProceduralMeshComponent.h"
+
+DECLARE_CYCLE_STAT(TEXT("Batch Meshes"), STAT_BatchMeshes, STATGROUP_Repo3D);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Num Batched Components"), STAT_BatchedComponents, STATGROUP_Repo3D);
+
+void RepoMeshBatcher::Add(const FString& Uri, const FVector& Offset, RepoSrcDecodedSection& Section, const int* TriangleIds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BatchMeshes);
+
+	auto& batch = FindBatch(Offset, Section.bTranslucent);
+
+	if (batch.Section.NumVertices() > 0 && batch.Section.NumVertices() + Section.NumVertices() > VertexBudget)
+	{
+		CreateComponent(batch);
+	}
+
+	auto& merged = batch.Section.Geometry;
+	auto& geometry = Section.Geometry;
+	auto baseVertex = (uint32)merged.ProcVertexBuffer.Num();
+
+	// The first section of a batch is taken as-is, which avoids a copy for sections that fill a batch on their own
+
+	if (baseVertex == 0)
+	{
+		merged = MoveTemp(geometry);
+	}
+	else
+	{
+		merged.ProcIndexBuffer.Reserve(merged.ProcIndexBuffer.Num() + geometry.ProcIndexBuffer.Num());
+		for (auto index : geometry.ProcIndexBuffer)
+		{
+			merged.ProcIndexBuffer.Add(index + baseVertex);
+		}
+		merged.ProcVertexBuffer.Append(geometry.ProcVertexBuffer);
+		merged.SectionLocalBox += geometry.SectionLocalBox;
+	}
+
+	batch.TriangleIdMap.Append(TriangleIds, Section.NumTriangles());
+	batch.Assets.AddUnique(Uri);
+
+	Section = RepoSrcDecodedSection();
+
+	if (merged.ProcVertexBuffer.Num() >= VertexBudget)
+	{
+		CreateComponent(batch);
+	}
+}
+
+void RepoMeshBatcher::Flush()
+{
+	for (auto& batch : Batches)
+	{
+		if (batch.Section.NumVertices() > 0)
+		{
+			CreateComponent(batch);
+		}
+	}
+}
+
+RepoMeshBatcher::Batch& RepoMeshBatcher::FindBatch(const FVector& Offset, bool bTranslucent)
+{
+	// Offsets are set per model, so there are only ever a handful of batches
+
+	for (auto& batch : Batches)
+	{
+		if (batch.Offset == Offset && batch.Section.bTranslucent == bTranslucent)
+		{
+			return batch;
+		}
+	}
+
+	auto& batch = Batches.AddDefaulted_GetRef();
+	batch.Offset = Offset;
+	batch.Section.bTranslucent = bTranslucent;
+	return batch;
+}
+
+void RepoMeshBatcher::CreateComponent(Batch& batch)
+{
+	auto bTranslucent = batch.Section.bTranslucent;
+
+	if (Actor.IsValid())
+	{
+		REPO_TRACE_SCOPE(CreatingBatchComponent); // The batch holds many SRCs, so is not part of any of their timelines
+
+		auto mesh = Actor->AddProceduralMesh();
+		mesh->SetRelativeLocation(batch.Offset);
+		batch.Section.MoveTo(mesh, 0);
+		{
+			REPO_TRACE_SCOPE(Collision);
+			mesh->SetCollisionProfileName(FName("IgnoreOnlyPawn"));
+		}
+
+		auto materialPrototype = bTranslucent ? MaterialTranslucent : MaterialOpaque;
+		if (materialPrototype)
+		{
+			REPO_TRACE_SCOPE(BindingMaterials);
+			mesh->SetMaterial(0, Actor->GetSharedMaterial(materialPrototype, bTranslucent));
+		}
+
+		Actor->MeshComponentTriangleMaps.Add(mesh, MoveTemp(batch.TriangleIdMap));
+
+		for (auto& asset : batch.Assets)
+		{
+			Actor->AddImportedAssetComponent(asset, mesh);
+		}
+
+		INC_DWORD_STAT(STAT_BatchedComponents);
+	}
+
+	batch.Section = RepoSrcDecodedSection();
+	batch.Section.bTranslucent = bTranslucent;
+	batch.TriangleIdMap.Reset();
+	batch.Assets.Reset();
+}
@@ -0,0 +1,558 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RepoSrcDecodeTask.h"
+#include "Repo3d.h"
+#include "HAL/ThreadSingleton.h"
+#include "Async/Async.h"
+#include "Decoder/RepoSrcArena.h"
+#include "Decoder/RepoSrcBufferPool.h"
+#include "Decoder/RepoSrcDecoder.h"
+#include "Decoder/RepoSrcGeometryFile.h"
+#include "Decoder/RepoSrcKernels.h"
+#include <atomic>
+
+DECLARE_CYCLE_STAT(TEXT("Handle SRC"), STAT_HandleSRC, STATGROUP_Repo3D);
+DECLARE_CYCLE_STAT(TEXT("Load Cached Geometry"), STAT_LoadGeometry, STATGROUP_Repo3D);
+DECLARE_MEMORY_STAT(TEXT("Uncompressed"), STAT_Uncompressed, STATGROUP_Repo3D);
+DECLARE_MEMORY_STAT(TEXT("Inflate Pool"), STAT_InflatePool, STATGROUP_Repo3D);
+DECLARE_MEMORY_STAT(TEXT("Decode Scratch"), STAT_DecodeScratch, STATGROUP_Repo3D);
+DECLARE_MEMORY_STAT(TEXT("Decode Scratch Peak"), STAT_DecodeScratchPeak, STATGROUP_Repo3D);
+
+// The kernels write packed floats straight into the engine's vector types
+static_assert(sizeof(FVector) == sizeof(float) * 3, "FVector must be three packed floats");
+static_assert(sizeof(FVector2D) == sizeof(float) * 2, "FVector2D must be two packed floats");
+static_assert(sizeof(uint32) == sizeof(int32), "Indices are widened into the uint32 index buffer as int32s");
+
+void RepoSrcDecodedSection::MoveTo(UProceduralMeshComponent* Component, int32 SectionIndex)
+{
+	// SetProcMeshSection() copies the section it is given. Instead, an empty section is set to create the slot, the
+	// geometry is moved into it, and then the slot is set to itself, which the assignment skips, to have the component
+	// update its bounds, collision and render state.
+
+	if (SectionIndex >= Component->GetNumSections())
+	{
+		Component->SetProcMeshSection(SectionIndex, FProcMeshSection());
+	}
+
+	auto section = Component->GetProcMeshSection(SectionIndex);
+	*section = MoveTemp(Geometry);
+	Component->SetProcMeshSection(SectionIndex, *section);
+
+	Geometry = FProcMeshSection();
+}
+
+// Compressed SRCs are inflated into buffers from this pool, so that importing a model does not allocate and free a
+// buffer the size of each SRC. Up to this many bytes of unused buffers are kept between SRCs.
+static RepoSrcBufferPool& GetBufferPool()
+{
+	static RepoSrcBufferPool Pool(64 * 1024 * 1024);
+	return Pool;
+}
+
+// Each worker thread allocates the scratch memory of the SRCs it decodes from its own arena. The arena is reset after
+// each SRC, so after the first few SRCs a worker no longer allocates any scratch memory at all.
+class RepoSrcDecodeScratch : public TThreadSingleton<RepoSrcDecodeScratch>
+{
+public:
+	RepoSrcArena Arena;
+};
+
+// The most scratch memory any worker has needed for one SRC
+static std::atomic<size_t> PeakScratchBytes(0);
+
+void RepoSrcDecodeTask::DoWork()
+{
+	SCOPE_CYCLE_COUNTER(STAT_HandleSRC);
+
+	if (bCancelled)
+	{
+		Response.Reset();
+		return;
+	}
+
+	if (!Response.IsValid())
+	{
+		bSucceeded = ReadGeometry(); // The SRC was not requested, as its geometry is in the cache
+		return;
+	}
+
+	auto& arena = RepoSrcDecodeScratch::Get().Arena;
+	auto reserved = arena.GetReservedBytes();
+
+	bSucceeded = DecodeSrc(Response->GetContent(), arena);
+
+	Response.Reset(); // The body is no longer needed once the meshes have been built
+
+	arena.Reset();
+
+	auto peak = PeakScratchBytes.load();
+	while (arena.GetPeakUsedBytes() > peak && !PeakScratchBytes.compare_exchange_weak(peak, arena.GetPeakUsedBytes()))
+	{
+	}
+
+	INC_MEMORY_STAT_BY(STAT_DecodeScratch, arena.GetReservedBytes());
+	DEC_MEMORY_STAT_BY(STAT_DecodeScratch, reserved);
+	SET_MEMORY_STAT(STAT_DecodeScratchPeak, PeakScratchBytes.load());
+	SET_MEMORY_STAT(STAT_InflatePool, GetBufferPool().GetRetainedBytes());
+}
+
+static RepoSrcStream MakeStream(const uint8* data, int32 count, uint32 stride, uint32 componentType)
+{
+	RepoSrcStream stream;
+	stream.Data = data;
+	stream.Count = (uint32)count;
+	stream.Stride = stride;
+	stream.ComponentType = componentType;
+	return stream;
+}
+
+static void AddToGeometry(RepoSrcGeometryWriter& writer, const RepoSrcDecodedMesh& mesh)
+{
+	// The sections are stored as they are, except for UV1. Its first component, the id relative to the SRC, is stored,
+	// and the second, relative to the actor, is generated again when the geometry is loaded, as is the triangle id map.
+
+	RepoSrcGeometryMesh cached;
+	cached.Sections.resize(mesh.Sections.Num());
+
+	for (int32 i = 0; i < mesh.Sections.Num(); i++)
+	{
+		auto& section = mesh.Sections[i];
+		auto& geometry = section.Geometry;
+		auto& out = cached.Sections[i];
+
+		auto vertices = (const uint8*)geometry.ProcVertexBuffer.GetData();
+		auto numVertices = geometry.ProcVertexBuffer.Num();
+		auto stride = (uint32)sizeof(FProcMeshVertex);
+
+		out.bTranslucent = section.bTranslucent;
+		FMemory::Memcpy(&out.Bounds[0], &geometry.SectionLocalBox.Min, sizeof(FVector));
+		FMemory::Memcpy(&out.Bounds[3], &geometry.SectionLocalBox.Max, sizeof(FVector));
+
+		out.Indices = MakeStream((const uint8*)geometry.ProcIndexBuffer.GetData(), geometry.ProcIndexBuffer.Num(), sizeof(uint32), RepoSrcDecoder::ComponentTypeUInt32);
+		out.Positions = MakeStream(vertices + STRUCT_OFFSET(FProcMeshVertex, Position), numVertices, stride, RepoSrcDecoder::ComponentTypeFloat);
+		out.Normals = MakeStream(vertices + STRUCT_OFFSET(FProcMeshVertex, Normal), numVertices, stride, RepoSrcDecoder::ComponentTypeFloat);
+		out.Texcoords = MakeStream(vertices + STRUCT_OFFSET(FProcMeshVertex, UV0), numVertices, stride, RepoSrcDecoder::ComponentTypeFloat);
+		if (mesh.TriangleIdMap.Num() > 0)
+		{
+			out.Ids = MakeStream(vertices + STRUCT_OFFSET(FProcMeshVertex, UV1), numVertices, stride, RepoSrcDecoder::ComponentTypeFloat);
+		}
+	}
+
+	writer.AddMesh(cached);
+}
+
+bool RepoSrcDecodeTask::DecodeSrc(const TArray<uint8>& src, RepoSrcArena& arena)
+{
+	RepoSrcDecoder decoder;
+	decoder.SetBufferPool(&GetBufferPool());
+	decoder.SetArena(&arena);
+
+	RepoSrcStatus status;
+	{
+		REPO_TRACE_STAGE(Timeline, ParsingHeader);
+		status = decoder.ReadPreamble(src.GetData(), src.Num());
+		if (status == RepoSrcStatus::Ok)
+		{
+			status = decoder.ParseHeader();
+		}
+	}
+	if (status == RepoSrcStatus::Ok)
+	{
+		REPO_TRACE_STAGE(Timeline, Inflating);
+		status = decoder.BeginInflate();
+	}
+	if (status != RepoSrcStatus::Ok)
+	{
+		UE_LOG(LogTemp, Error, TEXT("%s. Import of %s will be aborted."), UTF8_TO_TCHAR(RepoSrcStatusToString(status)), *Uri);
+		return false;
+	}
+
+	auto uncompressedSize = decoder.IsCompressed() ? decoder.GetBufferSize() : 0;
+	INC_MEMORY_STAT_BY(STAT_Uncompressed, uncompressedSize);
+
+	UE_LOG(LogTemp, Log, TEXT("Decoding %d Meshes for %s."), (int32)decoder.GetNumMeshes(), *Uri);
+
+	// Each mesh is decoded as soon as the part of the buffer it references has been inflated. Exporters write the
+	// meshes in order, so this overlaps the inflation of the rest of the buffer with the creation of the components
+	// for the first meshes.
+
+	bool succeeded = true;
+
+	RepoSrcGeometryWriter writer;
+	auto writeGeometry = GeometryCache.IsValid();
+
+	RepoSrcMesh src_mesh;
+	for (size_t i = 0; i < decoder.GetNumMeshes(); i++)
+	{
+		uint64_t extent;
+		status = decoder.GetMeshExtent(i, extent);
+		if (status == RepoSrcStatus::Ok && !decoder.IsInflated() && decoder.GetInflatedSize() < extent)
+		{
+			REPO_TRACE_STAGE(Timeline, Inflating);
+			while (status == RepoSrcStatus::Ok && !decoder.IsInflated() && decoder.GetInflatedSize() < extent && !bCancelled)
+			{
+				status = decoder.InflateSome(extent - decoder.GetInflatedSize());
+			}
+		}
+		if (bCancelled)
+		{
+			succeeded = false; // The decoder's buffers are returned to the pool as it goes out of scope
+			break;
+		}
+		if (status == RepoSrcStatus::Ok)
+		{
+			REPO_TRACE_STAGE(Timeline, Resolving);
+			status = decoder.ResolveMesh(i, src_mesh);
+		}
+		if (status != RepoSrcStatus::Ok)
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s. Import of %s will be aborted."), UTF8_TO_TCHAR(RepoSrcStatusToString(status)), *Uri);
+			succeeded = false;
+			break;
+		}
+
+		// The mesh's scratch memory is released once it has been decoded. Anything the decoder allocated while resolving
+		// it, such as gathered views, comes before the marker and so is kept.
+
+		auto marker = arena.GetMarker();
+
+		RepoSrcDecodedMesh mesh;
+		{
+			REPO_TRACE_STAGE(Timeline, Resolving);
+			succeeded = DecodeMesh(src_mesh, mesh, arena);
+		}
+
+		arena.Rewind(marker);
+
+		if (!succeeded)
+		{
+			break;
+		}
+		if (writeGeometry)
+		{
+			AddToGeometry(writer, mesh); // Before the mesh is handed over, as its geometry is moved into the components
+		}
+		Meshes.Enqueue(MoveTemp(mesh));
+	}
+
+	DEC_MEMORY_STAT_BY(STAT_Uncompressed, uncompressedSize);
+
+	if (succeeded && writeGeometry && bGeometryCacheable && !bCancelled)
+	{
+		StoreGeometry(writer);
+	}
+
+	return succeeded;
+}
+
+void RepoSrcDecodeTask::StoreGeometry(const RepoSrcGeometryWriter& writer)
+{
+	REPO_TRACE_SCOPE(StoreGeometry);
+
+	if (writer.GetSize() > MAX_int32)
+	{
+		return;
+	}
+
+	TArray<uint8> content;
+	content.SetNumUninitialized((int32)writer.GetSize());
+	writer.Write(content.GetData());
+
+	// The file is written on the thread pool, as the web cache writes responses, so the worker can go on to the next SRC
+
+	auto cache = GeometryCache;
+	auto key = GeometryKey;
+	Async(EAsyncExecution::ThreadPool, [cache, key, content = MoveTemp(content)]()
+	{
+		cache->WriteRaw(key, content);
+	});
+}
+
+bool RepoSrcDecodeTask::ReadGeometry()
+{
+	SCOPE_CYCLE_COUNTER(STAT_LoadGeometry);
+	REPO_TRACE_STAGE(Timeline, LoadingGeometry);
+
+	TSharedPtr<RepoMappedCacheEntry, ESPMode::ThreadSafe> entry;
+	if (GeometryCache.IsValid())
+	{
+		entry = GeometryCache->OpenMapped(GeometryKey);
+	}
+
+	RepoSrcGeometryFile file;
+	auto status = entry.IsValid() ? file.Open(entry->GetData(), entry->GetSize()) : RepoSrcStatus::Truncated;
+	if (status != RepoSrcStatus::Ok)
+	{
+		if (entry.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Cached geometry for %s is unreadable (%s) and will be removed."), *Uri, UTF8_TO_TCHAR(RepoSrcStatusToString(status)));
+			GeometryCache->Invalidate(GeometryKey);
+		}
+		bGeometryMissing = true;
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Loading %d cached Meshes for %s."), (int32)file.GetNumMeshes(), *Uri);
+
+	// The streams are read straight out of the mapped file, which is released once every mesh has been copied out
+
+	RepoSrcGeometryMesh cached;
+	for (size_t i = 0; i < file.GetNumMeshes(); i++)
+	{
+		if (bCancelled)
+		{
+			return false;
+		}
+
+		file.GetMesh(i, cached);
+
+		RepoSrcDecodedMesh mesh;
+		if (!LoadMesh(cached, mesh))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Cached geometry for %s is corrupt and will be removed. Its import will be aborted."), *Uri);
+			GeometryCache->Invalidate(GeometryKey);
+			return false;
+		}
+		Meshes.Enqueue(MoveTemp(mesh));
+	}
+
+	return true;
+}
+
+bool RepoSrcDecodeTask::LoadMesh(const RepoSrcGeometryMesh& cached, RepoSrcDecodedMesh& mesh)
+{
+	for (auto& source : cached.Sections)
+	{
+		auto& section = mesh.Sections.AddDefaulted_GetRef();
+		section.bTranslucent = source.bTranslucent;
+
+		auto& geometry = section.Geometry;
+		geometry.bEnableCollision = true;
+
+		auto numVertices = source.Positions.Count;
+		if (numVertices > 0)
+		{
+			geometry.SectionLocalBox = FBox(FVector(source.Bounds[0], source.Bounds[1], source.Bounds[2]), FVector(source.Bounds[3], source.Bounds[4], source.Bounds[5]));
+		}
+
+		auto& indices = geometry.ProcIndexBuffer;
+		indices.SetNumUninitialized(source.Indices.Count);
+		RepoSrcKernels::WidenIndices(source.Indices, (int32*)indices.GetData());
+
+		// The entry is not hashed, so the indices are checked before they can reach the renderer, as decoded ones are
+
+		if (!RepoSrcKernels::CheckIndices((const int32*)indices.GetData(), indices.Num(), numVertices))
+		{
+			return false;
+		}
+
+		geometry.ProcVertexBuffer.SetNum(numVertices);
+
+		auto vertices = (uint8*)geometry.ProcVertexBuffer.GetData();
+		auto stride = sizeof(FProcMeshVertex);
+
+		RepoSrcKernels::CopyFloatsInterleaved(source.Positions, 3, vertices + STRUCT_OFFSET(FProcMeshVertex, Position), stride);
+		if (source.Normals.IsValid())
+		{
+			RepoSrcKernels::CopyFloatsInterleaved(source.Normals, 3, vertices + STRUCT_OFFSET(FProcMeshVertex, Normal), stride);
+		}
+		if (source.Texcoords.IsValid())
+		{
+			RepoSrcKernels::CopyFloatsInterleaved(source.Texcoords, 2, vertices + STRUCT_OFFSET(FProcMeshVertex, UV0), stride);
+		}
+
+		if (source.Ids.IsValid())
+		{
+			auto ids = (const float*)source.Ids.Data; // Streams in the file are aligned
+			auto firstTriangle = mesh.TriangleIdMap.AddUninitialized(section.NumTriangles());
+
+			if (!RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(ids, source.Ids.Count, LocalToActorSubmeshMap.GetData(), LocalToActorSubmeshMap.Num(), vertices + STRUCT_OFFSET(FProcMeshVertex, UV1), stride) ||
+				!RepoSrcKernels::GenerateTriangleIdMap((const int32*)indices.GetData(), indices.Num(), ids, source.Ids.Count, LocalToActorSubmeshMap.GetData(), LocalToActorSubmeshMap.Num(), mesh.TriangleIdMap.GetData() + firstTriangle))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool RepoSrcDecodeTask::DecodeMesh(const RepoSrcMesh& src_mesh, RepoSrcDecodedMesh& mesh, RepoSrcArena& arena)
+{
+	RepoSrcDecodedSection whole;
+	auto& geometry = whole.Geometry;
+	geometry.bEnableCollision = true;
+
+	geometry.ProcIndexBuffer.SetNumUninitialized(src_mesh.Indices.Count);
+	RepoSrcKernels::WidenIndices(src_mesh.Indices, (int32*)geometry.ProcIndexBuffer.GetData());
+	geometry.ProcIndexBuffer.SetNum(src_mesh.Indices.Count / 3 * 3, false); // Only whole triangles are drawn
+
+	// The vertices are default constructed, so that the attributes the SRC does not have take the same defaults as
+	// they would with CreateMeshSection(). As there, streams must have one element per position to be used.
+
+	auto numVertices = src_mesh.Positions.IsValid() ? src_mesh.Positions.Count : 0;
+
+	// The kernels below check the indices they read, but a mesh without ids or translucency reaches the renderer and
+	// collision cooking without them, so every mesh is checked here
+
+	if (!RepoSrcKernels::CheckIndices((const int32*)geometry.ProcIndexBuffer.GetData(), geometry.ProcIndexBuffer.Num(), numVertices))
+	{
+		UE_LOG(LogTemp, Error, TEXT("SRC %s has a mesh with an index out of range. Possible corruption."), *Uri);
+		return false;
+	}
+	geometry.ProcVertexBuffer.SetNum(numVertices);
+
+	auto vertices = (uint8*)geometry.ProcVertexBuffer.GetData();
+	auto stride = sizeof(FProcMeshVertex);
+
+	if (numVertices > 0)
+	{
+		float bounds[6];
+		RepoSrcKernels::UnityToUnrealInterleaved(src_mesh.Positions, vertices + STRUCT_OFFSET(FProcMeshVertex, Position), stride, bounds);
+		geometry.SectionLocalBox = FBox(FVector(bounds[0], bounds[1], bounds[2]), FVector(bounds[3], bounds[4], bounds[5]));
+	}
+
+	if (src_mesh.Normals.IsValid() && src_mesh.Normals.Count == numVertices)
+	{
+		RepoSrcKernels::UnityToUnrealInterleaved(src_mesh.Normals, vertices + STRUCT_OFFSET(FProcMeshVertex, Normal), stride, nullptr);
+	}
+
+	if (src_mesh.Texcoords.IsValid() && src_mesh.Texcoords.Count == numVertices)
+	{
+		RepoSrcKernels::CopyFloatsInterleaved(src_mesh.Texcoords, 2, vertices + STRUCT_OFFSET(FProcMeshVertex, UV0), stride);
+	}
+
+	//Ids are indices into the 'mapping' array provided by the counterpart .json.mpc file.
+
+	if (src_mesh.Ids.IsValid() && src_mesh.Ids.Count != numVertices)
+	{
+		bGeometryCacheable = false; // The geometry cache holds the ids in UV1, which is only written when there is one per vertex
+	}
+
+	if (!src_mesh.Ids.IsValid())
+	{
+		mesh.Sections.Add(MoveTemp(whole));
+		return true;
+	}
+
+	// The ids are read by each of the kernels below, so they are copied out once. They are a fraction of the size
+	// of the vertices.
+
+	auto& indices = geometry.ProcIndexBuffer;
+	auto numTriangles = indices.Num() / 3;
+	auto numIds = src_mesh.Ids.Count;
+
+	auto ids = arena.Allocate<float>(numIds);
+	auto triangleClasses = arena.Allocate<uint8>(numTriangles);
+	if (!ids || !triangleClasses)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Out of memory decoding SRC %s."), *Uri);
+		return false;
+	}
+
+	RepoSrcKernels::CopyFloats(src_mesh.Ids, 1, ids);
+
+	// SupermeshMapIndices relative to the Supermesh itself, and the Actor
+
+	mesh.TriangleIdMap.SetNumUninitialized(numTriangles);
+
+	if ((numIds == numVertices && !RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(ids, numIds, LocalToActorSubmeshMap.GetData(), LocalToActorSubmeshMap.Num(), vertices + STRUCT_OFFSET(FProcMeshVertex, UV1), stride)) ||
+		!RepoSrcKernels::GenerateTriangleIdMap((const int32*)indices.GetData(), indices.Num(), ids, numIds, LocalToActorSubmeshMap.GetData(), LocalToActorSubmeshMap.Num(), mesh.TriangleIdMap.GetData()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("SRC %s references a submesh that is not in its mapping. Possible corruption."), *Uri);
+		return false;
+	}
+
+	// Each triangle takes the material of its submesh, which is the same for all three of its vertices
+
+	auto numTranslucent = RepoSrcKernels::ClassifyTriangles((const int32*)indices.GetData(), indices.Num(), ids, numIds, LocalTranslucency.GetData(), LocalTranslucency.Num(), triangleClasses);
+	if (numTranslucent < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SRC %s references a submesh that is not in its mapping. Possible corruption."), *Uri);
+		return false;
+	}
+
+	if (numTranslucent == 0 || numTranslucent == numTriangles)
+	{
+		whole.bTranslucent = numTranslucent > 0;
+		mesh.Sections.Add(MoveTemp(whole));
+		return true;
+	}
+
+	return SplitSections(mesh, whole, triangleClasses, (int32)numTranslucent, arena);
+}
+
+bool RepoSrcDecodeTask::SplitSections(RepoSrcDecodedMesh& mesh, RepoSrcDecodedSection& whole, const uint8* triangleClasses, int32 numTranslucent, RepoSrcArena& arena)
+{
+	auto& source = whole.Geometry;
+	auto numTriangles = whole.NumTriangles();
+	auto numVertices = source.ProcVertexBuffer.Num();
+
+	// The triangle id map is reordered in place, from a copy of the original order
+
+	auto remap = arena.Allocate<int32>(numVertices);
+	auto vertices = arena.Allocate<int32>(numVertices);
+	auto triangleIds = arena.Allocate<int>(numTriangles);
+	if (!remap || !vertices || !triangleIds)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Out of memory decoding SRC %s."), *Uri);
+		return false;
+	}
+
+	FMemory::Memcpy(triangleIds, mesh.TriangleIdMap.GetData(), numTriangles * sizeof(int));
+	auto triangleIdMap = mesh.TriangleIdMap.GetData();
+
+	for (uint8 translucent = 0; translucent < 2; translucent++)
+	{
+		auto& section = mesh.Sections.AddDefaulted_GetRef();
+		section.bTranslucent = translucent != 0;
+
+		auto& geometry = section.Geometry;
+		geometry.bEnableCollision = source.bEnableCollision;
+
+		auto sectionTriangles = translucent ? numTranslucent : numTriangles - numTranslucent;
+		geometry.ProcIndexBuffer.SetNumUninitialized(sectionTriangles * 3);
+
+		FMemory::Memset(remap, 0xFF, numVertices * sizeof(int32)); // -1
+		auto sectionVertices = RepoSrcKernels::CompactTriangles((const int32*)source.ProcIndexBuffer.GetData(), source.ProcIndexBuffer.Num(), triangleClasses, translucent, remap, numVertices, (int32*)geometry.ProcIndexBuffer.GetData(), vertices);
+		if (sectionVertices < 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("SRC %s has an index that is out of range. Possible corruption."), *Uri);
+			return false;
+		}
+
+		geometry.ProcVertexBuffer.SetNumUninitialized((int32)sectionVertices);
+		geometry.SectionLocalBox.Init();
+		for (int32 i = 0; i < sectionVertices; i++)
+		{
+			auto& vertex = source.ProcVertexBuffer[vertices[i]];
+			geometry.ProcVertexBuffer[i] = vertex;
+			geometry.SectionLocalBox += vertex.Position;
+		}
+
+		for (int32 i = 0; i < numTriangles; i++)
+		{
+			if (triangleClasses[i] == translucent)
+			{
+				*triangleIdMap++ = triangleIds[i];
+			}
+		}
+	}
+
+	return true;
+}
@@ -17,31 +17,173 @@
 
 #include "RepoSrcImporter.h"
 #include "RepoWebRequestHelpers.h"
-#include "Misc/Compression.h"
 #include "HAL/UnrealMemory.h"
 #include "Materials/MaterialInstanceDynamic.h"
-#include <string>
+#include "Async/Async.h"
+#include "Decoder/RepoSrcAssetList.h"
+#include "Decoder/RepoSrcMapping.h"
 
-DECLARE_CYCLE_STAT(TEXT("Handle SRC"), STAT_HandleSRC, STATGROUP_Repo3D);
 DECLARE_CYCLE_STAT(TEXT("Generate Mesh"), STAT_GenerateMesh, STATGROUP_Repo3D);
 DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last Mappings Response Time (ms)"), STAT_DownloadMappings, STATGROUP_Repo3D);
 DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last SRC Response Time (ms)"), STAT_DownloadSRC, STATGROUP_Repo3D);
-DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Active Requests"), STAT_ActiveRequests, STATGROUP_Repo3D);
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Num Triangles"), STAT_TotalTriangles, STATGROUP_Repo3D);
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Num Vertices"), STAT_TotalVertices, STATGROUP_Repo3D);
 DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Num Objects"), STAT_TotalObjects, STATGROUP_Repo3D);
-DECLARE_MEMORY_STAT(TEXT("Uncompressed"), STAT_Uncompressed, STATGROUP_Repo3D);
 
 void URepoSrcImporter::BeginDestroy()
 {
 	Super::BeginDestroy();
-	// URepoSrcImporter cleanup 
+	// URepoSrcImporter cleanup. The actor may already be gone, so only the requests and decode tasks are stopped.
+	if (manager.IsValid())
+	{
+		CancelRequests();
+	}
+}
+
+void URepoSrcImporter::Cancel()
+{
+	if (bFinished)
+	{
+		return;
+	}
+	bFinished = true;
+
+	UE_LOG(LogTemp, Log, TEXT("Cancelling import with %d SRCs remaining"), importers.Num());
+
+	for (auto& importer : importers)
+	{
+		AddToTimeline(importer, RepoImportTimeline::Outcome::Cancelled); // The SRCs that held up the import are the ones of most interest
+	}
+
+	CancelRequests();
+
+	if (batcher.IsValid())
+	{
+		batcher->Flush(); // The batches may hold meshes of SRCs that did complete
+		batcher.Reset();
+	}
+
+	RestoreStaleAssets();
+
+	Finish();
+	OnCancelled.ExecuteIfBound();
+}
+
+void URepoSrcImporter::CancelRequests()
+{
+	if (assetsRequestId)
+	{
+		manager->CancelRequest(assetsRequestId);
+		assetsRequestId = 0;
+	}
+
+	manager->OnBackpressureChanged.Remove(backpressureHandle);
+
+	for (auto& importer : importers)
+	{
+		importer->Cancel();
+	}
+	importers.Reset();
+	pendingImporters.Reset();
+	mappedImporters.Reset();
+	numAwaitingSrc = 0;
+}
+
+void URepoSrcImporter::RestoreStaleAssets()
+{
+	// A cancelled update gives the actor back the assets it had not replaced yet. Where an asset was partially imported
+	// again, the old one is restored if the new one has no components; otherwise the new one is kept, and the next
+	// update will finish it.
+
+	for (auto& stale : staleAssets)
+	{
+		auto replacement = actor->ImportedAssets.Find(stale.Key);
+		if (replacement && !replacement->bComplete && replacement->Components.Num() == 0)
+		{
+			actor->ReleaseImportedAsset(*replacement);
+			actor->ImportedAssets.Remove(stale.Key);
+			replacement = nullptr;
+		}
+
+		if (replacement)
+		{
+			actor->ReleaseImportedAsset(stale.Value);
+		}
+		else
+		{
+			actor->ImportedAssets.Add(stale.Key, MoveTemp(stale.Value));
+		}
+	}
+	staleAssets.Reset();
+}
+
+bool URepoSrcImporter::IsTickable() const
+{
+	return !HasAnyFlags(RF_ClassDefaultObject) && importers.Num() > 0;
+}
+
+void URepoSrcImporter::Tick(float DeltaTime)
+{
+	// Sample the bytes downloaded for the throughput, which is averaged over the last RateWindowSeconds
+
+	auto now = FPlatformTime::Seconds();
+	auto progress = GetProgress();
+	rateSamples.Add(TPair<double, int64>(now, progress.BytesDownloaded));
+	while (rateSamples.Num() > 1 && rateSamples[1].Key < now - RateWindowSeconds)
+	{
+		rateSamples.RemoveAt(0);
+	}
+	OnProgress.ExecuteIfBound(progress);
+
+	CSV_CUSTOM_STAT(Repo3d, AssetsQueued, progress.NumQueued, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Repo3d, AssetsDownloading, progress.NumDownloading, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Repo3d, AssetsDecoding, progress.NumDecoding, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Repo3d, AssetsUploaded, progress.NumUploaded, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Repo3d, DownloadMegabytesPerSecond, progress.MegabytesPerSecond, ECsvCustomStatOp::Set);
+
+	// Create the components for any decoded SRCs, until this frame's budget has been spent. The budget is checked after
+	// each mesh, so at least one is always created per frame.
+
+	auto Deadline = FPlatformTime::Seconds() + UploadBudgetMs / 1000.0;
+
+	if (bViewChanged)
+	{
+		bViewChanged = false;
+		for (auto& importer : importers)
+		{
+			importer->UpdateSrcPriority(View.GetPriority(importer->GetMappingBounds()));
+		}
+	}
+
+	for (int32 i = importers.Num() - 1; i >= 0; i--) // Iterate backwards as completed importers will remove themselves
+	{
+		TSharedRef<RepoSrcAssetImporter> importer = importers[i]; // Hold a reference, as the importer will be removed from the array when it completes
+		if (importer->IsDecoded())
+		{
+			importer->CreateMeshes(Deadline);
+		}
+		if (FPlatformTime::Seconds() > Deadline)
+		{
+			break;
+		}
+	}
+}
+
+void URepoSrcImporter::SetView(const RepoView& InView)
+{
+	if (!View.Equals(InView))
+	{
+		View = InView;
+		bViewChanged = true; // The priorities are updated on the next tick, so the view can be set many times per frame
+	}
 }
 
 void URepoSrcImporter::RequestRevision(FString teamspace, FString model, FString revision)
 {
 	check(manager.IsValid());
 
+	startTime = FPlatformTime::Seconds();
+
 	// in parallel, set the model units
 	RepoWebRequestHelpers::GetModelSettings(
 		manager.ToSharedRef(), teamspace, model,
@@ -50,14 +192,16 @@ void URepoSrcImporter::RequestRevision(FString teamspace, FString model, FString
 
 	if (!revision.IsEmpty())
 	{
-		manager->GetRequest(
+		assetsRequestId = manager->GetRequest(
 			FString::Printf(TEXT("%s/%s/revision/%s/srcAssets.json"), *teamspace, *model, *revision),
-			RepoWebRequestDelegate::CreateUObject(this, &URepoSrcImporter::AssetsRequestCompleted)
+			RepoWebRequestDelegate::CreateUObject(this, &URepoSrcImporter::AssetsRequestCompleted),
+			0,
+			true // A specific revision never changes, so can be cached
 		);
 	}
 	else
 	{
-		manager->GetRequest(
+		assetsRequestId = manager->GetRequest(
 			FString::Printf(TEXT("%s/%s/revision/master/head/srcAssets.json"), *teamspace, *model),
 			RepoWebRequestDelegate::CreateUObject(this, &URepoSrcImporter::AssetsRequestCompleted)
 		);
@@ -90,523 +234,883 @@ void URepoSrcImporter::HandleModelSettings(TSharedRef<RepoWebRequestHelpers::Mod
 	actor->SetActorScale3D(FVector(factor, factor, factor));
 }
 
-void URepoSrcImporter::HandleAssets(const FString& string)
+void URepoSrcImporter::HandleAssets(const TArray<uint8>& content)
 {
-	TSharedPtr<FJsonObject> assetsList = MakeShareable(new FJsonObject());
-	TSharedRef<TJsonReader<TCHAR>> reader = TJsonReaderFactory<TCHAR>::Create(string);
-	FJsonSerializer::Deserialize(reader, assetsList);
+	RepoSrcAssetList assetList;
+	if (!assetList.Parse((const char*)content.GetData(), content.Num()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Malformed SRC Assets Json"));
+		HandleFailed();
+		return;
+	}
 
-	FVector worldOffset;
-	bool worldOffsetInitialised = false;
+	// An update places the new revision relative to the same origin as the assets it keeps
 
-	for (auto model : assetsList->GetArrayField("models"))
+	FVector worldOffset = actor->ImportOrigin;
+	bool worldOffsetInitialised = bUpdate && actor->bHasImportOrigin;
+
+	if (MergeVertexBudget > 0)
 	{
-		for (auto asset : model->AsObject()->GetArrayField("assets"))
-		{
-			TSharedRef<RepoSrcAssetImporter> importer = MakeShared<RepoSrcAssetImporter>(manager);
-			importer->SetActor(actor);
-			importer->SetMaterialPrototype(materialOpaque, materialTranslucent);
-			importers.Add(importer);
+		batcher = MakeShared<RepoMeshBatcher>(actor, materialOpaque, materialTranslucent, MergeVertexBudget);
+	}
 
-			importer->OnComplete.BindUObject(this, &URepoSrcImporter::HandleCompleted, importer);
+	TMap<FString, FVector> assets; // The offset of each asset in the revision, relative to the world offset
 
-			auto srcAssetUri = FString::Printf(TEXT("%s/%s/%s"),
-				*(model->AsObject()->GetStringField("database")),
-				*(model->AsObject()->GetStringField("model")),
-				*(asset->AsString()));
+	for (auto& model : assetList.Models)
+	{
+		auto modelUri = FString::Printf(TEXT("%s/%s"), UTF8_TO_TCHAR(model.Database.c_str()), UTF8_TO_TCHAR(model.Model.c_str()));
 
-			FVector offsetVector;
-			auto offsetElements = model->AsObject()->GetArrayField("offset");
-			for (int32 i = 0; i < offsetElements.Num(); i++)
-			{
-				offsetVector[i] = offsetElements[i]->AsNumber();
-			}
+		for (auto& asset : model.Assets)
+		{
+			auto srcAssetUri = FString::Printf(TEXT("%s/%s"), *modelUri, UTF8_TO_TCHAR(asset.c_str()));
+
+			FVector offsetVector(model.Offset[0], model.Offset[1], model.Offset[2]);
 
 			if (!worldOffsetInitialised)
 			{
 				worldOffset = offsetVector;
 				worldOffsetInitialised = true;
+				if (!actor->bHasImportOrigin)
+				{
+					actor->ImportOrigin = worldOffset;
+					actor->bHasImportOrigin = true;
+				}
 			}
 
 			offsetVector -= worldOffset;
 
-			importer->SetOffset(offsetVector); // this method automatically performs the coordinate transform from server coordinate system to Unreal
-			importer->SetUri(srcAssetUri);
-
-			importer->RequestSrc();
+			assets.Add(srcAssetUri, offsetVector);
 		}
 	}
-}
-
-void URepoSrcImporter::HandleCompleted(TSharedRef<RepoSrcAssetImporter> importer)
-{
-	UE_LOG(LogTemp, Log, TEXT("Completed SRC %s"), *(importer->Uri));
 
-	importers.Remove(importer);
-	
-	if(importers.Num() <= 0)
+	if (bUpdate)
 	{
-		UE_LOG(LogTemp, Log, TEXT("Completed All Importers"));
-		OnComplete.ExecuteIfBound();
+		TakeStaleAssets(assets);
 	}
-}
 
-void URepoSrcImporter::AssetsRequestCompleted(TSharedPtr<RepoWebResponse> Result)
-{
-	if (Result->bWasSuccessful && Result->Response->GetResponseCode() == 200)
+	for (auto& asset : assets)
 	{
-		UE_LOG(LogTemp, Log, TEXT("Received SRC Assets Json"));
-		HandleAssets(Result->Response->GetContentAsString());
+		if (actor->ImportedAssets.Contains(asset.Key))
+		{
+			continue; // Unchanged since the revision in the actor
+		}
+
+		TSharedRef<RepoSrcAssetImporter> importer = MakeShared<RepoSrcAssetImporter>(manager);
+		importer->SetActor(actor);
+		importer->SetMaterialPrototype(materialOpaque, materialTranslucent);
+		importer->SetBatcher(batcher);
+		importer->SetGeometryCache(bGeometryCache);
+		importers.Add(importer);
+
+		importer->OnComplete.BindUObject(this, &URepoSrcImporter::HandleCompleted, importer);
+		importer->OnMappingComplete.BindUObject(this, &URepoSrcImporter::HandleMappingCompleted, importer);
+
+		importer->SetOffset(asset.Value); // this method automatically performs the coordinate transform from server coordinate system to Unreal
+		importer->SetUri(asset.Key);
+
+		pendingImporters.Add(importer);
 	}
-	else
+
+	UE_LOG(LogTemp, Log, TEXT("Importing %d of %d SRCs"), importers.Num(), assets.Num());
+
+	numAssets = importers.Num();
+
+	if (importers.Num() <= 0)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failure reading SRC %d %s"), Result->Response->GetResponseCode(), *(Result->Request->GetURL()));
+		HandleAllCompleted();
+		return;
 	}
+
+	// Rather than queue every request at once, the importers are started as the manager has room for them
+
+	backpressureHandle = manager->OnBackpressureChanged.AddUObject(this, &URepoSrcImporter::HandleBackpressureChanged);
+	RequestPendingSrcs();
 }
 
-void RepoSrcAssetImporter::SetOffset(FVector v)
+void URepoSrcImporter::HandleBackpressureChanged(bool backpressured)
 {
-	Offset = TransformCoordinateSystem(v);
+	if (!backpressured)
+	{
+		RequestPendingSrcs();
+	}
 }
 
-void RepoSrcAssetImporter::RequestSrc()
+void URepoSrcImporter::RequestPendingSrcs()
 {
-	UE_LOG(LogTemp, Log, TEXT("Requesting SRC %s"), *Uri);
+	// SRCs whose mappings have arrived are requested first, those that will cover the most of the view first
 
-	// For this version, just read the mapping first, and only when its received request the main SRC file
-	manager->GetRequest(
-		FString::Printf(TEXT("%s.json.mpc"), *Uri),
-		RepoWebRequestDelegate::CreateLambda(
-			[this](TSharedPtr<RepoWebResponse> result)
-			{	
-				DEC_DWORD_STAT_BY(STAT_ActiveRequests, 1);
-				if (MappingRequestCompleted(result)) {
-					manager->GetRequest(
-						FString::Printf(TEXT("%s.src.mpc"), *Uri),
-						RepoWebRequestDelegate::CreateRaw(this, &RepoSrcAssetImporter::SrcRequestCompleted)
-					);
-					INC_DWORD_STAT_BY(STAT_ActiveRequests, 1);
-				}
-				else
-				{
-					OnComplete.ExecuteIfBound();
-				}
-			})
-	);
+	while (mappedImporters.Num() > 0 && !manager->IsBackpressured())
+	{
+		int32 best = 0;
+		int32 bestPriority = View.GetPriority(mappedImporters[0]->GetMappingBounds());
+		for (int32 i = 1; i < mappedImporters.Num(); i++)
+		{
+			auto priority = View.GetPriority(mappedImporters[i]->GetMappingBounds());
+			if (priority > bestPriority)
+			{
+				best = i;
+				bestPriority = priority;
+			}
+		}
+
+		auto importer = mappedImporters[best];
+		mappedImporters.RemoveAt(best);
+		importer->RequestSrc(bestPriority);
+		numAwaitingSrc--;
+	}
+
+	// With a view, the mappings are requested ahead of the SRCs, so that there is a choice of SRCs to request next.
+	// Without one, both files are requested together, in the order of srcAssets.json.
+
+	int32 numRequested = 0;
+	while (numRequested < pendingImporters.Num() && !manager->IsBackpressured())
+	{
+		auto& importer = pendingImporters[numRequested];
+		if (View.IsValid())
+		{
+			if (numAwaitingSrc >= MappingLookahead)
+			{
+				break;
+			}
+			importer->RequestMapping();
+			numAwaitingSrc++;
+		}
+		else
+		{
+			importer->RequestMapping();
+			importer->RequestSrc(0);
+		}
+		numRequested++;
+	}
+	pendingImporters.RemoveAt(0, numRequested);
 
-	INC_DWORD_STAT_BY(STAT_ActiveRequests, 1);
+	if (pendingImporters.Num() <= 0 && numAwaitingSrc <= 0)
+	{
+		manager->OnBackpressureChanged.Remove(backpressureHandle);
+	}
 }
 
-void RepoSrcAssetImporter::SrcRequestCompleted(TSharedPtr<RepoWebResponse> Result)
+void URepoSrcImporter::HandleMappingCompleted(TSharedRef<RepoSrcAssetImporter> importer)
 {
-	DEC_DWORD_STAT_BY(STAT_ActiveRequests, 1);
-	SET_FLOAT_STAT(STAT_DownloadSRC, Result->Time * 1000.0);
-	
+	if (importer->IsSrcRequested())
+	{
+		return;
+	}
 
-	if (Result->bWasSuccessful && Result->Response->GetResponseCode() == 200)
+	if (importer->HasMapping())
 	{
-		UE_LOG(LogTemp, Log, TEXT("Received SRC %s.src.mpc"), *Uri);
-		HandleSrc(Result->Response->GetContent());
+		mappedImporters.Add(importer);
 	}
 	else
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failure reading SRC %d %s"), Result->Response->GetResponseCode(), *(Result->Request->GetURL()));
+		numAwaitingSrc--; // The importer will complete without requesting its SRC
 	}
 
-	OnComplete.ExecuteIfBound();
+	RequestPendingSrcs();
 }
 
-bool RepoSrcAssetImporter::MappingRequestCompleted(TSharedPtr<RepoWebResponse> Result)
+void URepoSrcImporter::HandleCompleted(TSharedRef<RepoSrcAssetImporter> importer)
 {
-	SET_FLOAT_STAT(STAT_DownloadMappings, Result->Time * 1000.0);
+	UE_LOG(LogTemp, Log, TEXT("Completed SRC %s"), *(importer->Uri));
 
-	if (Result->bWasSuccessful && Result->Response->GetResponseCode() == 200)
+	if (importer->HasSucceeded())
 	{
-		UE_LOG(LogTemp, Log, TEXT("Received Json Supermesh Mapping (%s.json.mpc)"), *Uri);
-		HandleMapping(Result->Response->GetContentAsString());
-		return true;
+		numUploaded++;
 	}
 	else
 	{
-		UE_LOG(LogTemp, Error, TEXT("Failure reading Json Supermesh Mapping for SRC %d %s"), Result->Response->GetResponseCode(), *(Result->Request->GetURL()));
-		return false;
+		numFailed++;
 	}
-}
+	AddToTimeline(importer, importer->HasSucceeded() ? RepoImportTimeline::Outcome::Uploaded : RepoImportTimeline::Outcome::Failed);
+	completedBytes += importer->GetBytesReceived();
+	completedTriangles += importer->GetNumTriangles();
 
-#pragma optimize("", off)
+	importers.Remove(importer);
+	
+	if(importers.Num() <= 0)
+	{
+		HandleAllCompleted();
+	}
+}
 
-void RepoSrcAssetImporter::HandleMapping(const FString& string)
+void URepoSrcImporter::HandleAllCompleted()
 {
-	if (LocalToActorSubmeshMap.Num())
+	bFinished = true;
+
+	if (batcher.IsValid())
 	{
-		UE_LOG(LogTemp, Error, TEXT("Non-empty Local Map"));
+		batcher->Flush(); // Create components for the partially filled batches
+		batcher.Reset();
 	}
 
-	auto &ActorIdMap = actor->GetSubmeshMap();
+	// The assets replaced by an update are only removed now, so the actor is never missing parts of the model
 
-	mappings = MakeShareable(new FJsonObject());
-	TSharedRef<TJsonReader<TCHAR>> reader = TJsonReaderFactory<TCHAR>::Create(string);
-	FJsonSerializer::Deserialize(reader, mappings);
+	for (auto& asset : staleAssets)
+	{
+		actor->ReleaseImportedAsset(asset.Value);
+	}
+	if (staleAssets.Num())
+	{
+		UE_LOG(LogTemp, Log, TEXT("Removed %d SRCs"), staleAssets.Num());
+	}
+	staleAssets.Reset();
 
-	numSubmeshes = mappings->GetIntegerField(TEXT("numberOfIDs"));
+	UE_LOG(LogTemp, Log, TEXT("Completed All Importers"));
+	Finish();
+	OnComplete.ExecuteIfBound();
+}
 
-	auto maps = mappings->GetArrayField(TEXT("mapping"));
-	for (int32 i = 0; i < maps.Num(); i++)
-	{
-		auto mapping = maps[i]->AsObject();
-		auto name = mapping->GetStringField(TEXT("Name"));
+void URepoSrcImporter::HandleFailed()
+{
+	// No SRC has been imported, so there is nothing to keep. OnComplete is raised as usual, so the owner can release
+	// the importer; the progress shows that no assets were loaded.
 
-		auto globalIndex = ActorIdMap.AddUnique(name);
-		LocalToActorSubmeshMap.Add(globalIndex);
-	}
+	bFinished = true;
 
-	auto materials = mappings->GetArrayField(TEXT("appearance"));
-	for (auto material : materials)
-	{
-		auto name = material->AsObject()->GetStringField(TEXT("name"));
-		Material m;
+	CancelRequests();
+	RestoreStaleAssets();
+
+	UE_LOG(LogTemp, Error, TEXT("Import failed"));
+	Finish();
+	OnComplete.ExecuteIfBound();
+}
+
+void URepoSrcImporter::Finish()
+{
+	finishTime = FPlatformTime::Seconds();
 
-		auto materialJson = material->AsObject()->GetObjectField(TEXT("material"));
-		
-		m.diffuse = ParseJsonColour(materialJson->GetStringField(TEXT("diffuseColor")));
+	auto progress = GetProgress();
+	UE_LOG(LogTemp, Log, TEXT("Loaded %d of %d SRCs (%d failed), %.1f MB and %lld triangles in %.1f s"),
+		progress.NumUploaded, progress.NumAssets, progress.NumFailed, progress.BytesDownloaded / 1e6, progress.NumTriangles, progress.ElapsedSeconds);
+	OnProgress.ExecuteIfBound(progress);
 
-		if (materialJson->HasField(TEXT("specularColor")))
+	if (!timelineFilename.IsEmpty())
+	{
+		if (timeline.Write(timelineFilename, startTime, finishTime))
 		{
-			m.specular = ParseJsonColour(materialJson->GetStringField(TEXT("specularColor")));
+			UE_LOG(LogTemp, Log, TEXT("Wrote the import timeline to %s"), *timelineFilename);
 		}
-		if(materialJson->HasField(TEXT("transparency")))
+		else
 		{
-			FDefaultValueHelper::ParseFloat(materialJson->GetStringField(TEXT("transparency")), m.transparency);
+			UE_LOG(LogTemp, Warning, TEXT("Unable to write the import timeline to %s"), *timelineFilename);
 		}
+	}
+}
 
-		mappingMaterials.Add(name, m);
+void URepoSrcImporter::AddToTimeline(TSharedRef<RepoSrcAssetImporter> importer, RepoImportTimeline::Outcome outcome)
+{
+	if (!timelineFilename.IsEmpty())
+	{
+		timeline.Add(importer->Uri, importer->GetTimeline(), outcome, importer->IsFromCache(), importer->GetBytesReceived(), importer->GetNumTriangles());
 	}
+}
 
-	hasTransparency = false;
-	for (auto material : mappingMaterials)
+RepoImportProgress URepoSrcImporter::GetProgress() const
+{
+	RepoImportProgress progress;
+	progress.NumAssets = numAssets;
+	progress.NumUploaded = numUploaded;
+	progress.NumFailed = numFailed;
+	progress.BytesDownloaded = assetsBytes + completedBytes;
+	progress.NumTriangles = completedTriangles;
+
+	for (auto& importer : importers)
 	{
-		if (material.Value.transparency != 0)
+		if (!importer->IsSrcRequested())
+		{
+			progress.NumQueued++;
+		}
+		else if (importer->IsDecoding())
+		{
+			progress.NumDecoding++;
+		}
+		else
 		{
-			hasTransparency = true;
+			progress.NumDownloading++;
 		}
+		progress.BytesDownloaded += importer->GetBytesReceived();
+		progress.NumTriangles += importer->GetNumTriangles();
 	}
 
-	for (int32 i = 0; i < maps.Num(); i++)
+	// The SRCs that have not arrived yet are assumed to be the average size of those that have finished
+
+	progress.BytesExpected = progress.BytesDownloaded;
+	auto numCompleted = numUploaded + numFailed;
+	if (numCompleted > 0)
 	{
-		auto mapping = maps[i]->AsObject();
-		auto name = mapping->GetStringField(TEXT("Name")); // in this format (.json.mpc) name is the id
-		auto appearance = mapping->GetStringField(TEXT("appearance"));
-		auto material = mappingMaterials[appearance];
+		progress.BytesExpected += completedBytes / numCompleted * (progress.NumQueued + progress.NumDownloading);
+	}
 
-		material.diffuse.A = 1.0 - material.transparency;
+	auto now = bFinished ? finishTime : FPlatformTime::Seconds();
+	progress.ElapsedSeconds = startTime > 0 ? now - startTime : 0;
 
-		actor->DiffuseMap->SetParameter(name, material.diffuse);
+	if (rateSamples.Num() > 0 && now > rateSamples[0].Key)
+	{
+		progress.MegabytesPerSecond = (float)((progress.BytesDownloaded - rateSamples[0].Value) / (now - rateSamples[0].Key) / 1e6);
 	}
 
-	// Every time the parameters change we update all map components, not only the ones we explicitly know of,
-	// to ensure the materials are initialised to sensible values.
-	for (auto component : actor->GetComponents())
+	return progress;
+}
+
+void URepoSrcImporter::TakeStaleAssets(const TMap<FString, FVector>& assets)
+{
+	// An asset is stale if it is not in the revision, has moved, or did not import completely
+
+	TSet<FString> stale;
+	for (auto& imported : actor->ImportedAssets)
 	{
-		auto map = Cast<URepoSupermeshMapComponent>(component);
-		if (map) {
-			map->UpdateTexture();
+		auto offset = assets.Find(imported.Key);
+		if (!offset || !RepoSrcAssetImporter::TransformCoordinateSystem(*offset).Equals(imported.Value.Offset) || !imported.Value.bComplete)
+		{
+			stale.Add(imported.Key);
+		}
+	}
+
+	// Merged components hold the geometry of several assets, so destroying one removes part of the others. Those assets
+	// are reimported too, as are any that share a component with them in turn.
+
+	TSet<UPrimitiveComponent*> staleComponents;
+	bool bChanged = stale.Num() > 0;
+	while (bChanged)
+	{
+		bChanged = false;
+		for (auto& imported : actor->ImportedAssets)
+		{
+			if (stale.Contains(imported.Key))
+			{
+				for (auto& component : imported.Value.Components)
+				{
+					staleComponents.Add(component.Get());
+				}
+			}
+		}
+		for (auto& imported : actor->ImportedAssets)
+		{
+			if (stale.Contains(imported.Key))
+			{
+				continue;
+			}
+			for (auto& component : imported.Value.Components)
+			{
+				if (component.IsValid() && staleComponents.Contains(component.Get()))
+				{
+					stale.Add(imported.Key);
+					bChanged = true;
+					break;
+				}
+			}
 		}
 	}
 
-	INC_DWORD_STAT_BY(STAT_TotalObjects, maps.Num())
+	// The stale assets are taken out of the actor, so those in the revision are imported again alongside the new ones
+
+	for (auto& uri : stale)
+	{
+		RepoImportedAsset asset;
+		actor->ImportedAssets.RemoveAndCopyValue(uri, asset);
+		staleAssets.Add(uri, MoveTemp(asset));
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Updating %s: %d of %d SRCs changed"), *(actor->GetName()), stale.Num(), actor->ImportedAssets.Num() + stale.Num());
 }
 
-void RepoSrcAssetImporter::HandleSrc(const TArray<uint8>& src)
+void URepoSrcImporter::AssetsRequestCompleted(RepoWebResponsePtr Result)
 {
-	SCOPE_CYCLE_COUNTER(STAT_HandleSRC);
+	assetsRequestId = 0;
+
+	if (Result->bWasSuccessful && Result->GetResponseCode() == 200)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Received SRC Assets Json"));
+		assetsBytes = Result->GetContent().Num();
+		HandleAssets(Result->GetContent());
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failure reading SRC %d %s"), Result->GetResponseCode(), *(Result->GetURL()));
+		HandleFailed();
+	}
+}
 
-	auto data = (const uint8*)src.GetData();
+RepoSrcAssetImporter::~RepoSrcAssetImporter()
+{
+	Cancel(); // The requests hold raw delegates to this instance
+}
 
-	auto preamble = (const uint32*)(data);
-	auto srcMagicBit = preamble[0];
-	auto srcVersion = preamble[1];
-	auto jsonByteSize = preamble[2];
+void RepoSrcAssetImporter::Cancel()
+{
+	OnComplete.Unbind();
+	OnMappingComplete.Unbind();
 
-	if (srcMagicBit != 23 && srcMagicBit != 24)
+	if (MappingRequestId)
 	{
-		UE_LOG(LogTemp, Error, TEXT("SRC Magic Bit Mismatch. Expected 23 or 24 but received %d. Import will be aborted."), srcMagicBit);
-		return;
+		manager->CancelRequest(MappingRequestId);
+		MappingRequestId = 0;
 	}
-	if (srcVersion != 42)
+	if (SrcRequestId)
 	{
-		UE_LOG(LogTemp, Error, TEXT("SRC Magic Bit Mismatch. Expected 42 but received %d. Import will be aborted."), srcVersion);
-		return;
+		manager->CancelRequest(SrcRequestId);
+		SrcRequestId = 0;
 	}
 
-	bool isCompressed = false;
-	if (srcMagicBit == 24)
+	MappingResult.Reset();
+	SrcResult.Reset();
+	bGeometryCached = false;
+
+	// The task may still be running on a worker, which holds its own reference. It stops before its next mesh, and the
+	// meshes it has decoded so far are released here.
+
+	if (DecodeTask.IsValid())
 	{
-		isCompressed = true;
+		DecodeTask->Cancel();
+		DecodeTask->Meshes.Empty();
+		DecodeTask.Reset();
+		DecodeResult.Reset();
 	}
+}
+
+void RepoSrcAssetImporter::SetOffset(FVector v)
+{
+	Offset = TransformCoordinateSystem(v);
+}
 
-	buffer = data + 12 + jsonByteSize;
+void RepoSrcAssetImporter::RequestMapping()
+{
+	UE_LOG(LogTemp, Log, TEXT("Requesting Mapping %s"), *Uri);
+
+	// SRC assets are immutable (a new revision has new assets), so both files can always be cached.
+
+	// Whichever of the mapping and the SRC arrives first, JoinRequests() will handle the mapping before the SRC, and
+	// raise OnComplete only once both responses have been received. Mappings are small, and are needed to decide the
+	// priority of the SRCs, so they are sent before any SRC.
+
+	MappingRequestId = manager->GetRequest(
+		FString::Printf(TEXT("%s.json.mpc"), *Uri),
+		RepoWebRequestDelegate::CreateRaw(this, &RepoSrcAssetImporter::MappingRequestCompleted),
+		MAX_int32,
+		true,
+		&RepoSrcAssetImporter::ConvertMappingForCache
+	);
+}
 
-	if (isCompressed) //zlib buffer compression is enabled
+bool RepoSrcAssetImporter::ConvertMappingForCache(const TArray<uint8>& Content, TArray<uint8>& Cached)
+{
+	// The mapping is stored in its binary form, so later loads of the revision do not parse any JSON for it. Parse()
+	// tells the forms apart, so HandleMapping() takes either.
+
+	RepoSrcMapping mapping;
+	if (RepoSrcMapping::IsBinary((const char*)Content.GetData(), Content.Num()) || !mapping.Parse((const char*)Content.GetData(), Content.Num()))
 	{
-		auto uncompressedSize = ((uint32_t*)buffer)[0];
-		buffer += 4;
-		auto compressedSize = src.Num() - 12 - jsonByteSize - 4;
+		return false;
+	}
+
+	Cached.SetNumUninitialized(mapping.GetBinarySize());
+	mapping.WriteBinary(Cached.GetData());
+	return true;
+}
 
-		//check() compressedSize
+void RepoSrcAssetImporter::RequestSrc(int32 priority)
+{
+	bSrcRequested = true;
+	SrcPriority = priority;
 
-		auto uncompressed = FMemory::Malloc(uncompressedSize);
+	// If the decoded geometry is in the cache, the SRC is not requested at all. JoinRequests() loads the geometry once
+	// the mapping has been handled, as it is needed to resolve the ids.
 
-		FCompression::UncompressMemory(
-			NAME_Zlib,
-			uncompressed,
-			uncompressedSize,
-			buffer,
-			compressedSize);
+	auto cache = manager->GetCache();
+	if (bUseGeometryCache && !bGeometryCacheFailed && cache.IsValid() && cache->Contains(GetGeometryCacheKey()))
+	{
+		UE_LOG(LogTemp, Log, TEXT("Found cached geometry for SRC %s"), *Uri);
+		bGeometryCached = true;
+		bFromCache = true;
+		JoinRequests();
+		return;
+	}
 
-		buffer = (uint8_t*)uncompressed;
+	UE_LOG(LogTemp, Log, TEXT("Requesting SRC %s"), *Uri);
+
+	SrcRequestId = manager->GetRequest(
+		FString::Printf(TEXT("%s.src.mpc"), *Uri),
+		RepoWebRequestDelegate::CreateRaw(this, &RepoSrcAssetImporter::SrcRequestCompleted),
+		priority,
+		true
+	);
+}
+
+FBox RepoSrcAssetImporter::GetMappingBounds() const
+{
+	if (!MappingBounds.IsValid || !actor.IsValid())
+	{
+		return FBox(ForceInit);
+	}
+	return MappingBounds.TransformBy(actor->GetActorTransform());
+}
 
-		INC_MEMORY_STAT_BY(STAT_Uncompressed, uncompressedSize)
+void RepoSrcAssetImporter::UpdateSrcPriority(int32 priority)
+{
+	if (SrcRequestId && !bSrcSent && !manager->SetPriority(SrcRequestId, priority))
+	{
+		bSrcSent = true;
 	}
+}
 
-	const std::string cstr(reinterpret_cast<const char*>(data + 12), jsonByteSize); // exporter explicitly uses 12
-	auto jsonStr = FString(cstr.c_str());
-	header = MakeShareable(new FJsonObject());
-	TSharedRef<TJsonReader<TCHAR>> reader = TJsonReaderFactory<TCHAR>::Create(jsonStr);
-	FJsonSerializer::Deserialize(reader, header);
+void RepoSrcAssetImporter::SrcRequestCompleted(RepoWebResponsePtr Result)
+{
+	SET_FLOAT_STAT(STAT_DownloadSRC, (Result->CompletedTime - Result->SentTime) * 1000.0);
 
-	indexViews = header->GetObjectField(TEXT("accessors"))->GetObjectField(TEXT("indexViews"));
-	attributeViews = header->GetObjectField(TEXT("accessors"))->GetObjectField(TEXT("attributeViews"));
-	bufferViews = header->GetObjectField(TEXT("bufferViews"));
-	bufferChunks = header->GetObjectField(TEXT("bufferChunks"));
+	SrcRequestId = 0;
 
-	// A 3D Repo scene will have multiple meshes, each delivered as a separate SRC. Within the SRC there are multiple meshes
-	// with correspond to the split parts of the SRC's scene mesh.
+	if (Result->bWasSuccessful)
+	{
+		BytesReceived += Result->GetContent().Num();
+	}
 
-	auto meshes = header->GetObjectField(TEXT("meshes"))->Values;
+	bFromCache = Result->bFromCache;
+	Timeline.Add(RepoAssetStage::Queued, Result->QueuedTime, Result->SentTime);
+	Timeline.Add(RepoAssetStage::Waiting, Result->SentTime, Result->FirstByteTime);
+	Timeline.Add(RepoAssetStage::Downloading, Result->FirstByteTime, Result->CompletedTime);
 
-	UE_LOG(LogTemp, Log, TEXT("Creating %d Procedural Meshes for %s."), meshes.Num(), *Uri);
+	SrcResult = Result;
+	JoinRequests();
+}
 
-	for (auto mesh_field : meshes)
+void RepoSrcAssetImporter::MappingRequestCompleted(RepoWebResponsePtr Result)
+{
+	SET_FLOAT_STAT(STAT_DownloadMappings, (Result->CompletedTime - Result->SentTime) * 1000.0);
+
+	MappingRequestId = 0;
+
+	if (Result->bWasSuccessful)
 	{
-		SCOPE_CYCLE_COUNTER(STAT_GenerateMesh);
+		BytesReceived += Result->GetContent().Num();
+	}
 
-		auto object = mesh_field.Value->AsObject();
-		auto attributes = object->GetObjectField(TEXT("attributes"));
+	MappingResult = Result;
+	JoinRequests();
+}
 
-		TArray<int32> triangles;
-		ResolveIndices(object->GetStringField(TEXT("indices")), triangles);
+void RepoSrcAssetImporter::JoinRequests()
+{
+	// The mapping is handled as soon as it arrives, as the SRC cannot be decoded without it
 
+	if (MappingResult.IsValid() && !bMappingHandled)
+	{
+		bMappingHandled = true;
 
-		TArray<FVector> vertices;
-		if (attributes->HasField(TEXT("position")))
+		if (MappingResult->bWasSuccessful && MappingResult->GetResponseCode() == 200)
 		{
-			ResolveAttribute(attributes->GetStringField(TEXT("position")), vertices);
+			UE_LOG(LogTemp, Log, TEXT("Received %s Supermesh Mapping (%s.json.mpc)"), MappingResult->bFromCache ? TEXT("Cached") : TEXT("Json"), *Uri);
+			bMappingSucceeded = HandleMapping(MappingResult->GetContent());
 		}
-
-		TArray<FVector> normals;
-		if (attributes->HasField(TEXT("normal")))
+		else
 		{
-			ResolveAttribute(attributes->GetStringField(TEXT("normal")), normals);
+			UE_LOG(LogTemp, Error, TEXT("Failure reading Json Supermesh Mapping for SRC %d %s"), MappingResult->GetResponseCode(), *(MappingResult->GetURL()));
 		}
 
-		TArray<FVector2D> uv0;
-		if (attributes->HasField(TEXT("texcoord")))
-		{
-			ResolveAttribute(attributes->GetStringField(TEXT("texcoord")), uv0);
-		}
+		Timeline.Add(RepoAssetStage::Mapping, MappingResult->QueuedTime, FPlatformTime::Seconds());
+
+		MappingResult.Reset();
 
-		//Ids are indices into the 'mapping' array provided by the counterpart .json.mpc file.
+		OnMappingComplete.ExecuteIfBound();
 
-		TArray<float> ids;
-		if (attributes->HasField(TEXT("id")))
+		if (!bMappingSucceeded && !bSrcRequested)
 		{
-			ResolveAttribute(attributes->GetStringField(TEXT("id")), ids);
+			OnComplete.ExecuteIfBound(); // The SRC will never be requested
+			return;
 		}
+	}
 
-		TransformCoordinateSystem(vertices);
-		TransformCoordinateSystem(normals);
+	if (!bMappingHandled || (!SrcResult.IsValid() && !bGeometryCached))
+	{
+		return; // Wait for the other response
+	}
 
-		TArray<FLinearColor> vertexColors; // Empty arrays
-		TArray<FProcMeshTangent> tangents;
-		TArray<FVector2D> uv1;
-		TArray<FVector2D> uv2;
-		TArray<FVector2D> uv3;
+	auto Result = SrcResult;
+	SrcResult.Reset();
 
-		GenerateSupermeshMapIndices(ids, uv1); // SupermeshMapIndices relative to the Supermesh itself, and the Actor
+	auto bLoadGeometry = bGeometryCached;
+	bGeometryCached = false;
 
-		auto mesh = actor->AddProceduralMesh();
-		mesh->SetRelativeLocation(Offset);
-		mesh->CreateMeshSection_LinearColor(0, vertices, triangles, normals, uv0, uv1, uv2, uv3, vertexColors, tangents, true);
+	if (!bMappingSucceeded)
+	{
+		OnComplete.ExecuteIfBound();
+	}
+	else if (bLoadGeometry)
+	{
+		HandleSrc(nullptr);
+	}
+	else if (Result->bWasSuccessful && Result->GetResponseCode() == 200)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Received SRC %s.src.mpc"), *Uri);
+		HandleSrc(Result); // OnComplete will be raised by CreateMeshes(), once the decoded meshes have been turned into components
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failure reading SRC %d %s"), Result->GetResponseCode(), *(Result->GetURL()));
+		OnComplete.ExecuteIfBound();
+	}
+}
 
-		mesh->SetCollisionProfileName(FName("IgnoreOnlyPawn"));
+bool RepoSrcAssetImporter::HandleMapping(const TArray<uint8>& content)
+{
+	REPO_TRACE_SCOPE(HandleMapping);
 
-		actor->MeshComponentTriangleMaps.Add(mesh, TArray<int>());
-		auto triangleIdMap = actor->MeshComponentTriangleMaps.Find(mesh); // This slightly odd way of getting and passing the array is to avoid a copy when adding to the map
-		GenerateTriangleIdMap(triangles, ids, *triangleIdMap);
+	if (LocalToActorSubmeshMap.Num())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Non-empty Local Map"));
+	}
 
-		UMaterialInterface* materialPrototype = nullptr;
+	RepoSrcMapping mapping;
+	if (!mapping.Parse((const char*)content.GetData(), content.Num()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Malformed Supermesh Mapping for SRC %s"), *Uri);
+		return false;
+	}
 
-		if (hasTransparency)
+	// The actor marks its free IdMap entries with an empty id, so a submesh without one cannot be added. This is
+	// checked before any ids are added, so a rejected mapping leaves the actor as it was.
+	for (auto& entry : mapping.Entries)
+	{
+		if (!entry.NameSize)
 		{
-			materialPrototype = materialTranslucent;
+			UE_LOG(LogTemp, Error, TEXT("Supermesh Mapping for SRC %s has a submesh without an id"), *Uri);
+			return false;
 		}
-		else
+	}
+
+	for (auto& appearance : mapping.Appearances)
+	{
+		if (!appearance.bDefined)
 		{
-			materialPrototype = materialOpaque;
+			UE_LOG(LogTemp, Warning, TEXT("Supermesh Mapping for SRC %s references missing appearance %s"), *Uri, UTF8_TO_TCHAR(appearance.Name.c_str()));
 		}
+	}
 
-		if (materialPrototype) 
-		{
-			auto material = UMaterialInstanceDynamic::Create(materialPrototype, mesh);
-			
-			for (auto component : actor->GetComponents())
-			{
-				auto map = Cast<URepoSupermeshMapComponent>(component);
-				if (map) {
-					map->ApplyTextureToMaterials(material);
-				}
-			}
+	// The entries are resolved in one pass: the id of each submesh is added to the actor, its bounds are used to
+	// prioritise the SRC request before its geometry is known, and its appearance decides its colour and whether it
+	// goes in the translucent section of the decode task.
+
+	auto numEntries = (int32)mapping.Entries.size();
+	LocalToActorSubmeshMap.Reserve(numEntries);
+	LocalTranslucency.SetNumZeroed(numEntries);
+
+	for (int32 i = 0; i < numEntries; i++)
+	{
+		auto& entry = mapping.Entries[i];
+
+		auto name = mapping.GetName(entry);
+		FUTF8ToTCHAR convertedName(name.Data, name.Size);
+		auto globalIndex = actor->AddSubmeshId(FString(convertedName.Length(), convertedName.Get()));
+		LocalToActorSubmeshMap.Add(globalIndex);
 
-			mesh->SetMaterial(0, material);
+		if (entry.bHasBounds)
+		{
+			MappingBounds += TransformCoordinateSystem(FVector(entry.Min[0], entry.Min[1], entry.Min[2])) + Offset;
+			MappingBounds += TransformCoordinateSystem(FVector(entry.Max[0], entry.Max[1], entry.Max[2])) + Offset;
 		}
 
-		Bounds += mesh->CalcLocalBounds().TransformBy(mesh->GetComponentTransform()).GetBox();
+		FLinearColor diffuse(FLinearColor::White);
+		if (entry.Appearance < mapping.Appearances.size())
+		{
+			auto& appearance = mapping.Appearances[entry.Appearance];
+			diffuse = FLinearColor(appearance.Diffuse[0], appearance.Diffuse[1], appearance.Diffuse[2], 1.0f - appearance.Transparency);
+			LocalTranslucency[i] = appearance.Transparency != 0;
+		}
 
-		INC_DWORD_STAT_BY(STAT_TotalTriangles, triangles.Num() / 3)
-		INC_DWORD_STAT_BY(STAT_TotalVertices, vertices.Num())
+		actor->DiffuseMap->SetParameter(globalIndex, diffuse);
 	}
 
-	if (isCompressed)
+	// Every time the parameters change we update all map components, not only the ones we explicitly know of,
+	// to ensure the materials are initialised to sensible values.
+	for (auto component : actor->GetComponents())
 	{
-		FMemory::Free((void*)buffer);
+		auto map = Cast<URepoSupermeshMapComponent>(component);
+		if (map) {
+			map->UpdateTexture();
+		}
 	}
 
-	buffer = nullptr;
+	// The asset holds its submeshes in the actor from here on, so that an update knows which it can remove
 
-	UE_LOG(LogTemp, Log, TEXT("Finished SRC %s"), *Uri);
-}
+	actor->AddImportedAsset(Uri, Offset, LocalToActorSubmeshMap);
 
-FVector RepoSrcAssetImporter::TransformCoordinateSystem(FVector v)
-{
-	auto tmp = v.Z;
-	v.Z = v.Y;
-	v.Y = -tmp;
-	v.X = -v.X;
-	return v;
+	INC_DWORD_STAT_BY(STAT_TotalObjects, numEntries)
+
+	return true;
 }
 
-void RepoSrcAssetImporter::TransformCoordinateSystem(TArray<FVector>& array) // from Unity to Unreal
+void RepoSrcAssetImporter::HandleSrc(RepoWebResponsePtr Result)
 {
-	for (int32 i = 0; i < array.Num(); i++)
+	// The decode task takes ownership of the local maps, as once the mapping has been handled they are only needed to build the vertex attributes and sections.
+	// Without a response, the task loads the cached geometry instead. The maps are copied then, as the SRC is decoded with them if the geometry cannot be loaded.
+
+	if (Result.IsValid())
 	{
-		auto tmp = array[i].Z;
-		array[i].Z = array[i].Y;
-		array[i].Y = -tmp;
-		array[i].X = -array[i].X;
+		DecodeTask = MakeShared<RepoSrcDecodeTask, ESPMode::ThreadSafe>(Uri, Result, MoveTemp(LocalToActorSubmeshMap), MoveTemp(LocalTranslucency));
 	}
-}
+	else
+	{
+		DecodeTask = MakeShared<RepoSrcDecodeTask, ESPMode::ThreadSafe>(Uri, Result, TArray<uint32>(LocalToActorSubmeshMap), TArray<uint8>(LocalTranslucency));
+	}
+	NumMeshesCreated = 0;
 
-void RepoSrcAssetImporter::GenerateSupermeshMapIndices(TArray<float>& ids, TArray<FVector2D>& uvs)
-{
-	uvs.SetNumUninitialized(ids.Num());
-	for (int32 i = 0; i < ids.Num(); i++)
+	auto cache = manager->GetCache();
+	if (bUseGeometryCache && cache.IsValid())
 	{
-		uvs[i].X = (float)ids[i];
-		uvs[i].Y = (float)LocalToActorSubmeshMap[ids[i]];
+		DecodeTask->SetGeometryCache(cache, GetGeometryCacheKey());
 	}
+
+	auto Task = DecodeTask; // local variable for closure capture
+	DecodeResult = Async(EAsyncExecution::TaskGraph, [Task]()
+	{
+		Task->DoWork();
+	});
 }
 
-void RepoSrcAssetImporter::GenerateTriangleIdMap(TArray<int>& triangles, TArray<float>& ids, TArray<int>& triangleIdMap)
+void RepoSrcAssetImporter::CreateMeshes(double Deadline)
 {
-	auto numTriangles = triangles.Num() / 3;
-	triangleIdMap.SetNumUninitialized(numTriangles);
-	for (int32 i = 0; i < numTriangles; i++)
+	check(IsInGameThread());
+
+	if (NumMeshesCreated == 0)
 	{
-		auto index0 = triangles[i * 3];
-		auto localId = ids[index0];
-		auto globalId = LocalToActorSubmeshMap[localId];
-		triangleIdMap[i] = globalId;
+		UE_LOG(LogTemp, Log, TEXT("Creating Procedural Meshes for %s."), *Uri);
 	}
-}
 
-#pragma optimize("", on)
+	// The task enqueues the meshes as it decodes them. Whether it has finished is checked before the queue is drained,
+	// so that a mesh enqueued in between cannot be missed.
 
-void RepoSrcAssetImporter::ResolveIndices(const FString& viewName, TArray<int32>& array)
-{
-	auto indexView = indexViews->GetObjectField(viewName);
+	bool bFinished = DecodeResult.IsReady();
 
-	auto viewOffset = indexView->GetIntegerField(TEXT("byteOffset"));
-	auto viewCount = indexView->GetIntegerField(TEXT("count"));
-	auto viewComponentType = indexView->GetIntegerField(TEXT("componentType"));
+	RepoSrcDecodedMesh decoded;
+	while (DecodeTask->Meshes.Dequeue(decoded))
+	{
+		CreateMesh(decoded);
+		decoded = RepoSrcDecodedMesh(); // Release the decoded buffers as we go
+		NumMeshesCreated++;
 
-	auto bufferView = bufferViews->GetObjectField(indexView->GetStringField(TEXT("bufferView")));
-	auto chunks = bufferView->GetArrayField(TEXT("chunks"));
+		if (FPlatformTime::Seconds() > Deadline)
+		{
+			bFinished = bFinished && DecodeTask->Meshes.IsEmpty();
+			break;
+		}
+	}
 
-	if (chunks.Num() != 1)
+	if (bFinished)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Recevied SRC with bufferView having %d Chunks. This version only supports one chunk per bufferView."), chunks.Num());
-		return;
-	}
+		auto bDecodeSucceeded = DecodeTask->bSucceeded;
+		auto bGeometryMissing = DecodeTask->bGeometryMissing;
+		Timeline.Append(DecodeTask->Timeline);
+		DecodeTask.Reset();
+		DecodeResult.Reset();
 
-	auto bufferChunk = bufferChunks->GetObjectField(chunks[0]->AsString());
+		if (bGeometryMissing)
+		{
+			UE_LOG(LogTemp, Log, TEXT("Cached geometry for %s is no longer available."), *Uri);
+			bGeometryCacheFailed = true;
+			bFromCache = false;
+			RequestSrc(SrcPriority);
+			return;
+		}
 
-	auto chunkOffset = bufferChunk->GetIntegerField(TEXT("byteOffset"));
-	auto chunkLength = bufferChunk->GetIntegerField(TEXT("byteLength"));
+		UE_LOG(LogTemp, Log, TEXT("Finished SRC %s (%d Procedural Meshes)"), *Uri, NumMeshesCreated);
 
-	if (viewOffset + (sizeof(uint16) * viewCount) != chunkLength)
-	{
-		UE_LOG(LogTemp, Error, TEXT("Buffer chunk length mismatch. Possible corruption."));
-		return;
-	}
+		bSucceeded = bDecodeSucceeded;
 
-	array.SetNumUninitialized(viewCount);
+		if (bDecodeSucceeded && actor.IsValid())
+		{
+			if (auto asset = actor->ImportedAssets.Find(Uri))
+			{
+				asset->bComplete = true;
+			}
+		}
 
-	auto data = (const uint16*)(buffer + chunkOffset + viewOffset);
-	for (int32 i = 0; i < viewCount; i++)
-	{
-		array[i] = data[i]; // use for loop here because we are casting uint16 to uint32
+		OnComplete.ExecuteIfBound();
 	}
 }
 
-template <typename T>
-void RepoSrcAssetImporter::ResolveAttribute(const FString& viewName, TArray<T>& array)
+void RepoSrcAssetImporter::CreateMesh(RepoSrcDecodedMesh& decoded)
 {
-	auto attributeView = attributeViews->GetObjectField(viewName);
+	SCOPE_CYCLE_COUNTER(STAT_GenerateMesh);
+	REPO_TRACE_STAGE(Timeline, CreatingMeshes);
 
-	auto viewOffset = attributeView->GetIntegerField(TEXT("byteOffset"));
-	auto viewStride = attributeView->GetIntegerField(TEXT("byteStride"));
-	auto viewComponentType = attributeView->GetIntegerField(TEXT("componentType"));
-	auto viewType = attributeView->GetStringField(TEXT("type"));
-	auto viewCount = attributeView->GetIntegerField(TEXT("count"));
+	if (Batcher.IsValid())
+	{
+		auto meshTransform = FTransform(Offset) * actor->GetActorTransform();
+		auto triangleIds = decoded.TriangleIdMap.GetData();
 
-	// Assume the offset and scale are identity.
+		for (auto& section : decoded.Sections)
+		{
+			INC_DWORD_STAT_BY(STAT_TotalTriangles, section.NumTriangles())
+			INC_DWORD_STAT_BY(STAT_TotalVertices, section.NumVertices())
+			NumTriangles += section.NumTriangles();
 
-	if (viewStride != sizeof(T))
-	{
-		UE_LOG(LogTemp, Error, TEXT("Attributes SRC byte stride does not match Array."));
-	}
+			Bounds += section.Geometry.SectionLocalBox.TransformBy(meshTransform);
 
-	auto bufferView = bufferViews->GetObjectField(attributeView->GetStringField(TEXT("bufferView")));
-	auto chunks = bufferView->GetArrayField(TEXT("chunks"));
+			// The triangle id map follows the sections, so each section's ids are the next run of it. Meshes without
+			// ids have an empty map, and their triangles are given INDEX_NONE.
 
-	if (chunks.Num() != 1)
-	{
-		UE_LOG(LogTemp, Error, TEXT("Recevied SRC with bufferView having %d Chunks. This version only supports one chunk per bufferView."), chunks.Num());
+			auto numTriangles = section.NumTriangles();
+			auto hasIds = decoded.TriangleIdMap.Num() > 0;
+			TArray<int> noIds;
+			if (!hasIds)
+			{
+				noIds.Init(INDEX_NONE, numTriangles);
+			}
+
+			Batcher->Add(Uri, Offset, section, hasIds ? triangleIds : noIds.GetData());
+
+			if (hasIds)
+			{
+				triangleIds += numTriangles;
+			}
+		}
 		return;
 	}
 
-	auto bufferChunk = bufferChunks->GetObjectField(chunks[0]->AsString());
+	auto mesh = actor->AddProceduralMesh();
+	mesh->SetRelativeLocation(Offset);
 
-	auto chunkOffset = bufferChunk->GetIntegerField(TEXT("byteOffset"));
-	auto chunkLength = bufferChunk->GetIntegerField(TEXT("byteLength"));
+	// Each section is drawn with the shared instance of the opaque or translucent material, so a mesh that
+	// contains only a few translucent submeshes does not have to sort and blend all of its triangles.
 
-	if (viewOffset + (viewStride * viewCount) != chunkLength)
+	for (int32 i = 0; i < decoded.Sections.Num(); i++)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Buffer chunk length mismatch. Possible corruption."));
-		return;
+		auto& section = decoded.Sections[i];
+
+		INC_DWORD_STAT_BY(STAT_TotalTriangles, section.NumTriangles())
+		INC_DWORD_STAT_BY(STAT_TotalVertices, section.NumVertices())
+		NumTriangles += section.NumTriangles();
+
+		section.MoveTo(mesh, i);
+
+		auto materialPrototype = section.bTranslucent ? materialTranslucent : materialOpaque;
+		if (materialPrototype)
+		{
+			REPO_TRACE_STAGE(Timeline, BindingMaterials);
+			mesh->SetMaterial(i, actor->GetSharedMaterial(materialPrototype, section.bTranslucent));
+		}
 	}
 
-	auto data = (buffer + chunkOffset + viewOffset);
-	array.SetNumUninitialized(viewCount);
-	memcpy(array.GetData(), data, chunkLength);
-}
\ No newline at end of file
+	{
+		REPO_TRACE_STAGE(Timeline, Collision);
+		mesh->SetCollisionProfileName(FName("IgnoreOnlyPawn"));
+	}
+
+	actor->MeshComponentTriangleMaps.Add(mesh, MoveTemp(decoded.TriangleIdMap));
+	actor->AddImportedAssetComponent(Uri, mesh);
+
+	Bounds += mesh->CalcLocalBounds().TransformBy(mesh->GetComponentTransform()).GetBox();
+}
+
+FString RepoSrcAssetImporter::GetGeometryCacheKey() const
+{
+	return manager->GetCacheKey(FString::Printf(TEXT("%s.src.geometry"), *Uri));
+}
+
+FVector RepoSrcAssetImporter::TransformCoordinateSystem(FVector v)
+{
+	auto tmp = v.Z;
+	v.Z = v.Y;
+	v.Y = -tmp;
+	v.X = -v.X;
+	return v;
+}
@@ -17,13 +17,14 @@
 
 #include "RepoSupermeshActor.h"
 #include "RepoSupermeshMapComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Components/PrimitiveComponent.h"
 #include <AssetRegistryModule.h>
 #if WITH_EDITOR 
 #include <AssetToolsModule.h>
 #include "Engine/StaticMesh.h"
 #include "PhysicsEngine/BodySetup.h"
 #include "PhysicsEngine/PhysicsSettings.h"
-#include "Materials/MaterialInstanceDynamic.h"
 #include "ProceduralMeshConversion.h"
 #include "RepoStaticSupermeshActor.h"
 #endif
@@ -39,6 +40,9 @@ ARepoSupermeshActor::ARepoSupermeshActor()
 
 	DiffuseMap = CreateDefaultSubobject<URepoSupermeshMapComponent>(FName("DiffuseMap"));
 	DiffuseMap->ParameterName = FName("DiffuseMap");
+
+	OpaqueMaterial = nullptr;
+	TranslucentMaterial = nullptr;
 }
 
 // Called when the game starts or when spawned
@@ -47,14 +51,26 @@ void ARepoSupermeshActor::BeginPlay()
 	Super::BeginPlay();
 }
 
+void ARepoSupermeshActor::PostLoad()
+{
+	Super::PostLoad();
+	RebuildSubmeshIndex();
+}
+
+#if WITH_EDITOR
+void ARepoSupermeshActor::PostEditUndo()
+{
+	Super::PostEditUndo();
+	RebuildSubmeshIndex(); // Undo restores IdMap without going through AddSubmeshId
+}
+#endif
+
 // Called every frame
 void ARepoSupermeshActor::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 }
 
-#pragma optimize("", off)
-
 UProceduralMeshComponent* ARepoSupermeshActor::AddProceduralMesh()
 {
 	auto component = NewObject<UProceduralMeshComponent>(this, UProceduralMeshComponent::StaticClass());
@@ -120,6 +136,8 @@ void ARepoSupermeshActor::ConvertToStaticHierarchy()
 		ManagedMaps.Add(component->ParameterName);
 	}
 
+	TSet<UMaterialInterface*> ConvertedMaterials;
+
 	for (auto ProcMeshComp : MeshComponents)
 	{
 		UE_LOG(LogTemp, Log, TEXT("Converting ProceduralMeshComponent %s"), *(ProcMeshComp->GetName()));
@@ -184,7 +202,11 @@ void ARepoSupermeshActor::ConvertToStaticHierarchy()
 			TSet<UMaterialInterface*> UniqueMaterials;
 			for (auto* Material : Materials)
 			{
-				UniqueMaterials.Add(Material);
+				if (!ConvertedMaterials.Contains(Material)) // Materials are shared between meshes, so are moved into the package of the first one only
+				{
+					UniqueMaterials.Add(Material);
+					ConvertedMaterials.Add(Material);
+				}
 			}
 
 			TSet<UTexture*> UniqueTextures;
@@ -283,6 +305,8 @@ void ARepoSupermeshActor::ConvertToStaticHierarchy()
 		component->UnregisterComponent();
 		component->DestroyComponent();
 	}
+
+	RebuildSubmeshIndex(); // The static actors resolve their face maps through IdMap, so make sure the index agrees with it
 }
 
 UTexture2D* ARepoSupermeshActor::ConvertToStaticTexture(UTexture2D* Texture, IAssetTools& AssetTools, UPackage* Package) 
@@ -341,30 +365,40 @@ UTexture2D* ARepoSupermeshActor::ConvertToStaticTexture(UTexture2D* Texture, IAs
 }
 #endif
 
-void ARepoSupermeshActor::SetMaterialsTextureParameter(FName ParameterName, UTexture* Value)
+UMaterialInstanceDynamic* ARepoSupermeshActor::GetSharedMaterial(UMaterialInterface* Prototype, bool bTranslucent)
 {
-	// Enumerate transient types
+	auto& Shared = bTranslucent ? TranslucentMaterial : OpaqueMaterial;
 
-	for (int32 i = 0; i < RootComponent->GetNumChildrenComponents(); i++)
+	if (!Shared || Shared->Parent != Prototype)
 	{
-		auto Mesh = Cast<UProceduralMeshComponent>(RootComponent->GetChildComponent(i));
-		if (Mesh)
+		Shared = UMaterialInstanceDynamic::Create(Prototype, this);
+
+		for (auto component : GetComponents())
 		{
-			const int32 NumSections = Mesh->GetNumSections();
-			for (int32 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
-			{
-				FProcMeshSection* ProcSection = Mesh->GetProcMeshSection(SectionIdx);
-				UMaterialInterface* Material = Mesh->GetMaterial(SectionIdx);
-				auto DynamicInstance = Cast<UMaterialInstanceDynamic>(Material);
-				if (DynamicInstance)
-				{
-					DynamicInstance->SetTextureParameterValue(ParameterName, Value);
-				}
+			auto map = Cast<URepoSupermeshMapComponent>(component);
+			if (map) {
+				map->ApplyTextureToMaterials(Shared);
 			}
 		}
 	}
 
-	// Enumerate static types
+	return Shared;
+}
+
+void ARepoSupermeshActor::SetMaterialsTextureParameter(FName ParameterName, UTexture* Value)
+{
+	// Meshes created by the importer all share these instances, before and after the conversion to a static hierarchy
+
+	if (OpaqueMaterial)
+	{
+		OpaqueMaterial->SetTextureParameterValue(ParameterName, Value);
+	}
+	if (TranslucentMaterial)
+	{
+		TranslucentMaterial->SetTextureParameterValue(ParameterName, Value);
+	}
+
+	// Enumerate static types, in case the hierarchy was baked before the instances were shared
 
 	for (int32 i = 0; i < Children.Num(); i++)
 	{
@@ -375,7 +409,7 @@ void ARepoSupermeshActor::SetMaterialsTextureParameter(FName ParameterName, UTex
 			for (auto Material : Mesh->GetMaterials())
 			{
 				auto DynamicMaterial = Cast<UMaterialInstanceDynamic>(Material);
-				if (DynamicMaterial)
+				if (DynamicMaterial && DynamicMaterial != OpaqueMaterial && DynamicMaterial != TranslucentMaterial)
 				{
 					DynamicMaterial->SetTextureParameterValue(ParameterName, Value);
 				}
@@ -384,17 +418,77 @@ void ARepoSupermeshActor::SetMaterialsTextureParameter(FName ParameterName, UTex
 	}
 }
 
-TArray<FString>& ARepoSupermeshActor::GetSubmeshMap()
+const TArray<FString>& ARepoSupermeshActor::GetSubmeshMap()
 {
 	return IdMap;
 }
 
+void ARepoSupermeshActor::RebuildSubmeshIndex()
+{
+	IdIndex.Reset();
+	IdIndex.Reserve(IdMap.Num());
+	FreeSubmeshIds.Reset();
+	for (int32 i = 0; i < IdMap.Num(); i++)
+	{
+		if (IdMap[i].IsEmpty())
+		{
+			FreeSubmeshIds.Add(i);
+		}
+		else
+		{
+			IdIndex.Add(IdMap[i], i);
+		}
+	}
+}
+
+int32 ARepoSupermeshActor::AddSubmeshId(const FString& Id)
+{
+	if (IdIndex.Num() + FreeSubmeshIds.Num() != IdMap.Num())
+	{
+		RebuildSubmeshIndex(); // The map was populated through another path, such as a duplication
+	}
+
+	if (auto Existing = IdIndex.Find(Id))
+	{
+		return *Existing;
+	}
+
+	int32 Index;
+	if (FreeSubmeshIds.Num() > 0)
+	{
+		Index = FreeSubmeshIds.Pop(false);
+		IdMap[Index] = Id;
+	}
+	else
+	{
+		Index = IdMap.Add(Id);
+	}
+	IdIndex.Add(Id, Index);
+	return Index;
+}
+
+int32 ARepoSupermeshActor::FindSubmeshId(const FString& Id)
+{
+	if (IdIndex.Num() + FreeSubmeshIds.Num() != IdMap.Num())
+	{
+		RebuildSubmeshIndex();
+	}
+
+	auto Existing = IdIndex.Find(Id);
+	return Existing ? *Existing : INDEX_NONE;
+}
+
 FString ARepoSupermeshActor::GetMeshIdFromFaceIndex(TWeakObjectPtr<class UPrimitiveComponent> Component, int32 FaceIndex)
 {
 	// Though the ARepoSupermeshActor exists above the static hierarchy too, we will only end up here from a ProceduralMeshComponent.
-	TArray<int>& faceToIdMap = *MeshComponentTriangleMaps.Find(Component.Get());
-	auto id = faceToIdMap[FaceIndex];
-	return IdMap[id];
+	// Faces of meshes that had no ids (which may have been merged with others) map to INDEX_NONE.
+	auto faceToIdMap = MeshComponentTriangleMaps.Find(Component.Get());
+	if (!faceToIdMap || !faceToIdMap->IsValidIndex(FaceIndex))
+	{
+		return FString();
+	}
+	auto id = (*faceToIdMap)[FaceIndex];
+	return IdMap.IsValidIndex(id) ? IdMap[id] : FString();
 }
 
 TWeakObjectPtr<ARepoSupermeshActor> ARepoSupermeshActor::GetActor()
@@ -402,4 +496,53 @@ TWeakObjectPtr<ARepoSupermeshActor> ARepoSupermeshActor::GetActor()
 	return TWeakObjectPtr<ARepoSupermeshActor>(this);
 }
 
-#pragma optimize("", on)
\ No newline at end of file
+void ARepoSupermeshActor::AddImportedAsset(const FString& Uri, const FVector& Offset, const TArray<uint32>& SubmeshIds)
+{
+	auto& Asset = ImportedAssets.FindOrAdd(Uri);
+	Asset.Offset = Offset;
+	Asset.SubmeshIds.Append(SubmeshIds);
+
+	if (SubmeshReferences.Num() < IdMap.Num())
+	{
+		SubmeshReferences.SetNumZeroed(IdMap.Num());
+	}
+	for (auto Id : SubmeshIds)
+	{
+		SubmeshReferences[Id]++;
+	}
+}
+
+void ARepoSupermeshActor::AddImportedAssetComponent(const FString& Uri, UPrimitiveComponent* Component)
+{
+	if (auto Asset = ImportedAssets.Find(Uri))
+	{
+		Asset->Components.AddUnique(Component);
+	}
+}
+
+void ARepoSupermeshActor::ReleaseImportedAsset(RepoImportedAsset& Asset)
+{
+	for (auto& Component : Asset.Components)
+	{
+		if (Component.IsValid())
+		{
+			MeshComponentTriangleMaps.Remove(Component.Get());
+			Component->DestroyComponent();
+		}
+	}
+	Asset.Components.Reset();
+
+	// Existing geometry holds indices into the IdMap, so it cannot be compacted. Instead the entries that are no
+	// longer referenced are emptied, and handed out again by AddSubmeshId().
+
+	for (auto Id : Asset.SubmeshIds)
+	{
+		if (SubmeshReferences.IsValidIndex(Id) && --SubmeshReferences[Id] == 0)
+		{
+			IdIndex.Remove(IdMap[Id]);
+			IdMap[Id].Empty();
+			FreeSubmeshIds.Add(Id);
+		}
+	}
+	Asset.SubmeshIds.Reset();
+}
@@ -69,23 +69,44 @@ int URepoSupermeshMapComponent::GetSupermeshMapSize()
 	return FMath::CeilToFloat(FMath::Sqrt(Parameters.Num()));
 }
 
-#pragma optimize("", off)
+void URepoSupermeshMapComponent::UpdateNumParameters()
+{
+	auto NumIds = GetActor()->GetSubmeshMap().Num();
+	if (Parameters.Num() != NumIds)
+	{
+		Parameters.SetNum(NumIds);
+	}
+}
 
 void URepoSupermeshMapComponent::SetParameter(int Id, FVector4 Value)
 {
-	Parameters.SetNum(GetActor()->GetSubmeshMap().Num());
+	UpdateNumParameters();
+	if (!Parameters.IsValidIndex(Id))
+	{
+		return;
+	}
 	Parameters[Id] = Value;
+	DirtyIds.Add(Id);
 	IsMapDirty = true;
 }
 
 void URepoSupermeshMapComponent::SetParameter(FString& Id, FVector4 Value)
 {
-	SetParameter(GetActor()->GetSubmeshMap().Find(Id), Value);
+	auto Index = GetActor()->FindSubmeshId(Id);
+	if (Index != INDEX_NONE)
+	{
+		SetParameter(Index, Value);
+	}
 }
 
 FVector4 URepoSupermeshMapComponent::GetParameter(FString& Id)
 {
-	return GetParameter(GetActor()->GetSubmeshMap().Find(Id));
+	auto Index = GetActor()->FindSubmeshId(Id);
+	if (Index == INDEX_NONE)
+	{
+		return FVector4(0, 0, 0, 0);
+	}
+	return GetParameter(Index);
 }
 
 FVector4 URepoSupermeshMapComponent::GetParameter(int Id)
@@ -97,7 +118,106 @@ FVector4 URepoSupermeshMapComponent::GetParameter(int Id)
 	return Parameters[Id];
 }
 
-#pragma optimize("", on)
+void URepoSupermeshMapComponent::SetParameters(const TArray<int32>& Ids, const TArray<FVector4>& Values)
+{
+	if (Ids.Num() != Values.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SetParameters was given %d Ids but %d Values. Only the first %d will be set."), Ids.Num(), Values.Num(), FMath::Min(Ids.Num(), Values.Num()));
+	}
+
+	UpdateNumParameters();
+
+	const int32 Num = FMath::Min(Ids.Num(), Values.Num());
+	DirtyIds.Reserve(DirtyIds.Num() + Num);
+	for (int32 i = 0; i < Num; i++)
+	{
+		if (Parameters.IsValidIndex(Ids[i]))
+		{
+			Parameters[Ids[i]] = Values[i];
+			DirtyIds.Add(Ids[i]);
+		}
+	}
+
+	IsMapDirty = true;
+}
+
+void URepoSupermeshMapComponent::SetParameters(const TArray<FString>& Ids, const TArray<FVector4>& Values)
+{
+	auto Actor = GetActor();
+
+	TArray<int32> Indices;
+	Indices.SetNumUninitialized(Ids.Num());
+	for (int32 i = 0; i < Ids.Num(); i++)
+	{
+		Indices[i] = Actor->FindSubmeshId(Ids[i]);
+	}
+
+	SetParameters(Indices, Values);
+}
+
+void URepoSupermeshMapComponent::SetParameters(const TArray<int32>& Ids, FVector4 Value)
+{
+	UpdateNumParameters();
+
+	DirtyIds.Reserve(DirtyIds.Num() + Ids.Num());
+	for (auto Id : Ids)
+	{
+		if (Parameters.IsValidIndex(Id))
+		{
+			Parameters[Id] = Value;
+			DirtyIds.Add(Id);
+		}
+	}
+
+	IsMapDirty = true;
+}
+
+void URepoSupermeshMapComponent::SetParameters(const TArray<FString>& Ids, FVector4 Value)
+{
+	auto Actor = GetActor();
+
+	TArray<int32> Indices;
+	Indices.SetNumUninitialized(Ids.Num());
+	for (int32 i = 0; i < Ids.Num(); i++)
+	{
+		Indices[i] = Actor->FindSubmeshId(Ids[i]);
+	}
+
+	SetParameters(Indices, Value);
+}
+
+// FVector4 is not a Blueprint type, so the Blueprint versions take colours
+
+static TArray<FVector4> ToParameters(const TArray<FLinearColor>& Values)
+{
+	TArray<FVector4> Parameters;
+	Parameters.SetNumUninitialized(Values.Num());
+	for (int32 i = 0; i < Values.Num(); i++)
+	{
+		Parameters[i] = FVector4(Values[i]);
+	}
+	return Parameters;
+}
+
+void URepoSupermeshMapComponent::SetParametersByIndex(const TArray<int32>& Indices, const TArray<FLinearColor>& Values)
+{
+	SetParameters(Indices, ToParameters(Values));
+}
+
+void URepoSupermeshMapComponent::SetParametersById(const TArray<FString>& Ids, const TArray<FLinearColor>& Values)
+{
+	SetParameters(Ids, ToParameters(Values));
+}
+
+void URepoSupermeshMapComponent::SetParameterForIndices(const TArray<int32>& Indices, FLinearColor Value)
+{
+	SetParameters(Indices, FVector4(Value));
+}
+
+void URepoSupermeshMapComponent::SetParameterForIds(const TArray<FString>& Ids, FLinearColor Value)
+{
+	SetParameters(Ids, FVector4(Value));
+}
 
 void URepoSupermeshMapComponent::CreateTexture()
 {
@@ -115,6 +235,11 @@ void URepoSupermeshMapComponent::CreateTexture()
 	Texture = Map;
 }
 
+static uint32 PackParameter(const FVector4& Parameter)
+{
+	return FLinearColor(Parameter).ToFColor(true).ToPackedARGB(); // This line is heavily dependent on the format and layout. Its inverse must match the IdToPixel method.
+}
+
 void URepoSupermeshMapComponent::UpdateTexture()
 {
 	// Check the texture matches the number of parameters, otherwise it may be uninitialised
@@ -127,15 +252,17 @@ void URepoSupermeshMapComponent::UpdateTexture()
 		recreatedTexture = true;
 	}
 
-	auto MapData = (int32*)Texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
-
-	for (int32 i = 0; i < Parameters.Num(); i++)
+	if (recreatedTexture || !Texture->Resource)
+	{
+		WriteAllTexels();
+		Texture->UpdateResource();
+	}
+	else
 	{
-		MapData[i] = FLinearColor(Parameters[i]).ToFColor(true).ToPackedARGB(); // This line is heavily dependent on the format and layout. Its inverse must match the IdToPixel method.
+		UploadDirtyTexels();
 	}
 
-	Texture->PlatformData->Mips[0].BulkData.Unlock();
-	Texture->UpdateResource();
+	DirtyIds.Reset();
 
 	if (recreatedTexture)
 	{
@@ -145,6 +272,92 @@ void URepoSupermeshMapComponent::UpdateTexture()
 	IsMapDirty = false;
 }
 
+void URepoSupermeshMapComponent::WriteAllTexels()
+{
+	auto MapData = (uint32*)Texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
+
+	for (int32 i = 0; i < Parameters.Num(); i++)
+	{
+		MapData[i] = PackParameter(Parameters[i]);
+	}
+
+	Texture->PlatformData->Mips[0].BulkData.Unlock();
+}
+
+void URepoSupermeshMapComponent::UploadDirtyTexels()
+{
+	if (!DirtyIds.Num())
+	{
+		return;
+	}
+
+	// Each row of the map that contains changed parameters is uploaded as one region, spanning from the first to the
+	// last changed texel in that row. The bulk data is kept up to date too, as it is what the static conversion saves.
+
+	const int32 Width = Texture->GetSizeX();
+
+	auto Ids = DirtyIds.Array();
+	Ids.Sort();
+
+	TArray<FIntVector> Spans; // (Row, First Column, Last Column)
+	int32 MaxSpanWidth = 0;
+	for (auto Id : Ids)
+	{
+		if (Id < 0 || Id >= Parameters.Num())
+		{
+			continue;
+		}
+		const int32 Row = Id / Width;
+		const int32 Column = Id % Width;
+		if (Spans.Num() && Spans.Last().X == Row)
+		{
+			Spans.Last().Z = Column;
+		}
+		else
+		{
+			Spans.Add(FIntVector(Row, Column, Column));
+		}
+		MaxSpanWidth = FMath::Max(MaxSpanWidth, Spans.Last().Z - Spans.Last().Y + 1);
+	}
+
+	if (!Spans.Num())
+	{
+		return;
+	}
+
+	// The source data and regions are read on the render thread, so they are handed over to it and freed by the cleanup function
+
+	const uint32 Pitch = MaxSpanWidth * sizeof(uint32);
+	auto Source = (uint8*)FMemory::Malloc(Pitch * Spans.Num());
+	auto Regions = new FUpdateTextureRegion2D[Spans.Num()];
+
+	auto MapData = (uint32*)Texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
+
+	for (int32 i = 0; i < Spans.Num(); i++)
+	{
+		const auto& Span = Spans[i];
+		const int32 SpanWidth = Span.Z - Span.Y + 1;
+		const int32 First = Span.X * Width + Span.Y;
+
+		for (int32 j = 0; j < SpanWidth && First + j < Parameters.Num(); j++)
+		{
+			MapData[First + j] = PackParameter(Parameters[First + j]);
+		}
+		FMemory::Memcpy(Source + Pitch * i, MapData + First, SpanWidth * sizeof(uint32));
+
+		Regions[i] = FUpdateTextureRegion2D(Span.Y, Span.X, 0, i, SpanWidth, 1);
+	}
+
+	Texture->PlatformData->Mips[0].BulkData.Unlock();
+
+	Texture->UpdateTextureRegions(0, Spans.Num(), Regions, Pitch, sizeof(uint32), Source,
+		[](uint8* SrcData, const FUpdateTextureRegion2D* SrcRegions)
+		{
+			FMemory::Free(SrcData);
+			delete[] SrcRegions;
+		});
+}
+
 #if WITH_EDITOR 
 void URepoSupermeshMapComponent::ConvertToStaticTexture(IAssetTools& AssetTools, UPackage* Package)
 {
@@ -0,0 +1,151 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RepoTrace.h"
+#include "Misc/FileHelper.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+#include "Serialization/JsonWriter.h"
+
+CSV_DEFINE_CATEGORY_MODULE(REPO3D_API, Repo3d, true);
+
+void RepoAssetTimeline::Add(RepoAssetStage Stage, double Start, double End)
+{
+	if (End <= 0 || End < Start)
+	{
+		return; // The stage was not reached, e.g. a response that did not come from the network has no first byte
+	}
+
+	auto& span = Spans[(int32)Stage];
+	span.Start = span.IsValid() ? FMath::Min(span.Start, Start) : Start;
+	span.End = FMath::Max(span.End, End);
+	span.Seconds += End - Start;
+}
+
+void RepoAssetTimeline::Append(const RepoAssetTimeline& Other)
+{
+	for (int32 i = 0; i < (int32)RepoAssetStage::Num; i++)
+	{
+		auto& other = Other.Spans[i];
+		if (other.IsValid())
+		{
+			auto& span = Spans[i];
+			span.Start = span.IsValid() ? FMath::Min(span.Start, other.Start) : other.Start;
+			span.End = FMath::Max(span.End, other.End);
+			span.Seconds += other.Seconds;
+		}
+	}
+}
+
+double RepoAssetTimeline::GetStart() const
+{
+	double start = 0;
+	for (auto& span : Spans)
+	{
+		if (span.IsValid() && (start == 0 || span.Start < start))
+		{
+			start = span.Start;
+		}
+	}
+	return start;
+}
+
+double RepoAssetTimeline::GetEnd() const
+{
+	double end = 0;
+	for (auto& span : Spans)
+	{
+		end = FMath::Max(end, span.End);
+	}
+	return end;
+}
+
+const TCHAR* RepoAssetTimeline::GetStageName(RepoAssetStage Stage)
+{
+	static const TCHAR* Names[] = {
+		TEXT("Mapping"),
+		TEXT("Queued"),
+		TEXT("Waiting"),
+		TEXT("Downloading"),
+		TEXT("LoadingGeometry"),
+		TEXT("ParsingHeader"),
+		TEXT("Inflating"),
+		TEXT("Resolving"),
+		TEXT("CreatingMeshes"),
+		TEXT("BindingMaterials"),
+		TEXT("Collision")
+	};
+	static_assert(UE_ARRAY_COUNT(Names) == (int32)RepoAssetStage::Num, "Every stage must have a name");
+	return Names[(int32)Stage];
+}
+
+void RepoImportTimeline::Add(const FString& Uri, const RepoAssetTimeline& Timeline, Outcome Result, bool bFromCache, int64 Bytes, int64 Triangles)
+{
+	Entries.Add({ Uri, Timeline, Result, bFromCache, Bytes, Triangles });
+}
+
+bool RepoImportTimeline::Write(const FString& Filename, double StartTime, double FinishTime) const
+{
+	TArray<const Entry*> sorted;
+	for (auto& entry : Entries)
+	{
+		sorted.Add(&entry);
+	}
+	sorted.Sort([](const Entry& A, const Entry& B)
+	{
+		return A.Timeline.GetEnd() - A.Timeline.GetStart() > B.Timeline.GetEnd() - B.Timeline.GetStart();
+	});
+
+	static const TCHAR* Outcomes[] = { TEXT("Uploaded"), TEXT("Failed"), TEXT("Cancelled") };
+
+	FString json;
+	auto writer = TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&json);
+	writer->WriteObjectStart();
+	writer->WriteValue(TEXT("seconds"), FinishTime - StartTime);
+	writer->WriteArrayStart(TEXT("assets"));
+	for (auto entry : sorted)
+	{
+		writer->WriteObjectStart();
+		writer->WriteValue(TEXT("uri"), entry->Uri);
+		writer->WriteValue(TEXT("outcome"), FString(Outcomes[(int32)entry->Result]));
+		writer->WriteValue(TEXT("cached"), entry->bFromCache);
+		writer->WriteValue(TEXT("bytes"), entry->Bytes);
+		writer->WriteValue(TEXT("triangles"), entry->Triangles);
+		writer->WriteValue(TEXT("start"), entry->Timeline.GetStart() - StartTime);
+		writer->WriteValue(TEXT("end"), entry->Timeline.GetEnd() - StartTime);
+		writer->WriteObjectStart(TEXT("stages"));
+		for (int32 i = 0; i < (int32)RepoAssetStage::Num; i++)
+		{
+			auto stage = (RepoAssetStage)i;
+			auto& span = entry->Timeline.Get(stage);
+			if (span.IsValid())
+			{
+				writer->WriteObjectStart(FString(RepoAssetTimeline::GetStageName(stage)));
+				writer->WriteValue(TEXT("start"), span.Start - StartTime);
+				writer->WriteValue(TEXT("end"), span.End - StartTime);
+				writer->WriteValue(TEXT("seconds"), span.Seconds);
+				writer->WriteObjectEnd();
+			}
+		}
+		writer->WriteObjectEnd();
+		writer->WriteObjectEnd();
+	}
+	writer->WriteArrayEnd();
+	writer->WriteObjectEnd();
+	writer->Close();
+
+	return FFileHelper::SaveStringToFile(json, *Filename, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+}
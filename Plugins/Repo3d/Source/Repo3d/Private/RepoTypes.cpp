@@ -26,4 +26,79 @@ Version Version::Parse(const FString& versionString)
 		FDefaultValueHelper::ParseInt(elements[2], Version.Revision);
 	}
 	return Version;
-}
\ No newline at end of file
+}
+
+RepoView::RepoView() :
+	Location(ForceInit),
+	Direction(FVector::ForwardVector),
+	HalfFov(PI / 4),
+	bValid(false)
+{
+}
+
+RepoView::RepoView(const FVector& InLocation, const FRotator& Rotation, float FovDegrees) :
+	Location(InLocation),
+	Direction(Rotation.Vector()),
+	HalfFov(FMath::DegreesToRadians(FMath::Clamp(FovDegrees, 1.0f, 179.0f)) * 0.5f),
+	bValid(true)
+{
+}
+
+float RepoView::EstimateCoverage(const FBox& Bounds) const
+{
+	if (!bValid || !Bounds.IsValid)
+	{
+		return 0;
+	}
+
+	// The bounds are treated as a sphere, whose projected area is compared to that of the view cone
+
+	FVector Centre, Extent;
+	Bounds.GetCenterAndExtents(Centre, Extent);
+	auto Radius = Extent.Size();
+	auto ToCentre = Centre - Location;
+	auto Distance = ToCentre.Size();
+
+	if (Distance <= Radius)
+	{
+		return 1; // The view is inside the bounds
+	}
+
+	auto AngularRadius = FMath::Asin(Radius / Distance);
+	auto Coverage = FMath::Min(FMath::Square(FMath::Tan(AngularRadius) / FMath::Tan(HalfFov)), 1.0f);
+
+	// The frustum is approximated by a cone wide enough to contain the corners of a 16:9 screen
+
+	auto Angle = FMath::Acos(FMath::Clamp(FVector::DotProduct(Direction, ToCentre / Distance), -1.0f, 1.0f));
+	if (Angle - AngularRadius > HalfFov * 1.15f)
+	{
+		Coverage *= 0.01f;
+	}
+
+	return Coverage;
+}
+
+int32 RepoView::GetPriority(const FBox& Bounds) const
+{
+	return (int32)(EstimateCoverage(Bounds) * 1000000); // Parts per million of the screen
+}
+
+bool RepoView::Equals(const RepoView& Other) const
+{
+	return bValid == Other.bValid && Location.Equals(Other.Location) && Direction.Equals(Other.Direction) && FMath::IsNearlyEqual(HalfFov, Other.HalfFov);
+}
+
+float RepoImportProgress::GetFraction() const
+{
+	return NumAssets > 0 ? (float)(NumUploaded + NumFailed) / NumAssets : 0.0f;
+}
+
+double RepoImportProgress::GetEstimatedSecondsRemaining() const
+{
+	auto NumFinished = NumUploaded + NumFailed;
+	if (NumFinished <= 0)
+	{
+		return -1.0;
+	}
+	return ElapsedSeconds / NumFinished * (NumAssets - NumFinished);
+}
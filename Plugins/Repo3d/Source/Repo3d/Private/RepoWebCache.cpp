@@ -0,0 +1,344 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RepoWebCache.h"
+#include "Repo3d.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+#include "Serialization/Archive.h"
+
+DECLARE_MEMORY_STAT(TEXT("Cache Size"), STAT_CacheSize, STATGROUP_Repo3D);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Cache Hits"), STAT_CacheHits, STATGROUP_Repo3D);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Cache Misses"), STAT_CacheMisses, STATGROUP_Repo3D);
+
+// Each file begins with this header, followed by the key, the SHA1 of the content, the content size, then the content itself.
+static const uint32 CacheFileMagic = 0x43443352; // "R3DC"
+static const uint32 CacheFileVersion = 1;
+
+RepoWebCache::RepoWebCache(const FString& InDirectory, int64 InMaxSize) :
+	TotalSize(0),
+	MaxSize(InMaxSize),
+	bScanned(false),
+	Directory(InDirectory)
+{
+}
+
+void RepoWebCache::SetMaxSize(int64 Size)
+{
+	FScopeLock ScopeLock(&Lock);
+	MaxSize = Size;
+	if (bScanned)
+	{
+		Evict();
+	}
+}
+
+FString RepoWebCache::GetFilename(const FString& Key) const
+{
+	FTCHARToUTF8 Utf8(*Key);
+	uint8 Hash[FSHA1::DigestSize];
+	FSHA1::HashBuffer(Utf8.Get(), Utf8.Length(), Hash);
+	return BytesToHex(Hash, FSHA1::DigestSize) + TEXT(".bin");
+}
+
+bool RepoWebCache::Read(const FString& Key, TArray<uint8>& Content)
+{
+	auto Filename = GetFilename(Key);
+	auto Path = FPaths::Combine(Directory, Filename);
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		Scan();
+		if (!Entries.Contains(Filename))
+		{
+			INC_DWORD_STAT(STAT_CacheMisses);
+			return false;
+		}
+	}
+
+	bool bValid = false;
+
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*Path, FILEREAD_Silent));
+	if (Reader)
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		uint32 KeyLength = 0;
+		*Reader << Magic;
+		*Reader << Version;
+		*Reader << KeyLength;
+
+		if (Magic == CacheFileMagic && Version == CacheFileVersion && KeyLength < (uint32)Reader->TotalSize())
+		{
+			TArray<uint8> StoredKey;
+			StoredKey.SetNumUninitialized(KeyLength);
+			Reader->Serialize(StoredKey.GetData(), KeyLength);
+
+			uint8 StoredHash[FSHA1::DigestSize];
+			Reader->Serialize(StoredHash, FSHA1::DigestSize);
+
+			uint64 ContentSize = 0;
+			*Reader << ContentSize;
+
+			FTCHARToUTF8 Utf8(*Key);
+			if (!Reader->IsError() &&
+				KeyLength == Utf8.Length() &&
+				FMemory::Memcmp(StoredKey.GetData(), Utf8.Get(), KeyLength) == 0 &&
+				Reader->Tell() + (int64)ContentSize == Reader->TotalSize())
+			{
+				Content.SetNumUninitialized(ContentSize);
+				Reader->Serialize(Content.GetData(), ContentSize);
+
+				uint8 Hash[FSHA1::DigestSize];
+				FSHA1::HashBuffer(Content.GetData(), Content.Num(), Hash);
+
+				bValid = !Reader->IsError() && FMemory::Memcmp(Hash, StoredHash, FSHA1::DigestSize) == 0;
+			}
+		}
+
+		Reader->Close();
+	}
+
+	FScopeLock ScopeLock(&Lock);
+
+	if (!bValid)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Cache entry for %s is corrupt and will be removed."), *Key);
+		Content.Empty();
+		Remove(Filename);
+		INC_DWORD_STAT(STAT_CacheMisses);
+		return false;
+	}
+
+	Touch(Filename);
+
+	INC_DWORD_STAT(STAT_CacheHits);
+	return true;
+}
+
+TSharedPtr<RepoMappedCacheEntry, ESPMode::ThreadSafe> RepoWebCache::OpenMapped(const FString& Key)
+{
+	auto Filename = GetFilename(Key);
+	auto Path = FPaths::Combine(Directory, Filename);
+
+	if (!Contains(Key))
+	{
+		INC_DWORD_STAT(STAT_CacheMisses);
+		return nullptr;
+	}
+
+	auto Entry = MakeShared<RepoMappedCacheEntry, ESPMode::ThreadSafe>();
+
+	Entry->Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+	if (Entry->Handle && Entry->Handle->GetFileSize() > 0)
+	{
+		Entry->Region.Reset(Entry->Handle->MapRegion(0, Entry->Handle->GetFileSize()));
+	}
+
+	if (!Entry->Region)
+	{
+		Entry->Handle.Reset();
+		if (!FFileHelper::LoadFileToArray(Entry->Content, *Path, FILEREAD_Silent))
+		{
+			FScopeLock ScopeLock(&Lock);
+			Remove(Filename);
+			INC_DWORD_STAT(STAT_CacheMisses);
+			return nullptr;
+		}
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	Touch(Filename);
+
+	INC_DWORD_STAT(STAT_CacheHits);
+	return Entry;
+}
+
+bool RepoWebCache::Contains(const FString& Key)
+{
+	FScopeLock ScopeLock(&Lock);
+	Scan();
+	return Entries.Contains(GetFilename(Key));
+}
+
+void RepoWebCache::Invalidate(const FString& Key)
+{
+	FScopeLock ScopeLock(&Lock);
+	Remove(GetFilename(Key));
+}
+
+void RepoWebCache::Write(const FString& Key, const TArray<uint8>& Content)
+{
+	uint8 Hash[FSHA1::DigestSize];
+	FSHA1::HashBuffer(Content.GetData(), Content.Num(), Hash);
+
+	Store(Key, [&](FArchive& Writer)
+	{
+		FTCHARToUTF8 Utf8(*Key);
+		uint32 Magic = CacheFileMagic;
+		uint32 Version = CacheFileVersion;
+		uint32 KeyLength = Utf8.Length();
+		uint64 ContentSize = Content.Num();
+
+		Writer << Magic;
+		Writer << Version;
+		Writer << KeyLength;
+		Writer.Serialize((void*)Utf8.Get(), KeyLength);
+		Writer.Serialize(Hash, FSHA1::DigestSize);
+		Writer << ContentSize;
+		Writer.Serialize((void*)Content.GetData(), Content.Num());
+	});
+}
+
+void RepoWebCache::WriteRaw(const FString& Key, const TArray<uint8>& Content)
+{
+	Store(Key, [&](FArchive& Writer)
+	{
+		Writer.Serialize((void*)Content.GetData(), Content.Num());
+	});
+}
+
+void RepoWebCache::Store(const FString& Key, TFunctionRef<void(FArchive& Writer)> Serialize)
+{
+	auto Filename = GetFilename(Key);
+	auto Path = FPaths::Combine(Directory, Filename);
+	auto TempPath = FPaths::Combine(Directory, FGuid::NewGuid().ToString() + TEXT(".tmp")); // Write to a temporary file first so readers never see partial entries
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		Scan(); // Scan before creating the temporary file, as the scan removes any it finds
+	}
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*TempPath, FILEWRITE_Silent));
+	if (!Writer)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Unable to write cache entry %s."), *TempPath);
+		return;
+	}
+
+	Serialize(*Writer);
+
+	int64 FileSize = Writer->Tell();
+	bool bSucceeded = Writer->Close();
+	Writer.Reset();
+
+	if (!bSucceeded || !IFileManager::Get().Move(*Path, *TempPath, true, true, false, true))
+	{
+		IFileManager::Get().Delete(*TempPath, false, false, true);
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+
+	if (auto Existing = Entries.Find(Filename))
+	{
+		TotalSize -= Existing->Size;
+	}
+
+	Entry Added;
+	Added.Size = FileSize;
+	Added.LastAccess = FDateTime::UtcNow();
+	Entries.Add(Filename, Added);
+	TotalSize += FileSize;
+
+	Evict();
+}
+
+void RepoWebCache::Scan()
+{
+	if (bScanned)
+	{
+		return;
+	}
+	bScanned = true;
+
+	IFileManager::Get().MakeDirectory(*Directory, true);
+
+	FPlatformFileManager::Get().GetPlatformFile().IterateDirectoryStat(*Directory,
+		[this](const TCHAR* Path, const FFileStatData& Stat)
+		{
+			if (!Stat.bIsDirectory)
+			{
+				auto Filename = FPaths::GetCleanFilename(Path);
+				if (Filename.EndsWith(TEXT(".tmp"))) // Left over from an interrupted write
+				{
+					IFileManager::Get().Delete(Path, false, false, true);
+				}
+				else
+				{
+					Entry Found;
+					Found.Size = Stat.FileSize;
+					Found.LastAccess = Stat.ModificationTime;
+					Entries.Add(Filename, Found);
+					TotalSize += Stat.FileSize;
+				}
+			}
+			return true;
+		});
+
+	UE_LOG(LogTemp, Log, TEXT("3D Repo cache %s contains %d entries (%lld bytes)."), *Directory, Entries.Num(), TotalSize);
+
+	Evict();
+}
+
+void RepoWebCache::Evict()
+{
+	if (TotalSize > MaxSize)
+	{
+		// Evict down to below the cap, so that we are not evicting on every write once the cache is full
+
+		auto Target = MaxSize - MaxSize / 10;
+
+		TArray<FString> Filenames;
+		Entries.GenerateKeyArray(Filenames);
+		Filenames.Sort([this](const FString& A, const FString& B)
+		{
+			return Entries[A].LastAccess < Entries[B].LastAccess;
+		});
+
+		for (int32 i = 0; i < Filenames.Num() && TotalSize > Target; i++)
+		{
+			Remove(Filenames[i]);
+		}
+	}
+
+	SET_MEMORY_STAT(STAT_CacheSize, TotalSize);
+}
+
+void RepoWebCache::Touch(const FString& Filename)
+{
+	auto Now = FDateTime::UtcNow();
+	if (auto Existing = Entries.Find(Filename))
+	{
+		Existing->LastAccess = Now;
+	}
+	IFileManager::Get().SetTimeStamp(*FPaths::Combine(Directory, Filename), Now); // The timestamp is the access time when the cache is scanned in the next session
+}
+
+void RepoWebCache::Remove(const FString& Filename)
+{
+	IFileManager::Get().Delete(*FPaths::Combine(Directory, Filename), false, false, true);
+	if (auto Existing = Entries.Find(Filename))
+	{
+		TotalSize -= Existing->Size;
+		Entries.Remove(Filename);
+	}
+}
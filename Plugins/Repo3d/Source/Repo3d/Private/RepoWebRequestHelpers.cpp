@@ -8,9 +8,9 @@ void RepoWebRequestHelpers::GetModelSettings(TSharedRef<RepoWebRequestManager> m
 	manager->GetRequest(
 		FString::Printf(TEXT("%s/%s.json"), *teamspace, *model),
 		RepoWebRequestDelegate::CreateLambda(
-			[callback](TSharedPtr<RepoWebResponse> Result) {
+			[callback](RepoWebResponsePtr Result) {
 				if (Result->bWasSuccessful) {
-					auto string = Result->Response->GetContentAsString();
+					auto string = Result->GetContentAsString();
 					auto reader = TJsonReaderFactory<TCHAR>::Create(string);
 					TSharedPtr<FJsonObject> jsonResponse = MakeShareable(new FJsonObject());
 					FJsonSerializer::Deserialize(reader, jsonResponse);
@@ -45,10 +45,10 @@ void RepoWebRequestHelpers::GetApplicationVersion(TSharedRef<class RepoWebReques
 	RepoWebRequest Request;
 	Request.uri = TEXT("version");
 	Request.callback = RepoWebRequestDelegate::CreateLambda(
-			[callback](TSharedPtr<RepoWebResponse> Result) {
+			[callback](RepoWebResponsePtr Result) {
 				if (Result->bWasSuccessful)
 				{
-					auto string = Result->Response->GetContentAsString();
+					auto string = Result->GetContentAsString();
 					auto reader = TJsonReaderFactory<TCHAR>::Create(string);
 					TSharedPtr<FJsonObject> jsonResponse = MakeShareable(new FJsonObject());
 					FJsonSerializer::Deserialize(reader, jsonResponse);
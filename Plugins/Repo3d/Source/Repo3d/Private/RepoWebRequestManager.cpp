@@ -19,15 +19,94 @@
 #include "Repo3d.h"
 #include "RepoTypes.h"
 #include "RepoWebRequestHelpers.h"
+#include "RepoTrace.h"
+#include "Async/Async.h"
 
 DECLARE_MEMORY_STAT(TEXT("Downloaded"), STAT_Downloaded, STATGROUP_Repo3D);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Queued Requests"), STAT_QueuedRequests, STATGROUP_Repo3D);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("In-Flight Requests"), STAT_InFlightRequests, STATGROUP_Repo3D);
+
+struct RepoWebRequestPriority
+{
+	bool operator()(const RepoWebRequest& A, const RepoWebRequest& B) const
+	{
+		if (A.priority != B.priority)
+		{
+			return A.priority > B.priority;
+		}
+		return A.sequence < B.sequence;
+	}
+};
+
+int32 RepoWebResponse::GetResponseCode() const
+{
+	if (bFromCache)
+	{
+		return 200;
+	}
+	return Response.IsValid() ? Response->GetResponseCode() : 0;
+}
+
+const TArray<uint8>& RepoWebResponse::GetContent() const
+{
+	if (bFromCache || !Response.IsValid())
+	{
+		return CachedContent;
+	}
+	return Response->GetContent();
+}
+
+FString RepoWebResponse::GetContentAsString() const
+{
+	if (bFromCache || !Response.IsValid())
+	{
+		FUTF8ToTCHAR Converted((const ANSICHAR*)CachedContent.GetData(), CachedContent.Num());
+		return FString(Converted.Length(), Converted.Get());
+	}
+	return Response->GetContentAsString();
+}
+
+FString RepoWebResponse::GetURL() const
+{
+	if (Request.IsValid())
+	{
+		return Request->GetURL();
+	}
+	return Uri;
+}
+
+void RepoWebRequestManager::SetCache(FString directory, int64 maxSizeBytes)
+{
+	if (directory.IsEmpty())
+	{
+		Cache.Reset();
+	}
+	else if (Cache.IsValid() && Cache->GetDirectory() == directory)
+	{
+		Cache->SetMaxSize(maxSizeBytes);
+	}
+	else
+	{
+		Cache = MakeShared<RepoWebCache, ESPMode::ThreadSafe>(directory, maxSizeBytes);
+	}
+}
 
 void RepoWebRequestManager::SetApiKey(FString apikey)
 {
 	ApiKey = apikey;
 }
 
-#pragma optimize("", off)
+void RepoWebRequestManager::SetMaxConcurrentRequests(int32 max)
+{
+	MaxConcurrentRequests = FMath::Max(max, 1);
+	ProcessQueue();
+}
+
+void RepoWebRequestManager::SetBackpressureThreshold(int32 threshold)
+{
+	BackpressureThreshold = FMath::Max(threshold, 1);
+	UpdateStats();
+}
 
 void RepoWebRequestManager::SetHost(FString host) 
 {
@@ -82,11 +161,140 @@ void RepoWebRequestManager::GetRequest(RepoWebRequest Request)
 		Requests.Add(Request);  // (Even if this host is unsupported, the user could still reconnect to a supported one...)
 		break;
 	case Status::Authenticated:
-		GetRequestSync(Request);
+		Request.sequence = NextSequence++;
+		if (Request.cacheable && !Request.cacheChecked && Cache.IsValid())
+		{
+			CacheQueue.HeapPush(Request, RepoWebRequestPriority()); // The request will be queued by ReadFromCacheCompleted if there is a miss
+		}
+		else
+		{
+			Queue.HeapPush(Request, RepoWebRequestPriority());
+		}
+		ProcessQueue();
 		break;
 	}
 }
 
+FString RepoWebRequestManager::GetCacheKey(const FString& uri) const
+{
+	return FString::Printf(TEXT("%s/%s"), *Host, *uri); // The key does not include the API key, as revisions look the same to all users who can access them
+}
+
+void RepoWebRequestManager::ReadFromCache(RepoWebRequest Request)
+{
+	// The cache is read on the thread pool, then the result is handed back to the game thread, where the callbacks
+	// are expected to execute. Only thread-safe pointers are copied on the worker; everything else is moved through.
+
+	TSharedRef<RepoWebCache, ESPMode::ThreadSafe> cache = Cache.ToSharedRef();
+	TWeakPtr<RepoWebRequestManager> manager = AsShared();
+	auto key = GetCacheKey(Request.uri);
+	auto timestamp = FPlatformTime::Seconds();
+
+	CacheReads.Add(Request.id, Request.priority);
+	NumCacheReads++;
+
+	Async(EAsyncExecution::ThreadPool,
+		[cache, key, timestamp, Request = MoveTemp(Request), manager = MoveTemp(manager)]() mutable
+		{
+			TArray<uint8> content;
+			bool bHit;
+			{
+				REPO_TRACE_SCOPE(ReadCache);
+				bHit = cache->Read(key, content);
+			}
+			auto readTime = FPlatformTime::Seconds();
+
+			AsyncTask(ENamedThreads::GameThread,
+				[bHit, timestamp, readTime, content = MoveTemp(content), Request = MoveTemp(Request), manager = MoveTemp(manager)]() mutable
+				{
+					auto pinned = manager.Pin();
+					if (pinned.IsValid())
+					{
+						pinned->ReadFromCacheCompleted(MoveTemp(Request), bHit, MoveTemp(content), timestamp, readTime);
+					}
+				});
+		});
+}
+
+void RepoWebRequestManager::ReadFromCacheCompleted(RepoWebRequest Request, bool bHit, TArray<uint8>&& Content, double ReadStartTime, double ReadEndTime)
+{
+	NumCacheReads--;
+
+	if (!CacheReads.RemoveAndCopyValue(Request.id, Request.priority)) // Take any change made while the cache was being read
+	{
+		ProcessQueue(); // The request was cancelled, but its read held a slot until now
+		return;
+	}
+
+	if (!bHit)
+	{
+		Request.cacheChecked = true;
+		GetRequest(Request); // Which also starts the next read
+		return;
+	}
+
+	ProcessQueue(); // Start the next read before the callback, as the network slots are freed
+
+	auto result = MakeShared<RepoWebResponse, ESPMode::ThreadSafe>();
+	result->bWasSuccessful = true;
+	result->bFromCache = true;
+	result->Time = 0;
+	result->Uri = Request.uri;
+	result->CachedContent = MoveTemp(Content);
+	result->QueuedTime = Request.queuedTime;
+	result->SentTime = ReadStartTime;
+	result->FirstByteTime = ReadEndTime;
+	result->CompletedTime = FPlatformTime::Seconds();
+	Request.callback.ExecuteIfBound(result);
+}
+
+void RepoWebRequestManager::ProcessQueue()
+{
+	if (bQueueOrderChanged)
+	{
+		Queue.Heapify(RepoWebRequestPriority());
+		bQueueOrderChanged = false;
+	}
+
+	while (Queue.Num() > 0 && NumInFlight < MaxConcurrentRequests)
+	{
+		RepoWebRequest Request;
+		Queue.HeapPop(Request, RepoWebRequestPriority(), false);
+		GetRequestSync(Request);
+	}
+
+	if (bCacheQueueOrderChanged)
+	{
+		CacheQueue.Heapify(RepoWebRequestPriority());
+		bCacheQueueOrderChanged = false;
+	}
+
+	while (CacheQueue.Num() > 0 && NumCacheReads < MaxConcurrentCacheReads)
+	{
+		RepoWebRequest Request;
+		CacheQueue.HeapPop(Request, RepoWebRequestPriority(), false);
+		ReadFromCache(Request);
+	}
+	UpdateStats();
+}
+
+void RepoWebRequestManager::UpdateStats()
+{
+	SET_DWORD_STAT(STAT_QueuedRequests, GetNumQueued());
+	SET_DWORD_STAT(STAT_InFlightRequests, NumInFlight);
+	CSV_CUSTOM_STAT(Repo3d, QueuedRequests, GetNumQueued(), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Repo3d, InFlightRequests, NumInFlight, ECsvCustomStatOp::Set);
+
+	// Requests being read from the cache count too, as each one that misses will join the network queue
+
+	auto backpressured = GetNumQueued() + CacheReads.Num() >= BackpressureThreshold;
+	if (backpressured != bBackpressured)
+	{
+		bBackpressured = backpressured;
+		OnBackpressureChanged.Broadcast(bBackpressured);
+	}
+}
+
 void RepoWebRequestManager::GetRequestSync(RepoWebRequest Request)
 {
 	FHttpModule::Get().SetHttpTimeout(3600); // the default timeout of 160 seconds is not enough for many models.
@@ -102,28 +310,186 @@ void RepoWebRequestManager::GetRequestSync(RepoWebRequest Request)
 
 	auto timestamp = FPlatformTime::Seconds();
 	auto callback = Request.callback; // local variable for closure capture
+	TWeakPtr<RepoWebRequestManager> manager = AsShared();
+	TSharedPtr<RepoWebCache, ESPMode::ThreadSafe> cache = Request.cacheable ? Cache : nullptr;
+	auto key = GetCacheKey(Request.uri);
+	auto uri = Request.uri;
+	auto id = Request.id;
+	auto transform = Request.cacheTransform;
+	auto queuedTime = Request.queuedTime;
+	auto firstByteTime = MakeShared<double>(0.0); // Shared by the progress and completion delegates
 
 	HttpRequest->SetURL(FString::Printf(TEXT("http://%s/api/%s%s"), *Host, *(Request.uri), *postfix));
+	HttpRequest->OnRequestProgress().BindLambda(
+		[firstByteTime](FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived)
+		{
+			if (BytesReceived > 0 && *firstByteTime == 0)
+			{
+				*firstByteTime = FPlatformTime::Seconds();
+			}
+		});
 	HttpRequest->OnProcessRequestComplete().BindLambda(
-		[callback, timestamp](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful) // note that Unreal should support binding delegates directly, but this function appears to be missing https://docs.unrealengine.com/en-US/Programming/UnrealArchitecture/Delegates/index.html
+		[callback, timestamp, queuedTime, firstByteTime, manager, cache, key, uri, id, transform](FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful) // note that Unreal should support binding delegates directly, but this function appears to be missing https://docs.unrealengine.com/en-US/Programming/UnrealArchitecture/Delegates/index.html
 		{
-			auto result = MakeShared<RepoWebResponse>();
+			auto result = MakeShared<RepoWebResponse, ESPMode::ThreadSafe>();
 			result->bWasSuccessful = bWasSuccessful;
 			result->Request = Request;
 			result->Response = Response;
-			result->Time = FPlatformTime::Seconds() - timestamp;
-			INC_MEMORY_STAT_BY(STAT_Downloaded, Response->GetContent().Num());
+			result->CompletedTime = FPlatformTime::Seconds();
+			result->Time = result->CompletedTime - timestamp;
+			result->QueuedTime = queuedTime;
+			result->SentTime = timestamp;
+			result->FirstByteTime = *firstByteTime > 0 ? *firstByteTime : result->CompletedTime; // The whole response arrived between two progress reports
+			result->Uri = uri;
+			if (Response.IsValid())
+			{
+				INC_MEMORY_STAT_BY(STAT_Downloaded, Response->GetContent().Num());
+			}
+
+			if (cache.IsValid() && bWasSuccessful && result->GetResponseCode() == 200)
+			{
+				Async(EAsyncExecution::ThreadPool, [cache, key, Response, transform]()
+				{
+					TArray<uint8> transformed;
+					if (transform && transform(Response->GetContent(), transformed))
+					{
+						cache->Write(key, transformed);
+					}
+					else
+					{
+						cache->Write(key, Response->GetContent());
+					}
+				});
+			}
+
+			// Free the slot before the callback, so the next request can start while this one is being handled
+
+			auto pinned = manager.Pin();
+			if (pinned.IsValid())
+			{
+				pinned->InFlight.Remove(id);
+				pinned->NumInFlight--;
+				pinned->ProcessQueue();
+			}
+
 			callback.ExecuteIfBound(result);
 		});
+
+	InFlight.Add(Request.id, HttpRequest);
+	NumInFlight++;
+	UpdateStats();
+
 	HttpRequest->ProcessRequest();
 }
 
-void RepoWebRequestManager::GetRequest(FString uri, RepoWebRequestDelegate callback)
+uint64 RepoWebRequestManager::GetRequest(FString uri, RepoWebRequestDelegate callback, int32 priority, bool cacheable, RepoWebCacheTransform cacheTransform)
 {
 	RepoWebRequest Request;
 	Request.callback = callback;
 	Request.uri = uri;
+	Request.id = NextId++;
+	Request.priority = priority;
+	Request.cacheable = cacheable;
+	Request.cacheTransform = MoveTemp(cacheTransform);
+	Request.queuedTime = FPlatformTime::Seconds();
 	GetRequest(Request);
+	return Request.id;
+}
+
+bool RepoWebRequestManager::SetPriority(uint64 id, int32 priority)
+{
+	// The queue is only re-heaped when the next request is taken from it, so that many priorities can be changed at once
+
+	for (auto& Request : Queue)
+	{
+		if (Request.id == id)
+		{
+			bQueueOrderChanged |= Request.priority != priority;
+			Request.priority = priority;
+			return true;
+		}
+	}
+
+	for (auto& Request : CacheQueue)
+	{
+		if (Request.id == id)
+		{
+			bCacheQueueOrderChanged |= Request.priority != priority;
+			Request.priority = priority;
+			return true;
+		}
+	}
+
+	for (auto& Request : Requests)
+	{
+		if (Request.id == id)
+		{
+			Request.priority = priority;
+			return true;
+		}
+	}
+
+	auto CacheRead = CacheReads.Find(id);
+	if (CacheRead)
+	{
+		*CacheRead = priority;
+		return true;
+	}
+
+	return false;
+}
+
+bool RepoWebRequestManager::CancelRequest(uint64 id)
+{
+	for (int32 i = 0; i < Queue.Num(); i++)
+	{
+		if (Queue[i].id == id)
+		{
+			Queue.HeapRemoveAt(i, RepoWebRequestPriority(), false);
+			UpdateStats();
+			return true;
+		}
+	}
+
+	for (int32 i = 0; i < CacheQueue.Num(); i++)
+	{
+		if (CacheQueue[i].id == id)
+		{
+			CacheQueue.HeapRemoveAt(i, RepoWebRequestPriority(), false);
+			UpdateStats();
+			return true;
+		}
+	}
+
+	for (int32 i = 0; i < Requests.Num(); i++)
+	{
+		if (Requests[i].id == id)
+		{
+			Requests.RemoveAt(i);
+			return true;
+		}
+	}
+
+	if (CacheReads.Remove(id)) // ReadFromCacheCompleted() will drop the request when it does not find it
+	{
+		UpdateStats();
+		return true;
+	}
+
+	// The completion delegate is unbound before the request is aborted, as some platforms raise it from within
+	// CancelRequest(), and the slot is freed here instead.
+
+	FHttpRequestPtr HttpRequest;
+	if (InFlight.RemoveAndCopyValue(id, HttpRequest))
+	{
+		HttpRequest->OnProcessRequestComplete().Unbind();
+		HttpRequest->CancelRequest();
+		NumInFlight--;
+		ProcessQueue();
+		return true;
+	}
+
+	return false;
 }
 
 FString RepoWebRequestManager::MakeURI(FString teamspace, FString model, FString revision, FString asset)
@@ -134,5 +500,3 @@ FString RepoWebRequestManager::MakeURI(FString teamspace, FString model, FString
 	}
 	return (FString::Printf(TEXT("%s/%s/revision/%s/%s"), *teamspace, *model, *revision, *asset));
 }
-
-#pragma optimize("", on)
\ No newline at end of file
@@ -28,6 +28,7 @@
 #include "RepoWebRequestManager.h"
 #include "RepoSrcImporter.h"
 #include "RepoTypes.h"
+#include "RepoBenchmarks.h"
 #include "Http.h"
 #include "HttpModule.h"
 #include "RHI.h"
@@ -35,7 +36,7 @@
 #define LOCTEXT_NAMESPACE "FRepo3dModule"
 
 
-Repo3d::Repo3d(TSharedRef<IPlugin> plugin):manager(MakeShared<RepoWebRequestManager>(this)),Plugin(plugin)
+Repo3d::Repo3d(TSharedRef<IPlugin> plugin):uploadBudgetMs(5.0f),mergeVertexBudget(0),bGeometryCache(false),manager(MakeShared<RepoWebRequestManager>(this)),Plugin(plugin)
 {
 }
 
@@ -87,6 +88,54 @@ void Repo3d::SetTranslucentMaterial(FString materialName)
 	translucentMaterial = LoadMaterial(materialName);
 }
 
+void Repo3d::SetCache(FString directory, int64 maxSizeBytes)
+{
+	manager->SetCache(directory, maxSizeBytes);
+}
+
+void Repo3d::SetGeometryCache(bool enabled)
+{
+	bGeometryCache = enabled;
+}
+
+void Repo3d::SetUploadBudget(float milliseconds)
+{
+	uploadBudgetMs = milliseconds;
+}
+
+void Repo3d::SetMergeVertexBudget(int32 vertices)
+{
+	mergeVertexBudget = vertices;
+}
+
+void Repo3d::SetTimelineDirectory(FString directory)
+{
+	timelineDirectory = directory;
+}
+
+void Repo3d::SetView(FVector location, FRotator rotation, float fovDegrees)
+{
+	view = RepoView(location, rotation, fovDegrees);
+	UpdateView();
+}
+
+void Repo3d::ClearView()
+{
+	view = RepoView();
+	UpdateView();
+}
+
+void Repo3d::UpdateView()
+{
+	for (auto importer : importers)
+	{
+		if (importer.IsValid())
+		{
+			importer->SetView(view);
+		}
+	}
+}
+
 void Repo3d::FindMaterials()
 {
 	auto Manager = UAssetManager::GetIfValid(); // use GetIfValid rather than Get because Get is marked EDITOR only and so cannot be linked from plugins
@@ -129,21 +178,59 @@ UMaterialInterface* Repo3d::LoadMaterial(FString materialName)
 	return materialAsset;
 }
 
-void Repo3d::LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor)
+Repo3dImport::Repo3dImport(URepoSrcImporter* InImporter):Importer(InImporter)
+{
+}
+
+void Repo3dImport::Cancel()
+{
+	if (Importer.IsValid())
+	{
+		Importer->Cancel();
+	}
+}
+
+bool Repo3dImport::IsActive() const
+{
+	return Importer.IsValid() && !Importer->IsFinished();
+}
+
+const RepoImportProgress& Repo3dImport::GetProgress() const
+{
+	return Progress;
+}
+
+TSharedRef<Repo3dImport> Repo3d::LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor)
 {
 	auto emptyDelegate = Repo3dLoadModelCompleteDelegate();
-	LoadModel(teamspace, model, revision, actor, emptyDelegate);
+	return LoadModel(teamspace, model, revision, actor, emptyDelegate);
 }
 
-void Repo3d::LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete)
+TSharedRef<Repo3dImport> Repo3d::LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete)
 {
-	UE_LOG(LogTemp, Log, TEXT("Importing 3D Repo Model..."));
+	return ImportModel(teamspace, model, revision, actor, oncomplete, false);
+}
+
+TSharedRef<Repo3dImport> Repo3d::UpdateModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor)
+{
+	auto emptyDelegate = Repo3dLoadModelCompleteDelegate();
+	return UpdateModel(teamspace, model, revision, actor, emptyDelegate);
+}
+
+TSharedRef<Repo3dImport> Repo3d::UpdateModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete)
+{
+	return ImportModel(teamspace, model, revision, actor, oncomplete, true);
+}
+
+TSharedRef<Repo3dImport> Repo3d::ImportModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete, bool update)
+{
+	UE_LOG(LogTemp, Log, TEXT("%s 3D Repo Model..."), update ? TEXT("Updating") : TEXT("Importing"));
 
 	auto importer = NewObject<URepoSrcImporter>(); // Create a new importer manager under the Transient package
 
 	if (actor.IsStale()) // We don't know where the Actor came from, so check it's still OK before proceeeding. Once assigned to the URepoSrcImporter actor UProperty, it will be protected from garbage collection.
 	{
-		return;
+		return MakeShared<Repo3dImport>(nullptr);
 	}
 	else
 	{
@@ -159,17 +246,55 @@ void Repo3d::LoadModel(FString teamspace, FString model, FString revision, TWeak
 	importer->SetWebManager(GetWebRequestManager());
 	importer->SetOpaqueMaterial(opaqueMaterial);
 	importer->SetTranslucentMaterial(translucentMaterial);
+	importer->SetUploadBudget(uploadBudgetMs);
+	importer->SetMergeVertexBudget(mergeVertexBudget);
+	importer->SetGeometryCache(bGeometryCache);
+	if (!timelineDirectory.IsEmpty())
+	{
+		importer->SetTimelineFile(FPaths::Combine(timelineDirectory, FString::Printf(TEXT("%s_%s_%s.json"), *teamspace, *model, *FDateTime::Now().ToString())));
+	}
+	importer->SetView(view);
+	importer->SetUpdate(update);
+
+	importers.Add(importer);
 	
 	importer->OnComplete.BindLambda(
 		[this, importer, actor, oncomplete]()
 		{
 			UE_LOG(LogTemp, Log, TEXT("Import complete."));
+			importers.Remove(importer);
 			oncomplete.ExecuteIfBound(actor);
 			importer->RemoveFromRoot();
 		}
 	);
 
+	importer->OnCancelled.BindLambda(
+		[this, importer]()
+		{
+			UE_LOG(LogTemp, Log, TEXT("Import cancelled."));
+			importers.Remove(importer);
+			importer->RemoveFromRoot();
+		}
+	);
+
+	auto import = MakeShared<Repo3dImport>(importer);
+	TWeakPtr<Repo3dImport> weakImport = import; // The caller may release the handle before the import finishes
+
+	importer->OnProgress.BindLambda(
+		[weakImport](const RepoImportProgress& progress)
+		{
+			auto import = weakImport.Pin();
+			if (import.IsValid())
+			{
+				import->Progress = progress;
+				import->OnProgress.ExecuteIfBound(progress);
+			}
+		}
+	);
+
 	importer->RequestRevision(teamspace, model, revision);
+
+	return import;
 }
 
 TSharedRef<Repo3d> FRepo3dModule::Get()
@@ -216,6 +341,8 @@ void FRepo3dModule::StartupModule()
 				}
 			}),
 		0);
+
+	RepoBenchmarks::RegisterConsoleCommands();
 }
 
 void FRepo3dModule::ShutdownModule()
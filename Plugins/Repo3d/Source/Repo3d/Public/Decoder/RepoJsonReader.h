@@ -0,0 +1,202 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/*
+ * A view of a string inside a RepoJsonReader's input (or its scratch buffer,
+ * if the string contained escape sequences). It is only valid until the
+ * reader advances.
+ */
+struct RepoJsonString
+{
+	const char* Data = nullptr;
+	size_t Size = 0;
+
+	bool Equals(const char* Literal) const
+	{
+		return strlen(Literal) == Size && memcmp(Data, Literal, Size) == 0;
+	}
+
+	std::string ToString() const
+	{
+		return std::string(Data, Size);
+	}
+};
+
+/*
+ * RepoJsonReader is a forward-only pull parser over UTF-8 JSON. It reads one
+ * token per call to Next() without building a document, so clients read
+ * the members they are interested in straight into their own types, and
+ * skip the rest with SkipValue().
+ * Keys are reported as a Key token, immediately followed by the tokens of
+ * their value.
+ */
+class RepoJsonReader
+{
+public:
+	enum class Token : uint8_t
+	{
+		None,
+		BeginObject,
+		EndObject,
+		BeginArray,
+		EndArray,
+		Key,
+		String,
+		Number,
+		True,
+		False,
+		Null,
+		End,	// The end of the input has been reached after a complete value
+		Error
+	};
+
+	RepoJsonReader(const char* Data, size_t Size);
+
+	Token Next();
+
+	Token GetToken() const
+	{
+		return Current;
+	}
+
+	// The current Key or String
+	const RepoJsonString& GetString() const
+	{
+		return String;
+	}
+
+	// The current Number
+	double GetNumber() const
+	{
+		return Number;
+	}
+
+	// Skips the value starting at the current token. If the current token begins an object or array, the reader
+	// is left on the token that closes it. Returns false if the input is malformed.
+	bool SkipValue();
+
+	// Reads the next token, which must be a value of the given type. These are used to read the value of a Key.
+	bool ReadString(RepoJsonString& Out);
+	bool ReadString(std::string& Out);
+	bool ReadNumber(double& Out);
+	bool ReadUInt64(uint64_t& Out);
+	bool ReadUInt32(uint32_t& Out);
+
+	// Reads an object member by member. ReadMember is called with the reader on each Key, and must consume the value.
+	template <typename F>
+	bool ReadObject(F&& ReadMember)
+	{
+		return Next() == Token::BeginObject && ReadMembers(ReadMember);
+	}
+
+	// As ReadObject(), for an object whose BeginObject has already been read
+	template <typename F>
+	bool ReadMembers(F&& ReadMember)
+	{
+		while (Next() == Token::Key)
+		{
+			if (!ReadMember(GetString()))
+			{
+				return false;
+			}
+		}
+		return Current == Token::EndObject;
+	}
+
+	// Reads an array element by element. ReadElement is called with the reader on the first token of each element,
+	// and must consume the rest of it.
+	template <typename F>
+	bool ReadArray(F&& ReadElement)
+	{
+		if (Next() != Token::BeginArray)
+		{
+			return false;
+		}
+		while (Next() != Token::EndArray)
+		{
+			if (Current == Token::Error || Current == Token::End || Current == Token::Key || !ReadElement(Current))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Skips the value of the current Key
+	bool SkipMember()
+	{
+		Next();
+		return SkipValue();
+	}
+
+	bool HasError() const
+	{
+		return Current == Token::Error;
+	}
+
+	// The byte offset of the reader within the input
+	size_t GetOffset() const
+	{
+		return (size_t)(Cursor - Begin);
+	}
+
+private:
+	enum class State : uint8_t
+	{
+		ExpectValue,
+		ExpectValueOrEnd,	// After '['
+		ExpectKey,			// After ',' in an object
+		ExpectKeyOrEnd,		// After '{'
+		ExpectCommaOrEnd,	// After a value inside a container
+		Done				// After the top-level value
+	};
+
+	static const int MaxDepth = 256;
+
+	const char* Begin;
+	const char* Cursor;
+	const char* Limit;
+
+	Token Current;
+	State CurrentState;
+	RepoJsonString String;
+	double Number;
+
+	int Depth;
+	char Containers[MaxDepth]; // '{' or '['
+
+	std::string Scratch; // Holds strings that needed unescaping
+
+	Token Fail();
+	Token ReadValue();
+	Token Push(char Container, Token Result);
+	Token Pop(Token Result);
+	bool ParseString();
+	bool ParseNumber();
+	bool ParseLiteral(const char* Literal, size_t Length);
+	void SkipWhitespace();
+	void AppendCodepoint(uint32_t Codepoint);
+};
@@ -0,0 +1,103 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * RepoSrcArena is a bump allocator for the scratch memory used while
+ * decoding an SRC, such as gathered bufferViews and the temporary arrays of
+ * the kernels. Allocations are never freed individually; instead the whole
+ * arena is Reset() between SRCs (or Rewind() to a Marker between meshes),
+ * and its blocks are reused. When Reset() finds that the previous SRC needed
+ * more than one block, the blocks are replaced by a single one big enough
+ * for all of them, so an arena settles on one allocation for a whole import.
+ * An arena is not thread safe. Each worker should have its own.
+ */
+class RepoSrcArena
+{
+public:
+	struct Marker
+	{
+		size_t Block;
+		size_t Offset;
+		size_t UsedBytes;
+	};
+
+	explicit RepoSrcArena(size_t InMinBlockSize = 1024 * 1024);
+	~RepoSrcArena();
+
+	RepoSrcArena(const RepoSrcArena&) = delete;
+	RepoSrcArena& operator=(const RepoSrcArena&) = delete;
+
+	// Returns Size bytes aligned to Alignment (a power of two), or nullptr if the memory could not be allocated
+	void* Allocate(size_t Size, size_t Alignment = 16);
+
+	template <typename T>
+	T* Allocate(size_t Count)
+	{
+		return (T*)Allocate(Count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	// Frees everything allocated so far, keeping the memory for reuse
+	void Reset();
+
+	// Frees everything allocated since Position was taken
+	Marker GetMarker() const;
+	void Rewind(const Marker& Position);
+
+	// The bytes allocated since the last Reset()
+	size_t GetUsedBytes() const
+	{
+		return UsedBytes;
+	}
+
+	// The most bytes that were allocated between two calls to Reset()
+	size_t GetPeakUsedBytes() const
+	{
+		return PeakUsedBytes;
+	}
+
+	// The size of the blocks held by the arena
+	size_t GetReservedBytes() const
+	{
+		return ReservedBytes;
+	}
+
+private:
+	struct Block
+	{
+		uint8_t* Data;
+		size_t Size;
+	};
+
+	std::vector<Block> Blocks;
+	size_t Current = 0; // The block allocations are made from
+	size_t Offset = 0; // The first free byte in the current block
+	size_t MinBlockSize;
+	size_t UsedBytes = 0;
+	size_t PeakUsedBytes = 0;
+	size_t ResetUsedBytes = 0; // The high-water mark of UsedBytes since the last Reset()
+	size_t ReservedBytes = 0;
+
+	void FreeBlocks();
+};
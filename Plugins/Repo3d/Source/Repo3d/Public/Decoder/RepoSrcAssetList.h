@@ -0,0 +1,50 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * One model of an srcAssets.json file. The assets are named relative to
+ * <Database>/<Model>/.
+ */
+struct RepoSrcAssetModel
+{
+	std::string Database;
+	std::string Model;
+	std::vector<std::string> Assets;
+	double Offset[3] = { 0, 0, 0 }; // In the server's coordinate system
+};
+
+/*
+ * RepoSrcAssetList reads an srcAssets.json file, which lists the SRCs that
+ * make up a revision, with a RepoJsonReader.
+ */
+class RepoSrcAssetList
+{
+public:
+	// Parses the UTF-8 JSON in Data. Returns false if it is malformed.
+	bool Parse(const char* Data, size_t Size);
+
+	std::vector<RepoSrcAssetModel> Models;
+};
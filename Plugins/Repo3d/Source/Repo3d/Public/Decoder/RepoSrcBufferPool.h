@@ -0,0 +1,104 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * RepoSrcBufferPool recycles the large buffers that compressed SRCs are
+ * inflated into, so that importing many SRCs does not allocate and free
+ * tens of megabytes per file. Buffers are handed out as RepoSrcBufferPool::Buffer
+ * handles, which return their memory to the pool when destroyed. The pool
+ * keeps at most MaxRetainedBytes of unused buffers; beyond that, released
+ * buffers are freed.
+ * The pool is thread safe, and must outlive the buffers acquired from it.
+ */
+class RepoSrcBufferPool
+{
+public:
+	class Buffer
+	{
+	public:
+		Buffer() = default;
+		Buffer(Buffer&& Other);
+		Buffer& operator=(Buffer&& Other);
+		~Buffer();
+
+		Buffer(const Buffer&) = delete;
+		Buffer& operator=(const Buffer&) = delete;
+
+		uint8_t* GetData() const
+		{
+			return Data;
+		}
+
+		size_t GetCapacity() const
+		{
+			return Capacity;
+		}
+
+		explicit operator bool() const
+		{
+			return Data != nullptr;
+		}
+
+		// Frees the memory, or returns it to the pool it came from
+		void Reset();
+
+	private:
+		friend class RepoSrcBufferPool;
+
+		RepoSrcBufferPool* Pool = nullptr;
+		uint8_t* Data = nullptr;
+		size_t Capacity = 0;
+	};
+
+	explicit RepoSrcBufferPool(size_t InMaxRetainedBytes);
+	~RepoSrcBufferPool();
+
+	// Returns a buffer of at least Size bytes, or an empty buffer if the memory could not be allocated
+	Buffer Acquire(size_t Size);
+
+	// Returns a buffer of at least Size bytes that is not owned by any pool, or an empty buffer
+	static Buffer Allocate(size_t Size);
+
+	// The total size of the unused buffers held by the pool
+	size_t GetRetainedBytes() const;
+
+	// Frees all the unused buffers
+	void Trim();
+
+private:
+	struct Entry
+	{
+		uint8_t* Data;
+		size_t Capacity;
+	};
+
+	mutable std::mutex Mutex;
+	std::vector<Entry> Free;
+	size_t RetainedBytes = 0;
+	size_t MaxRetainedBytes;
+
+	void Release(uint8_t* Data, size_t Capacity);
+};
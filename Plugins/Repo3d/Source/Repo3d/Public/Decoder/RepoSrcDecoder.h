@@ -0,0 +1,258 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Decoder/RepoSrcArena.h"
+#include "Decoder/RepoSrcBufferPool.h"
+
+class RepoJsonReader;
+
+enum class RepoSrcStatus : uint8_t
+{
+	Ok,
+	Truncated,
+	BadMagic,
+	BadVersion,
+	BadHeader,
+	InflateFailed,
+	UnsupportedChunks,
+	UnsupportedComponentType,
+	ChunkLengthMismatch,
+	OutOfBounds,
+	OutOfMemory
+};
+
+const char* RepoSrcStatusToString(RepoSrcStatus Status);
+
+/*
+ * A typed view of one accessor within the (uncompressed) SRC buffer. The data
+ * is not necessarily aligned, so it should be read with the RepoSrcKernels,
+ * or copied out.
+ */
+struct RepoSrcStream
+{
+	const uint8_t* Data = nullptr;
+	uint32_t Count = 0;
+	uint32_t Stride = 0;
+	uint32_t ComponentType = 0;
+
+	bool IsValid() const
+	{
+		return Data != nullptr;
+	}
+};
+
+/*
+ * The streams of one mesh within an SRC. Streams that are not present in the
+ * SRC are left invalid.
+ */
+struct RepoSrcMesh
+{
+	std::string Name;
+	RepoSrcStream Indices;
+	RepoSrcStream Positions;
+	RepoSrcStream Normals;
+	RepoSrcStream Texcoords;
+	RepoSrcStream Ids; // Indices into the 'mapping' array of the counterpart .json.mpc file
+};
+
+/*
+ * RepoSrcDecoder reads the header of an SRC file, inflates its buffer if it
+ * is compressed, and resolves the accessors of each mesh into streams. It
+ * does no conversion of the geometry itself; see RepoSrcKernels.
+ * Decode() runs all the stages. They are also exposed individually so that
+ * they can be timed separately by the benchmark, and must be called in
+ * order.
+ * The buffer can also be inflated a slice at a time, with BeginInflate() and
+ * InflateSome(), and each mesh resolved as soon as the part of the buffer it
+ * references (GetMeshExtent()) has been inflated. This lets a caller decode
+ * the first meshes while the rest of the buffer is still being inflated.
+ * The streams point into memory owned by the decoder (or, for uncompressed
+ * SRCs, into the input), so the decoder and the input must outlive them.
+ */
+class RepoSrcDecoder
+{
+public:
+	static const uint32_t MagicUncompressed = 23;
+	static const uint32_t MagicCompressed = 24;
+	static const uint32_t Version = 42;
+	static const uint32_t ComponentTypeUInt16 = 5123;
+	static const uint32_t ComponentTypeUInt32 = 5125;
+	static const uint32_t ComponentTypeFloat = 5126;
+
+	RepoSrcDecoder();
+	~RepoSrcDecoder();
+
+	// If set, the buffers compressed SRCs are inflated into are taken from, and returned to, Pool
+	void SetBufferPool(RepoSrcBufferPool* InPool)
+	{
+		Pool = InPool;
+	}
+
+	// If set, scratch memory such as gathered bufferViews is allocated from Arena instead of the decoder's own. The
+	// arena must not be reset while the meshes are in use.
+	void SetArena(RepoSrcArena* InArena)
+	{
+		Arena = InArena;
+	}
+
+	RepoSrcStatus Decode(const uint8_t* Data, size_t Size);
+
+	RepoSrcStatus ReadPreamble(const uint8_t* Data, size_t Size);
+	RepoSrcStatus ParseHeader();
+	RepoSrcStatus Inflate();
+	RepoSrcStatus ResolveMeshes();
+
+	// Prepares the buffer for inflation. For uncompressed SRCs, the whole buffer is available immediately.
+	RepoSrcStatus BeginInflate();
+
+	// Inflates up to MaxBytes more of the buffer
+	RepoSrcStatus InflateSome(size_t MaxBytes);
+
+	size_t GetInflatedSize() const
+	{
+		return InflatedSize;
+	}
+
+	bool IsInflated() const
+	{
+		return Buffer != nullptr && InflatedSize == BufferSize;
+	}
+
+	size_t GetNumMeshes() const
+	{
+		return MeshEntries.size();
+	}
+
+	// The number of bytes at the start of the buffer that must be inflated before mesh Index can be resolved
+	RepoSrcStatus GetMeshExtent(size_t Index, uint64_t& Extent) const;
+
+	// Resolves the streams of one mesh, which must be within the inflated part of the buffer
+	RepoSrcStatus ResolveMesh(size_t Index, RepoSrcMesh& Mesh);
+
+	const std::vector<RepoSrcMesh>& GetMeshes() const
+	{
+		return Meshes;
+	}
+
+	bool IsCompressed() const
+	{
+		return bCompressed;
+	}
+
+	size_t GetHeaderSize() const
+	{
+		return HeaderSize;
+	}
+
+	// The size of the buffer after inflation
+	size_t GetBufferSize() const
+	{
+		return BufferSize;
+	}
+
+private:
+	struct IndexView
+	{
+		uint64_t ByteOffset = 0;
+		uint32_t Count = 0;
+		uint32_t ComponentType = 0;
+		std::string BufferView;
+	};
+
+	struct AttributeView
+	{
+		uint64_t ByteOffset = 0;
+		uint32_t ByteStride = 0;
+		uint32_t Count = 0;
+		uint32_t ComponentType = 0;
+		std::string Type;
+		std::string BufferView;
+	};
+
+	struct BufferView
+	{
+		std::vector<std::string> Chunks;
+	};
+
+	struct BufferChunk
+	{
+		uint64_t ByteOffset = 0;
+		uint64_t ByteLength = 0;
+	};
+
+	struct MeshEntry
+	{
+		std::string Name;
+		std::string Indices;
+		std::string Position;
+		std::string Normal;
+		std::string Texcoord;
+		std::string Id;
+	};
+
+	const uint8_t* Input = nullptr;
+	size_t InputSize = 0;
+	bool bCompressed = false;
+
+	const char* Header = nullptr;
+	size_t HeaderSize = 0;
+
+	const uint8_t* Buffer = nullptr;
+	size_t BufferSize = 0;
+	size_t InflatedSize = 0;
+
+	RepoSrcBufferPool* Pool = nullptr;
+	RepoSrcBufferPool::Buffer Inflated;
+
+	struct InflateStream;
+	std::unique_ptr<InflateStream> Stream;
+
+	// BufferViews whose chunks are not contiguous in the buffer are gathered into arena memory, once per view
+	std::unordered_map<std::string, const uint8_t*> GatheredViews;
+	RepoSrcArena* Arena = nullptr;
+	RepoSrcArena OwnArena;
+
+	std::vector<MeshEntry> MeshEntries;
+	std::unordered_map<std::string, IndexView> IndexViews;
+	std::unordered_map<std::string, AttributeView> AttributeViews;
+	std::unordered_map<std::string, BufferView> BufferViews;
+	std::unordered_map<std::string, BufferChunk> BufferChunks;
+
+	std::vector<RepoSrcMesh> Meshes;
+
+	bool ParseMeshes(RepoJsonReader& Reader);
+	bool ParseAccessors(RepoJsonReader& Reader);
+	bool ParseBufferViews(RepoJsonReader& Reader);
+	bool ParseBufferChunks(RepoJsonReader& Reader);
+
+	RepoSrcStatus GetViewExtent(const std::string& BufferViewName, uint64_t& Extent) const;
+	RepoSrcStatus FailInflate();
+	void ClearGatheredViews();
+	RepoSrcStatus ResolveView(const std::string& BufferViewName, uint64_t ViewOffset, uint64_t ViewLength, const uint8_t*& Data);
+	RepoSrcStatus ResolveIndices(const std::string& ViewName, RepoSrcStream& Stream);
+	RepoSrcStatus ResolveAttribute(const std::string& ViewName, uint32_t Components, RepoSrcStream& Stream);
+};
@@ -0,0 +1,125 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Decoder/RepoSrcDecoder.h"
+
+/*
+ * One section of a decoded mesh, as stored in a geometry file. The vectors
+ * are already in Unreal's coordinate system. Ids holds the id of each
+ * vertex relative to the SRC's mapping (as UV1.X), as the ids relative to an
+ * actor change from one import to the next. Every stream but Indices and
+ * Positions is optional, and every stream but Indices has one element per
+ * position.
+ */
+struct RepoSrcGeometrySection
+{
+	bool bTranslucent = false;
+	float Bounds[6] = { 0, 0, 0, 0, 0, 0 }; // Minimum, then maximum
+	RepoSrcStream Indices;   // uint32
+	RepoSrcStream Positions; // float3
+	RepoSrcStream Normals;   // float3
+	RepoSrcStream Texcoords; // float2
+	RepoSrcStream Ids;       // float
+};
+
+struct RepoSrcGeometryMesh
+{
+	std::vector<RepoSrcGeometrySection> Sections;
+};
+
+/*
+ * RepoSrcGeometryFile reads the decoded geometry of an SRC, as written by a
+ * RepoSrcGeometryWriter, in place. The file is meant to be memory-mapped:
+ * Open() checks the header and the tables, and the streams of each mesh are
+ * then handed out as RepoSrcStreams pointing into the file, so loading a
+ * mesh reads only its own pages, and nothing is inflated or converted.
+ * The values in the streams are not checked, so callers should range-check
+ * the indices if the file may have been corrupted.
+ */
+class RepoSrcGeometryFile
+{
+public:
+	static const uint32_t Magic = 0x43473352; // "R3GC"
+	static const uint32_t Version = 1; // Must change whenever the decoded geometry would, as well as the layout
+	static const uint32_t PageSize = 4096; // The streams of each mesh begin on a page
+	static const uint32_t StreamAlignment = 16;
+
+	// Data must be aligned to StreamAlignment, and outlive the file and the meshes read from it
+	RepoSrcStatus Open(const uint8_t* Data, size_t Size);
+
+	size_t GetNumMeshes() const
+	{
+		return Meshes.size();
+	}
+
+	void GetMesh(size_t Index, RepoSrcGeometryMesh& Mesh) const;
+
+private:
+	struct MeshRecord
+	{
+		uint32_t FirstSection;
+		uint32_t NumSections;
+	};
+
+	struct SectionRecord
+	{
+		uint32_t bTranslucent;
+		uint32_t NumVertices;
+		uint32_t NumIndices;
+		uint32_t Streams; // A bit for each stream that is present, in the order of Offsets
+		float Bounds[6];
+		uint64_t Offsets[5]; // Indices, Positions, Normals, Texcoords, Ids
+	};
+
+	friend class RepoSrcGeometryWriter;
+
+	const uint8_t* Data = nullptr;
+	std::vector<MeshRecord> Meshes;
+	std::vector<SectionRecord> Sections;
+};
+
+/*
+ * RepoSrcGeometryWriter collects the decoded meshes of an SRC, mesh by mesh
+ * as they are decoded, and writes them out as a geometry file. The streams
+ * may be strided, such as fields of an interleaved vertex buffer; they are
+ * copied as they are added, packed.
+ */
+class RepoSrcGeometryWriter
+{
+public:
+	void AddMesh(const RepoSrcGeometryMesh& Mesh);
+
+	size_t GetSize() const;
+
+	// Writes GetSize() bytes to Out
+	void Write(uint8_t* Out) const;
+
+private:
+	std::vector<RepoSrcGeometryFile::MeshRecord> Meshes;
+	std::vector<RepoSrcGeometryFile::SectionRecord> Sections;
+	std::vector<uint8_t> Streams; // Offsets in the records are relative to the start of this, until written
+
+	size_t GetTablesSize() const;
+	uint64_t AddStream(const RepoSrcStream& Stream, size_t ElementSize);
+};
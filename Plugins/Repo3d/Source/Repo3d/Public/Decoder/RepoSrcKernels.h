@@ -0,0 +1,97 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include "Decoder/RepoSrcDecoder.h"
+
+/*
+ * RepoSrcKernels converts the streams resolved by a RepoSrcDecoder into the
+ * layouts the importer hands to Unreal. The outputs are plain arrays, so
+ * they can be written directly into TArrays of the matching engine types.
+ * Inputs may be unaligned; outputs must be aligned to their element type.
+ * The Interleaved variants write one field of an array of structs, such as
+ * a vertex buffer, given the offset of the field and the size of the struct
+ * (OutStride, in bytes).
+ */
+class RepoSrcKernels
+{
+public:
+	// The vector instruction set the kernels were compiled for ("AVX2", "SSE2", "NEON" or "Scalar")
+	static const char* GetInstructionSet();
+
+	// Widens a uint16 or uint32 index stream into Count int32s
+	static void WidenIndices(const RepoSrcStream& Indices, int32_t* Out);
+
+	// Returns true if every widened index refers to one of NumVertices vertices. uint32 indices too large for an int32
+	// are negative once widened, and so are out of range.
+	static bool CheckIndices(const int32_t* Indices, size_t NumIndices, size_t NumVertices);
+
+	// Converts a float3 stream from Unity's coordinate system to Unreal's, writing Count packed float3s
+	static void UnityToUnreal(const RepoSrcStream& Vectors, float* Out);
+
+	// Copies the first Components floats of each element of a float stream into Count packed elements
+	static void CopyFloats(const RepoSrcStream& Stream, uint32_t Components, float* Out);
+
+	// As UnityToUnreal, writing one float3 every OutStride bytes. If Bounds is not null, the minimum and maximum of
+	// the converted vectors are written to Bounds[0..2] and Bounds[3..5].
+	static void UnityToUnrealInterleaved(const RepoSrcStream& Vectors, uint8_t* Out, size_t OutStride, float* Bounds);
+
+	// As CopyFloats, writing one element every OutStride bytes
+	static void CopyFloatsInterleaved(const RepoSrcStream& Stream, uint32_t Components, uint8_t* Out, size_t OutStride);
+
+	// Writes a float2 for each id: the id itself (relative to the supermesh) and its index within the actor.
+	// Returns false if an id is outside LocalToActor.
+	static bool GenerateSupermeshMapIndices(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, float* Out);
+
+	// As GenerateSupermeshMapIndices, writing one float2 every OutStride bytes
+	static bool GenerateSupermeshMapIndicesInterleaved(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, uint8_t* Out, size_t OutStride);
+
+	// Writes the actor-relative id of the first vertex of each triangle. Returns false if an index or id is out of range.
+	static bool GenerateTriangleIdMap(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, int32_t* Out);
+
+	// Writes, for each triangle, the class (0 or 1) of the local id of its first vertex. Returns the number of triangles
+	// in class 1, or -1 if an index or id is out of range.
+	static int64_t ClassifyTriangles(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint8_t* Classes, size_t NumClasses, uint8_t* Out);
+
+	// Copies the triangles in Class into OutIndices, re-indexed so that they refer only to the vertices they use.
+	// OutVertices receives the original index of each of those vertices, and the number of them is returned, or -1 if
+	// an index is out of range. Remap must have one element per vertex of the mesh, all set to -1.
+	static int64_t CompactTriangles(const int32_t* Indices, size_t NumIndices, const uint8_t* TriangleClasses, uint8_t Class, int32_t* Remap, size_t NumVertices, int32_t* OutIndices, int32_t* OutVertices);
+};
+
+/*
+ * The reference implementations of the kernels that RepoSrcKernels
+ * vectorises. RepoSrcKernels uses these for the elements left over after the
+ * vector loops, and for layouts that it does not vectorise. They produce
+ * identical results, so they are also used to check and measure the vector
+ * kernels.
+ */
+class RepoSrcScalarKernels
+{
+public:
+	static void WidenIndices(const RepoSrcStream& Indices, int32_t* Out);
+	static bool CheckIndices(const int32_t* Indices, size_t NumIndices, size_t NumVertices);
+	static void UnityToUnreal(const RepoSrcStream& Vectors, float* Out);
+	static bool GenerateSupermeshMapIndices(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, float* Out);
+	static void UnityToUnrealInterleaved(const RepoSrcStream& Vectors, uint8_t* Out, size_t OutStride, float* Bounds);
+	static void CopyFloatsInterleaved(const RepoSrcStream& Stream, uint32_t Components, uint8_t* Out, size_t OutStride);
+	static bool GenerateSupermeshMapIndicesInterleaved(const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, uint8_t* Out, size_t OutStride);
+	static bool GenerateTriangleIdMap(const int32_t* Indices, size_t NumIndices, const float* Ids, size_t NumIds, const uint32_t* LocalToActor, size_t MapSize, int32_t* Out);
+};
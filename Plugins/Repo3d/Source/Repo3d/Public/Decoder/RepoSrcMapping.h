@@ -0,0 +1,106 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+// This file is part of the engine-independent decoder, and must only depend on the C++ standard library.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Decoder/RepoJsonReader.h"
+
+/*
+ * An appearance (material) of the submeshes of an SRC. The colours are
+ * linear RGB in [0,1].
+ */
+struct RepoSrcAppearance
+{
+	std::string Name;
+	float Diffuse[3] = { 1, 1, 1 };
+	float Specular[3] = { 0, 0, 0 };
+	float Transparency = 0;
+	bool bDefined = false; // False if a submesh names an appearance that the file does not contain
+};
+
+/*
+ * One entry of the 'mapping' array, describing a submesh of the SRC. The
+ * ids of the SRC's vertices index these entries.
+ */
+struct RepoSrcMappingEntry
+{
+	uint32_t NameOffset = 0; // The Name (the submesh id) is held in RepoSrcMapping's string pool; see GetName()
+	uint32_t NameSize = 0;
+	uint32_t Appearance = UINT32_MAX; // Index into RepoSrcMapping::Appearances, or UINT32_MAX if the entry has none
+	bool bHasBounds = false;
+	double Min[3] = { 0, 0, 0 }; // In the SRC's (Unity's) coordinate system
+	double Max[3] = { 0, 0, 0 };
+};
+
+/*
+ * RepoSrcMapping reads a .json.mpc supermesh mapping with a RepoJsonReader,
+ * straight into typed arrays. There is no document and no conversion to wide
+ * strings, and the names of all the entries share one string pool, so a
+ * mapping with hundreds of thousands of entries costs little more memory
+ * than the entries themselves.
+ * A parsed mapping can be written out in a binary form (see WriteBinary()),
+ * which holds the same arrays as they are laid out in memory. Parse()
+ * accepts either form, and reads the binary one with a handful of copies,
+ * so a mapping that has been stored in its binary form can be loaded again
+ * at almost no cost.
+ */
+class RepoSrcMapping
+{
+public:
+	static const uint32_t BinaryMagic = 0x424D3352; // "R3MB"
+	static const uint32_t BinaryVersion = 1;
+
+	// Parses the UTF-8 JSON, or the binary form, in Data. Returns false if it is malformed.
+	bool Parse(const char* Data, size_t Size);
+
+	static bool IsBinary(const char* Data, size_t Size);
+
+	size_t GetBinarySize() const;
+
+	// Writes GetBinarySize() bytes to Out
+	void WriteBinary(uint8_t* Out) const;
+
+	RepoJsonString GetName(const RepoSrcMappingEntry& Entry) const
+	{
+		RepoJsonString Name;
+		Name.Data = Names.data() + Entry.NameOffset;
+		Name.Size = Entry.NameSize;
+		return Name;
+	}
+
+	uint32_t NumberOfIds = 0;
+	std::vector<RepoSrcMappingEntry> Entries;
+	std::vector<RepoSrcAppearance> Appearances;
+
+private:
+	std::string Names;
+	std::unordered_map<std::string, uint32_t> AppearanceIndices;
+
+	bool ParseJson(const char* Data, size_t Size);
+	bool ParseBinary(const char* Data, size_t Size);
+	bool ParseEntries(RepoJsonReader& Reader, size_t InputSize);
+	bool ParseAppearances(RepoJsonReader& Reader);
+	uint32_t FindOrAddAppearance(const RepoJsonString& Name);
+};
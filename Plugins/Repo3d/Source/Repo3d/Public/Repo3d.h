@@ -24,21 +24,62 @@
 #include "RepoWebRequestManager.h"
 #include "RepoSupermeshActor.h"
 #include "RepoSupermeshMapComponent.h"
+#include "RepoTypes.h"
 
 DECLARE_STATS_GROUP(TEXT("3D Repo Plugin"), STATGROUP_Repo3D, STATCAT_Advanced)
 
 DECLARE_DELEGATE_OneParam(Repo3dLoadModelCompleteDelegate, TWeakObjectPtr<ARepoSupermeshActor>);
 
+class URepoSrcImporter;
+
+/*
+ * Returned by Repo3d::LoadModel() and Repo3d::UpdateModel(), to cancel the
+ * import, e.g. when the user switches to another model before it has loaded.
+ * It also reports the progress of the import, e.g. for a loading bar.
+ */
+class REPO3D_API Repo3dImport
+{
+public:
+	Repo3dImport(URepoSrcImporter* InImporter);
+
+	// Cancels the queued and in-flight requests and the decode tasks of the import, and releases their buffers. The
+	// components already created are kept. The completion delegate is not raised.
+	void Cancel();
+
+	// True until the import completes or is cancelled
+	bool IsActive() const;
+
+	// The most recent progress of the import. This is kept once the import has finished.
+	const RepoImportProgress& GetProgress() const;
+
+	// Raised each frame while the import runs, and once more when it completes or is cancelled
+	RepoImportProgressDelegate OnProgress;
+
+private:
+	friend class Repo3d;
+
+	TWeakObjectPtr<URepoSrcImporter> Importer;
+	RepoImportProgress Progress;
+};
+
 class REPO3D_API Repo3d
 {
 private:
 	FString package;
 	UMaterialInterface* opaqueMaterial;
 	UMaterialInterface* translucentMaterial;
+	float uploadBudgetMs;
+	int32 mergeVertexBudget;
+	bool bGeometryCache;
+	FString timelineDirectory;
+	RepoView view;
 	TSharedRef<RepoWebRequestManager> manager;
+	TArray<TWeakObjectPtr<URepoSrcImporter>> importers; // Importers that are still loading
 
 	UMaterialInterface* LoadMaterial(FString materialName);
 	void FindMaterials();
+	void UpdateView();
+	TSharedRef<Repo3dImport> ImportModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete, bool update);
 
 public:
 	Repo3d(TSharedRef<IPlugin> plugin);
@@ -54,8 +95,41 @@ public:
 	void SetOpaqueMaterial(FString materialName);
 	void SetTranslucentMaterial(FString materialName);
 
-	void LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor);
-	void LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete);
+	// Responses for specific revisions are cached on disk in directory, up to maxSizeBytes. The cache is disabled until
+	// this is called; pass an empty directory to disable it again.
+	void SetCache(FString directory, int64 maxSizeBytes);
+
+	// If enabled, the decoded geometry of each SRC is stored in the cache as well, in a form that is mapped straight
+	// into memory, so later imports of the same revision neither download nor decode the SRCs. Disabled by default, as
+	// decoded geometry takes several times the space of the SRCs.
+	void SetGeometryCache(bool enabled);
+
+	// The time in milliseconds importers may spend on the game thread each frame creating components for decoded SRCs.
+	void SetUploadBudget(float milliseconds);
+
+	// When greater than zero, the meshes of a model are packed into components of up to this many vertices, rather than
+	// each SRC mesh having its own component. Zero (the default) disables merging.
+	void SetMergeVertexBudget(int32 vertices);
+
+	// If set, each import writes the timeline of its SRCs (the time each spent queued, downloading, decoding and being
+	// turned into components) to a JSON file in directory, slowest first. Pass an empty directory to disable.
+	void SetTimelineDirectory(FString directory);
+
+	// The camera that models are being loaded for. The SRCs that will cover the most of the screen from this view are
+	// downloaded first, including by models that are already loading. Call this as the camera moves.
+	void SetView(FVector location, FRotator rotation, float fovDegrees);
+
+	// Stops prioritising SRCs by view. New models will download their SRCs in the order the server lists them.
+	void ClearView();
+
+	TSharedRef<Repo3dImport> LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor);
+	TSharedRef<Repo3dImport> LoadModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete);
+
+	// Changes the actor to another revision of the model it holds. Only the SRCs that differ from those already in the
+	// actor are downloaded; the rest keep their components. The SRCs that are not in the new revision are removed once
+	// the new ones have been created. A cancelled update keeps the SRCs it had not yet replaced.
+	TSharedRef<Repo3dImport> UpdateModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor);
+	TSharedRef<Repo3dImport> UpdateModel(FString teamspace, FString model, FString revision, TWeakObjectPtr<ARepoSupermeshActor> actor, Repo3dLoadModelCompleteDelegate& oncomplete);
 
 	// These log warnings to the user, as well as the UE_LOG
 	void LogWarning(FString warning);
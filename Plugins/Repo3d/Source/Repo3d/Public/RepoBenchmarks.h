@@ -0,0 +1,40 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+
+/*
+ * RepoBenchmarks holds micro-benchmarks of the plugin's runtime paths that
+ * can be run from the console of a game or editor session, e.g.
+ *   3drepobenchmarkmap 100000
+ * Results are written to the log and to the screen.
+ */
+class REPO3D_API RepoBenchmarks
+{
+public:
+	static void RegisterConsoleCommands();
+
+	// Compares setting Count supermesh map parameters one at a time against setting them in a batch
+	static void SupermeshMapParameters(UWorld* World, int32 Count);
+
+private:
+	static void Report(const FString& Message);
+};
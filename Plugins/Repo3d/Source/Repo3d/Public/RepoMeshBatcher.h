@@ -0,0 +1,74 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RepoSupermeshActor.h"
+#include "RepoSrcDecodeTask.h"
+
+/*
+ * RepoMeshBatcher packs the sections of many decoded meshes into fewer, larger
+ * ProceduralMeshComponents, to reduce the number of components (and so the
+ * registration, transform and draw call overhead) of models made of many
+ * small SRCs.
+ * Sections are only packed with others that have the same material type and
+ * offset, as each component has one material and one relative location. A
+ * batch is turned into a component when adding the next section would take it
+ * over the vertex budget, or when Flush() is called.
+ * The triangle id maps are concatenated alongside the triangles, so the
+ * MeshComponentTriangleMaps of the actor continue to resolve face indices.
+ * Each component is recorded against all the SRC assets that contributed to
+ * it, so that updating any of them replaces the whole component.
+ */
+class REPO3D_API RepoMeshBatcher
+{
+public:
+	RepoMeshBatcher(TWeakObjectPtr<ARepoSupermeshActor> InActor, UMaterialInterface* InMaterialOpaque, UMaterialInterface* InMaterialTranslucent, int32 InVertexBudget) :
+		Actor(InActor),
+		MaterialOpaque(InMaterialOpaque),
+		MaterialTranslucent(InMaterialTranslucent),
+		VertexBudget(InVertexBudget)
+	{
+	}
+
+	// Adds a section of the SRC asset Uri to the batch for its material type and offset. TriangleIds holds the id of
+	// each triangle of the section. The section's buffers are consumed.
+	void Add(const FString& Uri, const FVector& Offset, RepoSrcDecodedSection& Section, const int* TriangleIds);
+
+	// Creates components for all the batches that still hold sections.
+	void Flush();
+
+private:
+	struct Batch
+	{
+		FVector Offset;
+		RepoSrcDecodedSection Section;
+		TArray<int> TriangleIdMap;
+		TArray<FString> Assets; // The URIs of the SRC assets the sections came from
+	};
+
+	TWeakObjectPtr<ARepoSupermeshActor> Actor;
+	UMaterialInterface* MaterialOpaque;
+	UMaterialInterface* MaterialTranslucent;
+	int32 VertexBudget;
+
+	TArray<Batch> Batches;
+
+	Batch& FindBatch(const FVector& Offset, bool bTranslucent);
+	void CreateComponent(Batch& batch);
+};
@@ -0,0 +1,137 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/ThreadSafeBool.h"
+#include "ProceduralMeshComponent.h"
+#include "RepoWebRequestManager.h"
+#include "RepoTrace.h"
+
+struct RepoSrcMesh;
+struct RepoSrcGeometryMesh;
+class RepoSrcArena;
+class RepoSrcGeometryWriter;
+
+/*
+ * The geometry of one section of a mesh, already transformed into Unreal's
+ * coordinate system. The SRC streams are decoded straight into the vertex
+ * layout of the ProceduralMeshComponent, so the section can be moved into a
+ * component without being converted or copied again (see MoveTo()).
+ * UV1 of each vertex holds its SupermeshMapIndices relative to the Supermesh
+ * itself (X), and the Actor (Y).
+ */
+struct RepoSrcDecodedSection
+{
+	FProcMeshSection Geometry;
+	bool bTranslucent = false;
+
+	int32 NumTriangles() const
+	{
+		return Geometry.ProcIndexBuffer.Num() / 3;
+	}
+
+	int32 NumVertices() const
+	{
+		return Geometry.ProcVertexBuffer.Num();
+	}
+
+	// Moves the geometry into section SectionIndex of Component. The section is left empty.
+	void MoveTo(UProceduralMeshComponent* Component, int32 SectionIndex);
+};
+
+/*
+ * One mesh within an SRC. Meshes that contain both opaque and translucent
+ * submeshes are split into two sections, so that only the translucent
+ * triangles are drawn with the translucent material. The opaque section,
+ * if any, is always first.
+ */
+struct RepoSrcDecodedMesh
+{
+	TArray<RepoSrcDecodedSection> Sections;
+	TArray<int> TriangleIdMap; // Covers the triangles of all the sections, in order
+};
+
+/*
+ * RepoSrcDecodeTask turns the body of a .src.mpc response into a set of
+ * RepoSrcDecodedMesh instances, using the engine-independent RepoSrcDecoder
+ * and RepoSrcKernels. It does not touch any UObjects, so DoWork()
+ * can run on the task graph. The RepoSrcAssetImporter that created it is
+ * responsible for creating the components from the results on the game thread.
+ * Compressed SRCs are inflated only as far as the next mesh needs, and each
+ * mesh is put in the Meshes queue as soon as it is decoded, so the importer
+ * can start creating components before the rest of the SRC is inflated.
+ * Scratch memory is allocated from an arena belonging to the worker thread,
+ * which is reset between SRCs rather than freed.
+ * A task can be cancelled from any thread. It stops before its next mesh,
+ * or before it starts if it has not, releasing its buffers.
+ * If given a geometry cache entry, a task writes the meshes it decodes to
+ * it. A task without a response reads its meshes from that entry instead,
+ * by mapping the file, so that the SRC is neither downloaded nor decoded.
+ */
+class REPO3D_API RepoSrcDecodeTask
+{
+public:
+	RepoSrcDecodeTask(const FString& InUri, RepoWebResponsePtr InResponse, TArray<uint32>&& InLocalToActorSubmeshMap, TArray<uint8>&& InLocalTranslucency) :
+		Uri(InUri),
+		bSucceeded(false),
+		bGeometryMissing(false),
+		Response(InResponse),
+		LocalToActorSubmeshMap(MoveTemp(InLocalToActorSubmeshMap)),
+		LocalTranslucency(MoveTemp(InLocalTranslucency)),
+		bGeometryCacheable(true)
+	{
+	}
+
+	void SetGeometryCache(TSharedPtr<RepoWebCache, ESPMode::ThreadSafe> InCache, const FString& InKey)
+	{
+		GeometryCache = InCache;
+		GeometryKey = InKey;
+	}
+
+	void DoWork();
+
+	void Cancel()
+	{
+		bCancelled = true;
+	}
+
+	FString Uri;
+	bool bSucceeded; // Only valid once DoWork() has returned
+	bool bGeometryMissing; // Set by DoWork() if the cached geometry could not be opened, in which case there are no meshes
+	TQueue<RepoSrcDecodedMesh, EQueueMode::Spsc> Meshes; // Filled by DoWork(), and drained by the game thread
+	FThreadSafeBool bCancelled;
+	RepoAssetTimeline Timeline; // The decode stages, recorded by DoWork(). Only valid once it has returned.
+
+private:
+	RepoWebResponsePtr Response;
+	TArray<uint32> LocalToActorSubmeshMap;
+	TArray<uint8> LocalTranslucency; // Non-zero for each submesh (by local id) that has a translucent material
+
+	TSharedPtr<RepoWebCache, ESPMode::ThreadSafe> GeometryCache;
+	FString GeometryKey;
+	bool bGeometryCacheable; // Cleared if a mesh was decoded in a way the geometry cache cannot hold
+
+	bool DecodeSrc(const TArray<uint8>& src, RepoSrcArena& arena);
+	bool DecodeMesh(const RepoSrcMesh& src_mesh, RepoSrcDecodedMesh& mesh, RepoSrcArena& arena);
+	bool SplitSections(RepoSrcDecodedMesh& mesh, RepoSrcDecodedSection& whole, const uint8* triangleClasses, int32 numTranslucent, RepoSrcArena& arena);
+	void StoreGeometry(const RepoSrcGeometryWriter& writer);
+	bool ReadGeometry();
+	bool LoadMesh(const RepoSrcGeometryMesh& cached, RepoSrcDecodedMesh& mesh);
+};
@@ -29,6 +29,11 @@
 #include "Json.h"
 #include "RepoWebRequestManager.h"
 #include "RepoWebRequestHelpers.h"
+#include "RepoTypes.h"
+#include "RepoSrcDecodeTask.h"
+#include "RepoMeshBatcher.h"
+#include "Tickable.h"
+#include "Async/Future.h"
 #include "Http.h"
 #include "HttpModule.h"
 #include "RepoSrcImporter.generated.h"
@@ -42,14 +47,39 @@ DECLARE_DELEGATE(RepoSrcImportersCompleted)
  * actually process the files.
  * This class is a UObject as it will handle the lifetime of the actor
  * and materials.
+ * The SRCs are decoded on the task graph. This class ticks on the game thread
+ * to create the components from the decoded meshes, spending at most
+ * UploadBudgetMs per frame doing so.
+ * If a view has been set, the mappings are requested ahead of the SRCs, and
+ * their bounds used to request the SRCs that will cover the most of the
+ * screen first. The priorities of queued SRC requests follow the view as it
+ * changes.
+ * In update mode, only the SRCs that are not already in the actor are
+ * imported, and the assets of the actor that are not in the new revision are
+ * removed once the import completes, so the model is never missing parts
+ * while it loads.
+ * The progress of the import can be queried at any time, and is raised
+ * each frame while it runs (see RepoImportProgress).
+ * With the geometry cache enabled, SRCs whose decoded geometry is in the
+ * cache are loaded from it once their mappings have been handled, rather
+ * than requested and decoded.
+ * An import can be cancelled at any time, which aborts its requests and
+ * decode tasks. If the importer is destroyed while importing, it is cancelled
+ * in the same way, so no callback can reach a destroyed importer.
+ * If the list of SRCs cannot be read, the import fails: it completes at
+ * once, without having imported anything, and the actor is left as it was.
  */
 UCLASS()
-class REPO3D_API URepoSrcImporter : public UObject
+class REPO3D_API URepoSrcImporter : public UObject, public FTickableGameObject
 {
 	GENERATED_BODY()
 
 	TSharedPtr<RepoWebRequestManager> manager;
 	TArray<TSharedRef<class RepoSrcAssetImporter>> importers;
+	TArray<TSharedRef<class RepoSrcAssetImporter>> pendingImporters; // Importers that have not yet issued their requests
+	TArray<TSharedRef<class RepoSrcAssetImporter>> mappedImporters; // Importers whose mapping has arrived, but whose SRC has not been requested
+	int32 numAwaitingSrc; // Importers whose mapping has been requested ahead of their SRC
+	FDelegateHandle backpressureHandle;
 
 	UPROPERTY()
 	ARepoSupermeshActor* actor;
@@ -58,8 +88,57 @@ class REPO3D_API URepoSrcImporter : public UObject
 	UPROPERTY()
 	UMaterialInterface* materialTranslucent;
 
+	float UploadBudgetMs;
+	int32 MergeVertexBudget;
+	bool bGeometryCache;
+	TSharedPtr<RepoMeshBatcher> batcher;
+
+	FString timelineFilename;
+	RepoImportTimeline timeline; // The importers as they complete, if timelineFilename is set
+
+	RepoView View;
+	bool bViewChanged;
+
+	bool bUpdate;
+	TMap<FString, RepoImportedAsset> staleAssets; // Assets taken from the actor that are released when the update completes
+
+	uint64 assetsRequestId;
+	bool bFinished; // Set once the import has completed or been cancelled
+
+	// Progress. The importers count towards these once they complete; until then, they are counted by GetProgress().
+	int32 numAssets;
+	int32 numUploaded;
+	int32 numFailed;
+	int64 assetsBytes; // srcAssets.json
+	int64 completedBytes;
+	int64 completedTriangles;
+	double startTime;
+	double finishTime;
+	TArray<TPair<double, int64>> rateSamples; // BytesDownloaded at each tick over the last RateWindowSeconds
+
+	static constexpr double RateWindowSeconds = 2.0;
+
+	// The number of mappings that are requested ahead of their SRCs when there is a view, to choose the SRCs from
+	static const int32 MappingLookahead = 128;
+
 public:
-	URepoSrcImporter()
+	URepoSrcImporter():
+		numAwaitingSrc(0),
+		UploadBudgetMs(5.0f),
+		MergeVertexBudget(0),
+		bGeometryCache(false),
+		bViewChanged(false),
+		bUpdate(false),
+		assetsRequestId(0),
+		bFinished(false),
+		numAssets(0),
+		numUploaded(0),
+		numFailed(0),
+		assetsBytes(0),
+		completedBytes(0),
+		completedTriangles(0),
+		startTime(0),
+		finishTime(0)
 	{
 	}
 
@@ -83,16 +162,80 @@ public:
 		this->materialOpaque = opaque;
 	}
 
+	// The time in milliseconds the importer may spend creating components on the game thread each frame. At least one mesh is always created per frame.
+	void SetUploadBudget(float milliseconds)
+	{
+		this->UploadBudgetMs = milliseconds;
+	}
+
+	// The maximum number of vertices of the components that the SRC meshes are merged into. If zero, each mesh gets its own component.
+	void SetMergeVertexBudget(int32 vertices)
+	{
+		this->MergeVertexBudget = vertices;
+	}
+
+	// If set, the decoded geometry of the SRCs is stored in, and loaded from, the web manager's cache
+	void SetGeometryCache(bool enabled)
+	{
+		this->bGeometryCache = enabled;
+	}
+
+	// If set, the timeline of every SRC is written to this JSON file when the import completes or is cancelled
+	void SetTimelineFile(FString filename)
+	{
+		this->timelineFilename = filename;
+	}
+
+	// If set, the revision replaces the assets already in the actor, rather than being added to them
+	void SetUpdate(bool update)
+	{
+		this->bUpdate = update;
+	}
+
+	// The view to prioritise the SRCs for. Can be changed at any time, e.g. each frame as the camera moves.
+	void SetView(const RepoView& InView);
+
 	void RequestRevision(FString teamspace, FString model, FString revision);
 
+	// Stops the import, keeping the components created so far. OnCancelled is raised instead of OnComplete.
+	void Cancel();
+
+	bool IsFinished() const
+	{
+		return bFinished;
+	}
+
+	RepoImportProgress GetProgress() const;
+
 	RepoSrcImportersCompleted OnComplete;
+	RepoSrcImportersCompleted OnCancelled;
+
+	// Raised each frame while the import runs, and once more as it completes or is cancelled
+	RepoImportProgressDelegate OnProgress;
 
 	void BeginDestroy() override;
 
+	/** FTickableGameObject implementation */
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableInEditor() const override { return true; }
+	virtual bool IsTickableWhenPaused() const override { return true; }
+	virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(URepoSrcImporter, STATGROUP_Tickables); }
+
 private:
-	void AssetsRequestCompleted(TSharedPtr<RepoWebResponse> Result);
-	void HandleAssets(const FString& string);
+	void AssetsRequestCompleted(RepoWebResponsePtr Result);
+	void HandleAssets(const TArray<uint8>& content);
 	void HandleCompleted(TSharedRef<RepoSrcAssetImporter> importer);
+	void AddToTimeline(TSharedRef<RepoSrcAssetImporter> importer, RepoImportTimeline::Outcome outcome);
+	void HandleAllCompleted();
+	void HandleFailed();
+	void Finish();
+	void TakeStaleAssets(const TMap<FString, FVector>& assets);
+	void RestoreStaleAssets();
+	void CancelRequests();
+	void HandleMappingCompleted(TSharedRef<RepoSrcAssetImporter> importer);
+	void HandleBackpressureChanged(bool backpressured);
+	void RequestPendingSrcs();
 	void HandleModelSettings(TSharedRef<RepoWebRequestHelpers::ModelSettings> Settings);
 };
 
@@ -109,39 +252,63 @@ private:
 	UMaterialInterface* materialOpaque;
 	UMaterialInterface* materialTranslucent;
 
-	TSharedPtr<FJsonObject> header;
-	TSharedPtr<FJsonObject> indexViews;
-	TSharedPtr<FJsonObject> attributeViews;
-	TSharedPtr<FJsonObject> bufferViews;
-	TSharedPtr<FJsonObject> bufferChunks;
-	TSharedPtr<FJsonObject> mappings;
-
-	const uint8* buffer;
-	int numSubmeshes;
 	TArray<uint32> LocalToActorSubmeshMap;
-
-	struct Material
-	{
-		FLinearColor diffuse;
-		FLinearColor specular;
-		float transparency;
-	};
-
-	TMap<FString, Material> mappingMaterials;
-	bool hasTransparency;
-
-	uint32 mappingsRequestTime;
-	uint32 srcRequestTime;
+	TArray<uint8> LocalTranslucency;
+
+	// The responses are held here until both have arrived (see JoinRequests())
+	RepoWebResponsePtr MappingResult;
+	RepoWebResponsePtr SrcResult;
+	bool bMappingHandled;
+	bool bMappingSucceeded;
+	bool bSrcRequested;
+	bool bSrcSent; // Set once the SRC request has left the queue, after which its priority cannot change
+	uint64 MappingRequestId; // Until the responses arrive, otherwise zero
+	uint64 SrcRequestId;
+	FBox MappingBounds; // The bounds of the submeshes in the mapping, relative to the actor
+
+	TSharedPtr<RepoSrcDecodeTask, ESPMode::ThreadSafe> DecodeTask;
+	TFuture<void> DecodeResult;
+	int32 NumMeshesCreated;
+	int64 NumTriangles;
+	int64 BytesReceived;
+	bool bSucceeded;
+	bool bFromCache; // Set if the SRC or its geometry came from the cache
+	RepoAssetTimeline Timeline;
+
+	bool bUseGeometryCache;
+	bool bGeometryCached; // Set when the geometry is to be loaded from the cache instead of the SRC, until it is
+	bool bGeometryCacheFailed; // Set if the cached geometry could not be loaded, so the SRC was requested after all
+	int32 SrcPriority;
+
+	TSharedPtr<RepoMeshBatcher> Batcher;
 
 public:
 	RepoSrcAssetImporter(TSharedPtr<RepoWebRequestManager> manager) :
 		manager(manager),
 		materialOpaque(nullptr),
 		materialTranslucent(nullptr),
+		bMappingHandled(false),
+		bMappingSucceeded(false),
+		bSrcRequested(false),
+		bSrcSent(false),
+		MappingRequestId(0),
+		SrcRequestId(0),
+		MappingBounds(ForceInit),
+		NumMeshesCreated(0),
+		NumTriangles(0),
+		BytesReceived(0),
+		bSucceeded(false),
+		bFromCache(false),
+		bUseGeometryCache(false),
+		bGeometryCached(false),
+		bGeometryCacheFailed(false),
+		SrcPriority(0),
 		Bounds(ForceInit)
 	{
 	}
 
+	~RepoSrcAssetImporter();
+
 	void SetActor(TWeakObjectPtr<ARepoSupermeshActor> Actor)
 	{
 		this->actor = Actor;
@@ -153,18 +320,102 @@ public:
 		this->materialTranslucent = translucent;
 	}
 
+	// If set, the decoded sections are packed by the batcher instead of each mesh getting its own component
+	void SetBatcher(TSharedPtr<RepoMeshBatcher> InBatcher)
+	{
+		this->Batcher = InBatcher;
+	}
+
+	// If set, the decoded geometry is stored in the web manager's cache, and when it is there already, loaded from it
+	// instead of requesting the SRC
+	void SetGeometryCache(bool enabled)
+	{
+		this->bUseGeometryCache = enabled;
+	}
+
 	void SetOffset(FVector v);
 
 	TBaseDelegate<void> OnComplete;
 
+	// Raised once the mapping has been received and handled, whether or not it succeeded
+	TBaseDelegate<void> OnMappingComplete;
+
 	void SetUri(FString uri)
 	{
 		Uri = uri;
 	}
 
-	void RequestSrc();
+	// The mapping and the SRC may be requested together, or the mapping first so that its bounds can decide when to
+	// request the SRC.
+	void RequestMapping();
+	void RequestSrc(int32 priority);
+
+	bool HasMapping() const
+	{
+		return bMappingHandled && bMappingSucceeded;
+	}
+
+	bool IsSrcRequested() const
+	{
+		return bSrcRequested;
+	}
+
+	// True from when the SRC (or its cached geometry) has arrived until its meshes have all been created
+	bool IsDecoding() const
+	{
+		return DecodeTask.IsValid();
+	}
+
+	// Only valid once OnComplete has been raised
+	bool HasSucceeded() const
+	{
+		return bSucceeded;
+	}
+
+	// The size of the mapping and SRC responses received so far
+	int64 GetBytesReceived() const
+	{
+		return BytesReceived;
+	}
+
+	// The triangles of the meshes created so far
+	int64 GetNumTriangles() const
+	{
+		return NumTriangles;
+	}
+
+	bool IsFromCache() const
+	{
+		return bFromCache;
+	}
+
+	// The stages the SRC has been through so far. The decode stages are added once the decode task has finished.
+	const RepoAssetTimeline& GetTimeline() const
+	{
+		return Timeline;
+	}
+
+	// The bounds of the SRC in world space, estimated from its mapping. Invalid until the mapping has been handled.
+	FBox GetMappingBounds() const;
+
+	// Changes the priority of the SRC request, if it has not yet been sent
+	void UpdateSrcPriority(int32 priority);
+
+	// Cancels the requests and the decode task, and releases the responses and any decoded meshes. Neither delegate
+	// will be raised afterwards.
+	void Cancel();
+
+	// True once some of the SRC's meshes have been decoded and are waiting to be created on the game thread, or the
+	// decode has finished.
+	bool IsDecoded() const
+	{
+		return DecodeTask.IsValid() && (!DecodeTask->Meshes.IsEmpty() || DecodeResult.IsReady());
+	}
+
+	// Creates components for the meshes decoded so far until all are created or Deadline (in FPlatformTime::Seconds())
+	// has passed. OnComplete is raised once the decode has finished and the last mesh has been created.
+	void CreateMeshes(double Deadline);
 
-	static void TransformCoordinateSystem(TArray<FVector>& array); // from Unity to Unreal
 	static FVector TransformCoordinateSystem(FVector v);
 
 	FString Uri;
@@ -172,24 +423,13 @@ public:
 	FBox Bounds;
 
 private:
-	void SrcRequestCompleted(TSharedPtr<RepoWebResponse> Result);
-	bool MappingRequestCompleted(TSharedPtr<RepoWebResponse> Result);
-	void HandleMapping(const FString& string);
-	void HandleSrc(const TArray<uint8>& src);
-	void ResolveIndices(const FString& viewName, TArray<int32>& array);
-	template <typename T>
-	void ResolveAttribute(const FString& viewName, TArray<T>& array);
-	void GenerateSupermeshMapIndices(TArray<float>& ids, TArray<FVector2D>& uvs);
-	void GenerateTriangleIdMap(TArray<int>& triangles, TArray<float>& ids, TArray<int>& triangleIdMap);
-
-	FLinearColor ParseJsonColour(const FString& field)
-	{
-		FJsonSerializableArray array;
-		field.ParseIntoArrayWS(array);
-		FLinearColor colour;
-		FDefaultValueHelper::ParseFloat(array[0], colour.R);
-		FDefaultValueHelper::ParseFloat(array[1], colour.G);
-		FDefaultValueHelper::ParseFloat(array[2], colour.B);
-		return colour;
-	}
+	void SrcRequestCompleted(RepoWebResponsePtr Result);
+	void MappingRequestCompleted(RepoWebResponsePtr Result);
+	void JoinRequests();
+	bool HandleMapping(const TArray<uint8>& content);
+	void HandleSrc(RepoWebResponsePtr Result);
+	void CreateMesh(RepoSrcDecodedMesh& decoded);
+	FString GetGeometryCacheKey() const;
+
+	static bool ConvertMappingForCache(const TArray<uint8>& Content, TArray<uint8>& Cached);
 };
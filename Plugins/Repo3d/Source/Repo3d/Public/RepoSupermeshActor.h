@@ -26,6 +26,18 @@
 #include "RepoSupermeshActor.generated.h"
 
 class IAssetTools; // Forward declaration for the static conversion methods. This is not used at runtime.
+class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UPrimitiveComponent;
+
+// An SRC asset that has been imported into an ARepoSupermeshActor. See ARepoSupermeshActor::ImportedAssets.
+struct RepoImportedAsset
+{
+	FVector Offset;
+	TArray<uint32> SubmeshIds; // Indices into the actor's IdMap, each holding a reference
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> Components; // Components built from the SRC. Merged components may be shared with other assets.
+	bool bComplete = false; // False if the import failed or is still in progress
+};
 
 UCLASS()
 class REPO3D_API ARepoSupermeshActor : public AActor, public IRepoTraceable
@@ -39,6 +51,18 @@ class REPO3D_API ARepoSupermeshActor : public AActor, public IRepoTraceable
 	UPROPERTY(AdvancedDisplay)
 	TArray<FString> IdMap;
 
+	// The index of each Id within IdMap. This is not serialised; it is rebuilt from IdMap when the actor is loaded.
+	TMap<FString, int32> IdIndex;
+
+	// Entries of IdMap whose submeshes have been removed (see ReleaseImportedAsset()). They are empty strings, and are
+	// reused by AddSubmeshId() before the map is grown.
+	TArray<int32> FreeSubmeshIds;
+
+	// The number of imported assets that use each entry of IdMap
+	TArray<int32> SubmeshReferences;
+
+	void RebuildSubmeshIndex();
+
 public:
 	UPROPERTY(VisibleAnywhere, Category = "3DRepo Model Data")
 	FString Teamspace;
@@ -56,6 +80,13 @@ public:
 	UPROPERTY(VisibleAnywhere, Category = "3DRepo Supermeshing Data")
 	URepoSupermeshMapComponent* DiffuseMap;
 
+	// The material instances shared by all meshes of this actor. See GetSharedMaterial().
+	UPROPERTY(VisibleAnywhere, Category = "3DRepo Supermeshing Data")
+	UMaterialInstanceDynamic* OpaqueMaterial;
+
+	UPROPERTY(VisibleAnywhere, Category = "3DRepo Supermeshing Data")
+	UMaterialInstanceDynamic* TranslucentMaterial;
+
 public:	
 	// Sets default values for this actor's properties
 	ARepoSupermeshActor();
@@ -73,11 +104,22 @@ public:
 	UTexture2D* ConvertToStaticTexture(UTexture2D* Texture, IAssetTools& AssetTools, UPackage* Package);
 #endif
 
-	TArray<FString>& GetSubmeshMap();
+	const TArray<FString>& GetSubmeshMap();
+
+	// Returns the index of Id in the submesh map, adding it if it is not already present. Id must not be empty, as
+	// empty entries mark the free slots of the map.
+	int32 AddSubmeshId(const FString& Id);
+
+	// Returns the index of Id in the submesh map, or INDEX_NONE.
+	int32 FindSubmeshId(const FString& Id);
 
 	virtual FString GetMeshIdFromFaceIndex(TWeakObjectPtr<class UPrimitiveComponent> Component, int32 FaceIndex);
 	virtual TWeakObjectPtr<ARepoSupermeshActor> GetActor();
 
+	// Returns the dynamic instance of Prototype shared by all the meshes of this actor that use it, creating it (with the
+	// current map textures applied) if necessary. Each actor has one opaque and one translucent instance.
+	UMaterialInstanceDynamic* GetSharedMaterial(UMaterialInterface* Prototype, bool bTranslucent);
+
 	// Sets the Parameter on all Dynamic Materials under this ARepoSupermeshActor. This will operate on both static
 	// and transient types (before and after the conversion to a static hierarchy).
 	void SetMaterialsTextureParameter(FName ParameterName, UTexture* Value);
@@ -88,10 +130,35 @@ public:
 	// distributed to the ARepoStaticSupermeshActors when the scene hierarchy is baked.
 	TMap<UPrimitiveComponent*, TArray<int>> MeshComponentTriangleMaps;
 
+	// The SRC assets that have been imported, by URI, so that a later revision can be imported as an update that only
+	// replaces the assets that have changed (see Repo3d::UpdateModel()). Like MeshComponentTriangleMaps, this only has
+	// to survive as long as the Procedural Meshes.
+	TMap<FString, RepoImportedAsset> ImportedAssets;
+
+	// The offset that the models' offsets are made relative to, set by the first import
+	FVector ImportOrigin;
+	bool bHasImportOrigin = false;
+
+	// Records an asset whose mapping has been handled, taking a reference to each of its submeshes. An asset imported
+	// more than once accumulates the references and components of each import.
+	void AddImportedAsset(const FString& Uri, const FVector& Offset, const TArray<uint32>& SubmeshIds);
+
+	// Records a component that holds geometry of the asset
+	void AddImportedAssetComponent(const FString& Uri, UPrimitiveComponent* Component);
+
+	// Destroys the components of the asset, and releases its submeshes. Submeshes that are no longer used by any asset
+	// are removed from the IdMap, and their indices reused for new Ids.
+	void ReleaseImportedAsset(RepoImportedAsset& Asset);
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void PostLoad() override;
+#if WITH_EDITOR
+	virtual void PostEditUndo() override;
+#endif
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -45,7 +45,29 @@ public:
 	FVector4 GetParameter(FString& Id);
 	FVector4 GetParameter(int Id);
 
+	// Sets many parameters in one pass. Ids are either indices into Actor::GetSubmeshMap(), or the Ids themselves;
+	// unknown Ids are ignored. When given arrays, Ids and Values must be the same length.
+	void SetParameters(const TArray<int32>& Ids, const TArray<FVector4>& Values);
+	void SetParameters(const TArray<FString>& Ids, const TArray<FVector4>& Values);
+	void SetParameters(const TArray<int32>& Ids, FVector4 Value);
+	void SetParameters(const TArray<FString>& Ids, FVector4 Value);
+
+	// Blueprint versions of SetParameters
+	UFUNCTION(BlueprintCallable, Category = "3DRepo Supermeshing Data")
+	void SetParametersByIndex(const TArray<int32>& Indices, const TArray<FLinearColor>& Values);
+
+	UFUNCTION(BlueprintCallable, Category = "3DRepo Supermeshing Data")
+	void SetParametersById(const TArray<FString>& Ids, const TArray<FLinearColor>& Values);
+
+	UFUNCTION(BlueprintCallable, Category = "3DRepo Supermeshing Data")
+	void SetParameterForIndices(const TArray<int32>& Indices, FLinearColor Value);
+
+	UFUNCTION(BlueprintCallable, Category = "3DRepo Supermeshing Data")
+	void SetParameterForIds(const TArray<FString>& Ids, FLinearColor Value);
+
 	// Updates the Texture with the current parameters. At run-time, this will be done automatically on demand.
+	// Only the texels of the parameters that have changed since the last update are uploaded, unless the
+	// Texture has to be (re)created.
 	void UpdateTexture();
 	void ApplyTextureToMaterials();
 	void ApplyTextureToMaterials(UMaterialInstanceDynamic* material);
@@ -53,9 +75,14 @@ public:
 private:
 	void CreateTexture();
 	int GetSupermeshMapSize();
+	void UpdateNumParameters();
+	void WriteAllTexels();
+	void UploadDirtyTexels();
 
 	bool IsMapDirty; // At runtime, if a parameter changes within a frame the texture should be updated. At design time it is assumed the update will be manual.
 
+	TSet<int32> DirtyIds; // The parameters that have changed since the Texture was last updated
+
 #if WITH_EDITOR
 public:
 	// Called when the ARepoSupermeshActor is being transformed to use static types. This method will save the map to an Asset
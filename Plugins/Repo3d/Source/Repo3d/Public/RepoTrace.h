@@ -0,0 +1,154 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(REPO3D_API, Repo3d);
+
+// Times the enclosing scope as a CPU event in Unreal Insights (Repo3d_<Name>), and as a timing stat in the Repo3d
+// category of the CSV profiler. Both compile to nothing when their profilers are disabled.
+#define REPO_TRACE_SCOPE(Name) \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Repo3d_##Name); \
+	CSV_SCOPED_TIMING_STAT(Repo3d, Name)
+
+// As REPO_TRACE_SCOPE, and also adds the scope to the RepoAssetStage Stage of Timeline
+#define REPO_TRACE_STAGE(Timeline, Stage) \
+	REPO_TRACE_SCOPE(Stage); \
+	RepoAssetTimelineScope PREPROCESSOR_JOIN(RepoAssetTimelineScope, __LINE__)(Timeline, RepoAssetStage::Stage)
+
+/*
+ * The stages of the life of one SRC asset, in the order they usually happen.
+ * The decode stages run on a worker, and interleave: each mesh is inflated
+ * and resolved in turn, and the game thread creates the components of the
+ * first meshes while the rest are decoded. CreatingMeshes includes
+ * BindingMaterials and Collision.
+ */
+enum class RepoAssetStage : uint8
+{
+	Mapping,			// From the mapping request being made, to the mapping having been handled
+	Queued,				// The SRC request, waiting in the request manager's queue
+	Waiting,			// From the SRC request being sent to the first byte of the response (DNS, connect and TTFB)
+	Downloading,		// From the first byte of the SRC response to the last
+	LoadingGeometry,	// Reading the cached geometry, in place of the SRC stages from Queued to Resolving
+	ParsingHeader,		// The JSON header of the SRC
+	Inflating,
+	Resolving,			// Resolving the attributes of each mesh, and building its vertices
+	CreatingMeshes,
+	BindingMaterials,
+	Collision,
+	Num
+};
+
+/*
+ * The time an asset spent in each RepoAssetStage. Stages a task goes through
+ * many times, such as inflating each mesh, are merged: Start and End are the
+ * first and last times the asset was in the stage, and Seconds is the sum of
+ * the time spent in it between them.
+ */
+class REPO3D_API RepoAssetTimeline
+{
+public:
+	struct Span
+	{
+		double Start = 0;
+		double End = 0;
+		double Seconds = 0;
+
+		bool IsValid() const
+		{
+			return End > 0;
+		}
+	};
+
+	void Add(RepoAssetStage Stage, double Start, double End);
+
+	// Merges the stages of Other, such as those recorded by a decode task on a worker
+	void Append(const RepoAssetTimeline& Other);
+
+	const Span& Get(RepoAssetStage Stage) const
+	{
+		return Spans[(int32)Stage];
+	}
+
+	// The first and last times of any stage
+	double GetStart() const;
+	double GetEnd() const;
+
+	static const TCHAR* GetStageName(RepoAssetStage Stage);
+
+private:
+	Span Spans[(int32)RepoAssetStage::Num];
+};
+
+class RepoAssetTimelineScope
+{
+public:
+	RepoAssetTimelineScope(RepoAssetTimeline& InTimeline, RepoAssetStage InStage) :
+		Timeline(InTimeline),
+		Stage(InStage),
+		Start(FPlatformTime::Seconds())
+	{
+	}
+
+	~RepoAssetTimelineScope()
+	{
+		Timeline.Add(Stage, Start, FPlatformTime::Seconds());
+	}
+
+private:
+	RepoAssetTimeline& Timeline;
+	RepoAssetStage Stage;
+	double Start;
+};
+
+/*
+ * The timelines of the assets of one import, written to a JSON file so that
+ * the assets that hold up production loads can be found. The assets are
+ * written slowest first, with their times in seconds from the start of the
+ * import.
+ */
+class REPO3D_API RepoImportTimeline
+{
+public:
+	enum class Outcome : uint8
+	{
+		Uploaded,
+		Failed,
+		Cancelled
+	};
+
+	void Add(const FString& Uri, const RepoAssetTimeline& Timeline, Outcome Result, bool bFromCache, int64 Bytes, int64 Triangles);
+
+	bool Write(const FString& Filename, double StartTime, double FinishTime) const;
+
+private:
+	struct Entry
+	{
+		FString Uri;
+		RepoAssetTimeline Timeline;
+		Outcome Result;
+		bool bFromCache;
+		int64 Bytes;
+		int64 Triangles;
+	};
+
+	TArray<Entry> Entries;
+};
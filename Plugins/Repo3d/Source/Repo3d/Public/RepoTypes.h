@@ -34,3 +34,67 @@ public:
 	}
 };
 
+/*
+ * A view that models are loaded for. The importers use it to estimate how
+ * much of the screen each SRC will cover, and download the SRCs that cover
+ * the most first.
+ */
+class REPO3D_API RepoView
+{
+public:
+	RepoView();
+	RepoView(const FVector& InLocation, const FRotator& Rotation, float FovDegrees);
+
+	bool IsValid() const
+	{
+		return bValid;
+	}
+
+	// The approximate fraction of the screen that Bounds (in world space) will cover. Bounds outside the view frustum
+	// are scaled down, so that they are loaded after everything that is in view.
+	float EstimateCoverage(const FBox& Bounds) const;
+
+	// Converts the coverage of Bounds into a request priority, from zero upwards
+	int32 GetPriority(const FBox& Bounds) const;
+
+	bool Equals(const RepoView& Other) const;
+
+	FVector Location;
+	FVector Direction;
+	float HalfFov; // Horizontal, in radians
+
+private:
+	bool bValid;
+};
+
+/*
+ * A snapshot of the progress of a model import. While the import runs, each
+ * of the SRCs it loads is in exactly one of the stages. The stages show what
+ * a slow import is waiting on: SRCs piling up in NumDownloading mean it is
+ * bound by the network, and in NumDecoding, by decoding or by the upload
+ * budget.
+ */
+class REPO3D_API RepoImportProgress
+{
+public:
+	int32 NumAssets = 0;       // The SRCs to load (for an update, those that changed). Zero until srcAssets.json has arrived.
+	int32 NumQueued = 0;       // Not yet requested, as the request manager is busy
+	int32 NumDownloading = 0;  // Requested, including those waiting in the request manager's queue
+	int32 NumDecoding = 0;     // Received, and being decoded or turned into components
+	int32 NumUploaded = 0;     // Finished, with all their meshes handed to components
+	int32 NumFailed = 0;       // Finished, but could not be downloaded or decoded
+
+	int64 BytesDownloaded = 0; // The responses received so far, whether from the server or the cache
+	int64 BytesExpected = 0;   // BytesDownloaded, plus the SRCs not yet received, estimated from those that have been
+	float MegabytesPerSecond = 0; // The rate BytesDownloaded has grown over the last few seconds
+	int64 NumTriangles = 0;    // In the meshes handed to components so far
+	double ElapsedSeconds = 0;
+
+	// The fraction of the SRCs that have finished, from 0 to 1
+	float GetFraction() const;
+
+	// Extrapolated from the rate SRCs have finished so far. Negative until the first has.
+	double GetEstimatedSecondsRemaining() const;
+};
+
+DECLARE_DELEGATE_OneParam(RepoImportProgressDelegate, const RepoImportProgress&);
@@ -0,0 +1,117 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Async/MappedFileHandle.h"
+
+/*
+ * A RepoWebCache entry mapped into memory, or read into it where the platform
+ * cannot map files. The data stays valid for as long as the instance exists.
+ */
+class REPO3D_API RepoMappedCacheEntry
+{
+public:
+	const uint8* GetData() const
+	{
+		return Region ? Region->GetMappedPtr() : Content.GetData();
+	}
+
+	int64 GetSize() const
+	{
+		return Region ? Region->GetMappedSize() : Content.Num();
+	}
+
+private:
+	friend class RepoWebCache;
+
+	// Declared in this order so that the region is unmapped before the file is closed
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+	TArray<uint8> Content;
+};
+
+/*
+ * RepoWebCache is a persistent, size-capped cache of web responses on the
+ * local disk. Entries are stored in files named by the SHA1 of their key,
+ * and hold a copy of the key and the SHA1 of the content, which are checked
+ * on every read. When the total size exceeds the cap, the least recently
+ * used entries are evicted.
+ * Only responses that can never change (such as the assets of a specific
+ * revision) should be stored.
+ * Content derived from responses, which is loaded by mapping it rather
+ * than reading it, can be stored as raw entries (see WriteRaw()). These are
+ * not hashed, so their content must be checked by whoever maps it.
+ * All methods are thread-safe, and Read and Write are expected to be called
+ * from worker threads.
+ */
+class REPO3D_API RepoWebCache
+{
+public:
+	RepoWebCache(const FString& Directory, int64 MaxSize);
+
+	// Returns true and fills Content if there is a valid entry for Key. Corrupt entries are deleted.
+	bool Read(const FString& Key, TArray<uint8>& Content);
+
+	void Write(const FString& Key, const TArray<uint8>& Content);
+
+	// Stores Content as the whole of the entry's file, so that it can be mapped with OpenMapped()
+	void WriteRaw(const FString& Key, const TArray<uint8>& Content);
+
+	// Maps the raw entry for Key. Returns null if there is none.
+	TSharedPtr<RepoMappedCacheEntry, ESPMode::ThreadSafe> OpenMapped(const FString& Key);
+
+	// Whether there is an entry for Key. It may still be evicted before it is read.
+	bool Contains(const FString& Key);
+
+	// Removes the entry for Key, such as one whose content was found to be corrupt
+	void Invalidate(const FString& Key);
+
+	void SetMaxSize(int64 Size);
+
+	FString GetDirectory() const
+	{
+		return Directory;
+	}
+
+private:
+	struct Entry
+	{
+		int64 Size;
+		FDateTime LastAccess;
+	};
+
+	FCriticalSection Lock;
+	TMap<FString, Entry> Entries; // Keyed by the filename
+	int64 TotalSize;
+	int64 MaxSize;
+	bool bScanned;
+	FString Directory;
+
+	FString GetFilename(const FString& Key) const;
+
+	// Writes an entry through a temporary file, with the content written by Serialize
+	void Store(const FString& Key, TFunctionRef<void(FArchive& Writer)> Serialize);
+
+	// These must be called with Lock held
+	void Scan();
+	void Evict();
+	void Remove(const FString& Filename);
+	void Touch(const FString& Filename);
+};
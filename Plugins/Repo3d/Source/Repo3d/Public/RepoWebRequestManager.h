@@ -20,29 +20,84 @@
 #include "CoreMinimal.h"
 #include "Http.h"
 #include "HttpModule.h"
+#include "Misc/Paths.h"
+#include "RepoWebCache.h"
 
-class RepoWebResponse
+/*
+ * The result of a RepoWebRequest. The response may have come from the network
+ * or from the RepoWebCache, so clients should use the accessors rather than the
+ * Http Response directly.
+ */
+class REPO3D_API RepoWebResponse
 {
 public:
 	FHttpRequestPtr Request;
 	FHttpResponsePtr Response;
 	bool bWasSuccessful;
+	bool bFromCache = false;
 	uint32 Time;
+
+	// The life of the request, in FPlatformTime::Seconds(). For a response from the cache, SentTime is when the cache
+	// read began, and FirstByteTime is when it completed. The first byte is noticed when the Http module next reports
+	// progress, so it is only as precise as the frame rate.
+	double QueuedTime = 0;
+	double SentTime = 0;
+	double FirstByteTime = 0;
+	double CompletedTime = 0;
+
+	FString Uri;
+	TArray<uint8> CachedContent;
+
+	int32 GetResponseCode() const;
+	const TArray<uint8>& GetContent() const;
+	FString GetContentAsString() const;
+	FString GetURL() const;
 };
 
-DECLARE_DELEGATE_OneParam(RepoWebRequestDelegate, TSharedPtr<RepoWebResponse>);
+// Responses are reference counted thread-safely, as they may be handed to worker threads for decoding
+typedef TSharedPtr<RepoWebResponse, ESPMode::ThreadSafe> RepoWebResponsePtr;
+
+DECLARE_DELEGATE_OneParam(RepoWebRequestDelegate, RepoWebResponsePtr);
+
+// Converts the content of a response into the form it is stored in the RepoWebCache, such as a form that is quicker
+// to load. Called on a worker thread. Returns false to store the content as it is.
+typedef TFunction<bool(const TArray<uint8>& Content, TArray<uint8>& Cached)> RepoWebCacheTransform;
+
+// Raised with true when the manager's queue becomes full, and false when it has room again.
+DECLARE_MULTICAST_DELEGATE_OneParam(RepoWebRequestBackpressureDelegate, bool);
 
 class RepoWebRequest
 {
 public:
 	FString uri;
 	RepoWebRequestDelegate callback;
+	uint64 id = 0;			// Identifies the request to SetPriority()
+	int32 priority = 0;		// Requests with a higher priority are sent first
+	uint64 sequence = 0;	// Requests with the same priority are sent in the order they were made
+	bool cacheable = false;	// Whether the response will never change, and so can be stored in and served from the RepoWebCache
+	bool cacheChecked = false;
+	RepoWebCacheTransform cacheTransform;
+	double queuedTime = 0;	// When the request was made
 };
 
 class Repo3d;
 class RepoWebRequestHelpers;
 
-class REPO3D_API RepoWebRequestManager
+/*
+ * RepoWebRequestManager sends requests to the 3D Repo Web API. Requests are
+ * held until the host has been configured, and then scheduled so that no
+ * more than MaxConcurrentRequests are in flight at once. The remainder wait
+ * in a priority queue. Clients that issue many requests should watch
+ * IsBackpressured() or OnBackpressureChanged, and hold back new requests
+ * while the queue is full. The priority of a request can be changed until
+ * it is sent. Requests can be cancelled at any point; the callback of a
+ * cancelled request is never raised.
+ * Cacheable requests are looked up in the cache first, if one has been set.
+ * No more than MaxConcurrentCacheReads are read at once; the remainder wait
+ * in a second priority queue, and count towards the backpressure threshold
+ * as the network queue does.
+ */
+class REPO3D_API RepoWebRequestManager : public TSharedFromThis<RepoWebRequestManager>
 {
 	friend class RepoWebRequestHelpers;
 public:
@@ -50,6 +105,16 @@ public:
 		:Owner(owner) // the Repo3D instance owns the manager, so the manager will go away before the repo instance
 	{
 		State = Status::None;
+		MaxConcurrentRequests = 8;
+		BackpressureThreshold = 64;
+		NumInFlight = 0;
+		NextSequence = 0;
+		NextId = 1;
+		MaxConcurrentCacheReads = 8;
+		NumCacheReads = 0;
+		bQueueOrderChanged = false;
+		bCacheQueueOrderChanged = false;
+		bBackpressured = false;
 	}
 
 	enum Status {
@@ -59,10 +124,54 @@ public:
 		NotSupported = -1
 	};
 
-	void GetRequest(FString uri, RepoWebRequestDelegate callback);
+	// Returns an id that can be passed to SetPriority() and CancelRequest(). Cacheable responses are stored as they are
+	// received, or as converted by cacheTransform, if given. Responses served from the cache are in the stored form.
+	uint64 GetRequest(FString uri, RepoWebRequestDelegate callback, int32 priority = 0, bool cacheable = false, RepoWebCacheTransform cacheTransform = RepoWebCacheTransform());
+
+	// Changes the priority of a request that has not yet been sent. Returns false if it has been sent already.
+	bool SetPriority(uint64 id, int32 priority);
+
+	// Removes a request from the queue, or aborts it if it is in flight. Returns false if the request has completed.
+	bool CancelRequest(uint64 id);
 	void SetHost(FString host);
 	void SetApiKey(FString apikey);
 
+	// The maximum number of requests that will be sent to the server at once
+	void SetMaxConcurrentRequests(int32 max);
+
+	// The number of queued requests at which the manager reports backpressure
+	void SetBackpressureThreshold(int32 threshold);
+
+	int32 GetNumQueued() const
+	{
+		return Queue.Num() + CacheQueue.Num();
+	}
+
+	int32 GetNumInFlight() const
+	{
+		return NumInFlight;
+	}
+
+	bool IsBackpressured() const
+	{
+		return bBackpressured;
+	}
+
+	RepoWebRequestBackpressureDelegate OnBackpressureChanged;
+
+	// Cacheable requests will be served from the disk cache when possible. The cache is disabled until this is called.
+	// Pass an empty directory to disable it again.
+	void SetCache(FString directory, int64 maxSizeBytes);
+
+	// The disk cache, or null if it is disabled. Clients may store content derived from responses in it too, under
+	// keys made with GetCacheKey().
+	TSharedPtr<RepoWebCache, ESPMode::ThreadSafe> GetCache() const
+	{
+		return Cache;
+	}
+
+	FString GetCacheKey(const FString& uri) const;
+
 	Status GetState()
 	{
 		return State;
@@ -81,12 +190,44 @@ private:
 	// Pending requests. New requests will be held here until the manager is authenticated.
 	TArray<RepoWebRequest> Requests; 
 
+	// Requests waiting for a free slot, stored as a heap ordered by priority, then sequence.
+	TArray<RepoWebRequest> Queue;
+
+	// Cacheable requests waiting for a cache read, stored as Queue is
+	TArray<RepoWebRequest> CacheQueue;
+
+	// The priorities of requests that are being looked up in the cache, and so are in none of the arrays
+	TMap<uint64, int32> CacheReads;
+
+	// The requests that have been sent, so that they can be cancelled
+	TMap<uint64, FHttpRequestPtr> InFlight;
+
+	int32 MaxConcurrentRequests;
+	int32 BackpressureThreshold;
+	int32 NumInFlight;
+	int32 MaxConcurrentCacheReads;
+	int32 NumCacheReads; // Reads on the thread pool, including those of requests cancelled since they started
+	uint64 NextSequence;
+	uint64 NextId;
+	bool bQueueOrderChanged; // Set when SetPriority() has changed a request in the Queue, which must be re-heaped
+	bool bCacheQueueOrderChanged; // As bQueueOrderChanged, for the CacheQueue
+	bool bBackpressured;
+
 	Status State;
 
 	FString Host;
 	FString ApiKey;
 
+	TSharedPtr<RepoWebCache, ESPMode::ThreadSafe> Cache;
+
 	void GetRequest(RepoWebRequest Request);
+	void ReadFromCache(RepoWebRequest Request);
+	void ReadFromCacheCompleted(RepoWebRequest Request, bool bHit, TArray<uint8>&& Content, double ReadStartTime, double ReadEndTime);
 	void GetRequestSync(RepoWebRequest Request);
 	void UpdateState(Status newState);
+
+	// Sends queued requests until the queue is empty or the maximum number of requests are in flight, and starts the
+	// reads of the cache queue likewise
+	void ProcessQueue();
+	void UpdateStats();
 };
\ No newline at end of file
@@ -67,6 +67,9 @@ public class Repo3d : ModuleRules
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
+
+		// The SRC decoder (Private/Decoder) calls zlib directly, so that it can also be built outside of the engine
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
 		
 		
 		DynamicallyLoadedModuleNames.AddRange(
@@ -0,0 +1,265 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RepoKernelBenchmark compares the vectorised RepoSrcKernels with the scalar
+ * reference implementations on synthetic streams, and checks that they
+ * produce identical output.
+ *
+ * Usage: RepoKernelBenchmark [--vertices N] [--iterations N] [--run-length N]
+ *
+ * The streams are laid out as an SRC mesh would be: packed float3 positions,
+ * packed float2 texture coordinates, uint16 indices, and ids in runs of
+ * --run-length vertices (one object each). The interleaved kernels write
+ * them into a buffer of vertices laid out as the engine's FProcMeshVertex.
+ * The defaults are 10,000,000 vertices, 10 iterations and runs of 200.
+ */
+
+#include "Decoder/RepoSrcDecoder.h"
+#include "Decoder/RepoSrcKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// The same layout as the engine's FProcMeshVertex, which the plugin decodes the vertices into
+struct ProcMeshVertex
+{
+	float Position[3] = { 0, 0, 0 };
+	float Normal[3] = { 0, 0, 1 };
+	float TangentX[3] = { 1, 0, 0 };
+	bool bFlipTangentY = false;
+	uint8_t Color[4] = { 255, 255, 255, 255 };
+	float UV0[2] = { 0, 0 };
+	float UV1[2] = { 0, 0 };
+	float UV2[2] = { 0, 0 };
+	float UV3[2] = { 0, 0 };
+};
+
+typedef std::chrono::steady_clock Clock;
+
+struct Streams
+{
+	std::vector<uint16_t> Indices16;
+	std::vector<float> Positions;
+	std::vector<float> Texcoords;
+	std::vector<float> Ids;
+	std::vector<int32_t> Indices; // Widened, for the triangle id map
+	std::vector<uint32_t> LocalToActor;
+};
+
+static void Generate(Streams& s, size_t NumVertices, size_t RunLength)
+{
+	std::mt19937 Random(1);
+	std::uniform_real_distribution<float> Coordinate(-1000.0f, 1000.0f);
+
+	s.Positions.resize(NumVertices * 3);
+	for (auto& p : s.Positions)
+	{
+		p = Coordinate(Random);
+	}
+
+	s.Texcoords.resize(NumVertices * 2);
+	for (auto& t : s.Texcoords)
+	{
+		t = Coordinate(Random) / 1000.0f;
+	}
+
+	// Each object is RunLength consecutive vertices, and its triangles only reference its own vertices
+
+	auto NumObjects = (NumVertices + RunLength - 1) / RunLength;
+	s.Ids.resize(NumVertices);
+	for (size_t i = 0; i < NumVertices; i++)
+	{
+		s.Ids[i] = (float)(i / RunLength);
+	}
+
+	s.LocalToActor.resize(NumObjects);
+	for (size_t i = 0; i < NumObjects; i++)
+	{
+		s.LocalToActor[i] = (uint32_t)(NumObjects - i); // Not the identity, so a wrong lookup is caught
+	}
+
+	s.Indices16.resize(NumVertices * 2); // Roughly two triangles per vertex, as in a closed mesh
+	s.Indices.resize(s.Indices16.size());
+	for (size_t t = 0; t < s.Indices.size() / 3; t++)
+	{
+		auto First = std::min(t / 2, NumVertices - 1) / RunLength * RunLength;
+		auto Count = std::min(RunLength, NumVertices - First);
+		for (size_t k = 0; k < 3; k++)
+		{
+			auto Index = First + Random() % Count;
+			s.Indices[t * 3 + k] = (int32_t)Index;
+			s.Indices16[t * 3 + k] = (uint16_t)Index;
+		}
+	}
+}
+
+template<typename F>
+static double Time(int Iterations, F&& Kernel)
+{
+	Kernel(); // Warm-up, which also faults in the output pages
+	auto Start = Clock::now();
+	for (int i = 0; i < Iterations; i++)
+	{
+		Kernel();
+	}
+	return std::chrono::duration<double>(Clock::now() - Start).count() * 1000.0 / Iterations;
+}
+
+static bool bAllMatched = true;
+
+static void Report(const char* Name, double ScalarMs, double VectorMs, size_t Bytes, bool bMatched)
+{
+	printf("%-24s %10.3f %10.3f %10.1f %9.2fx %s\n", Name, ScalarMs, VectorMs, Bytes / 1e6 / (VectorMs / 1000.0), ScalarMs / VectorMs, bMatched ? "" : "MISMATCH");
+	bAllMatched &= bMatched;
+}
+
+int main(int argc, char** argv)
+{
+	size_t NumVertices = 10000000;
+	size_t RunLength = 200;
+	int Iterations = 10;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--vertices") == 0 && i + 1 < argc)
+		{
+			NumVertices = std::max(1L, atol(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			Iterations = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--run-length") == 0 && i + 1 < argc)
+		{
+			RunLength = std::max(1L, atol(argv[++i]));
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--vertices N] [--iterations N] [--run-length N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	Streams s;
+	Generate(s, NumVertices, RunLength);
+
+	printf("%zu vertices, %zu triangles, runs of %zu, %d iterations, %s\n\n", NumVertices, s.Indices.size() / 3, RunLength, Iterations, RepoSrcKernels::GetInstructionSet());
+	printf("%-24s %10s %10s %10s %10s\n", "kernel", "scalar ms", "vector ms", "MB/s", "speed-up");
+
+	{
+		RepoSrcStream Stream;
+		Stream.Data = (const uint8_t*)s.Indices16.data();
+		Stream.Count = (uint32_t)s.Indices16.size();
+		Stream.Stride = sizeof(uint16_t);
+		Stream.ComponentType = RepoSrcDecoder::ComponentTypeUInt16;
+
+		std::vector<int32_t> Scalar(Stream.Count), Vector(Stream.Count);
+		auto ScalarMs = Time(Iterations, [&]() { RepoSrcScalarKernels::WidenIndices(Stream, Scalar.data()); });
+		auto VectorMs = Time(Iterations, [&]() { RepoSrcKernels::WidenIndices(Stream, Vector.data()); });
+		Report("widen indices", ScalarMs, VectorMs, Stream.Count * sizeof(uint16_t), Scalar == Vector);
+	}
+
+	{
+		std::vector<int32_t> Indices(s.Indices);
+		bool bScalar = true, bVector = true;
+		auto ScalarMs = Time(Iterations, [&]() { bScalar &= RepoSrcScalarKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices); });
+		auto VectorMs = Time(Iterations, [&]() { bVector &= RepoSrcKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices); });
+
+		// Both must also reject an index past the end, and a negative one (a uint32 index too large for an int32)
+		Indices[Indices.size() / 2] = (int32_t)NumVertices;
+		auto bRejected = !RepoSrcScalarKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices) && !RepoSrcKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices);
+		Indices[Indices.size() / 2] = -1;
+		bRejected &= !RepoSrcScalarKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices) && !RepoSrcKernels::CheckIndices(Indices.data(), Indices.size(), NumVertices);
+		Report("check indices", ScalarMs, VectorMs, Indices.size() * sizeof(int32_t), bScalar && bVector && bRejected);
+	}
+
+	{
+		RepoSrcStream Stream;
+		Stream.Data = (const uint8_t*)s.Positions.data();
+		Stream.Count = (uint32_t)NumVertices;
+		Stream.Stride = sizeof(float) * 3;
+		Stream.ComponentType = RepoSrcDecoder::ComponentTypeFloat;
+
+		std::vector<float> Scalar(NumVertices * 3), Vector(NumVertices * 3);
+		auto ScalarMs = Time(Iterations, [&]() { RepoSrcScalarKernels::UnityToUnreal(Stream, Scalar.data()); });
+		auto VectorMs = Time(Iterations, [&]() { RepoSrcKernels::UnityToUnreal(Stream, Vector.data()); });
+		auto bMatched = memcmp(Scalar.data(), Vector.data(), Scalar.size() * sizeof(float)) == 0; // Bitwise, so the signs of zeros are compared too
+		Report("unity to unreal", ScalarMs, VectorMs, NumVertices * 12, bMatched);
+	}
+
+	{
+		std::vector<float> Scalar(NumVertices * 2), Vector(NumVertices * 2);
+		bool bScalar = true, bVector = true;
+		auto ScalarMs = Time(Iterations, [&]() { bScalar &= RepoSrcScalarKernels::GenerateSupermeshMapIndices(s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), Scalar.data()); });
+		auto VectorMs = Time(Iterations, [&]() { bVector &= RepoSrcKernels::GenerateSupermeshMapIndices(s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), Vector.data()); });
+		Report("supermesh map indices", ScalarMs, VectorMs, NumVertices * sizeof(float), bScalar && bVector && Scalar == Vector);
+	}
+
+	{
+		auto NumTriangles = s.Indices.size() / 3;
+		std::vector<int32_t> Scalar(NumTriangles), Vector(NumTriangles);
+		bool bScalar = true, bVector = true;
+		auto ScalarMs = Time(Iterations, [&]() { bScalar &= RepoSrcScalarKernels::GenerateTriangleIdMap(s.Indices.data(), s.Indices.size(), s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), Scalar.data()); });
+		auto VectorMs = Time(Iterations, [&]() { bVector &= RepoSrcKernels::GenerateTriangleIdMap(s.Indices.data(), s.Indices.size(), s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), Vector.data()); });
+		Report("triangle id map", ScalarMs, VectorMs, s.Indices.size() * sizeof(int32_t), bScalar && bVector && Scalar == Vector);
+	}
+
+	{
+		// The interleaved kernels write the fields of the same vertex buffers, so each is compared in full after all of
+		// them have run
+
+		std::vector<ProcMeshVertex> Scalar(NumVertices), Vector(NumVertices);
+		auto ScalarData = (uint8_t*)Scalar.data();
+		auto VectorData = (uint8_t*)Vector.data();
+		auto Matches = [&]() { return memcmp(ScalarData, VectorData, NumVertices * sizeof(ProcMeshVertex)) == 0; };
+
+		RepoSrcStream Positions;
+		Positions.Data = (const uint8_t*)s.Positions.data();
+		Positions.Count = (uint32_t)NumVertices;
+		Positions.Stride = sizeof(float) * 3;
+		Positions.ComponentType = RepoSrcDecoder::ComponentTypeFloat;
+
+		// The bounds are compared by value, as NEON combines its lanes at the end, and so may pick either zero
+		float ScalarBounds[6], VectorBounds[6];
+		auto ScalarMs = Time(Iterations, [&]() { RepoSrcScalarKernels::UnityToUnrealInterleaved(Positions, ScalarData + offsetof(ProcMeshVertex, Position), sizeof(ProcMeshVertex), ScalarBounds); });
+		auto VectorMs = Time(Iterations, [&]() { RepoSrcKernels::UnityToUnrealInterleaved(Positions, VectorData + offsetof(ProcMeshVertex, Position), sizeof(ProcMeshVertex), VectorBounds); });
+		Report("interleaved positions", ScalarMs, VectorMs, NumVertices * 12, Matches() && std::equal(ScalarBounds, ScalarBounds + 6, VectorBounds));
+
+		RepoSrcStream Texcoords;
+		Texcoords.Data = (const uint8_t*)s.Texcoords.data();
+		Texcoords.Count = (uint32_t)NumVertices;
+		Texcoords.Stride = sizeof(float) * 2;
+		Texcoords.ComponentType = RepoSrcDecoder::ComponentTypeFloat;
+
+		ScalarMs = Time(Iterations, [&]() { RepoSrcScalarKernels::CopyFloatsInterleaved(Texcoords, 2, ScalarData + offsetof(ProcMeshVertex, UV0), sizeof(ProcMeshVertex)); });
+		VectorMs = Time(Iterations, [&]() { RepoSrcKernels::CopyFloatsInterleaved(Texcoords, 2, VectorData + offsetof(ProcMeshVertex, UV0), sizeof(ProcMeshVertex)); });
+		Report("interleaved texcoords", ScalarMs, VectorMs, NumVertices * 8, Matches());
+
+		bool bScalar = true, bVector = true;
+		ScalarMs = Time(Iterations, [&]() { bScalar &= RepoSrcScalarKernels::GenerateSupermeshMapIndicesInterleaved(s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), ScalarData + offsetof(ProcMeshVertex, UV1), sizeof(ProcMeshVertex)); });
+		VectorMs = Time(Iterations, [&]() { bVector &= RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(s.Ids.data(), NumVertices, s.LocalToActor.data(), s.LocalToActor.size(), VectorData + offsetof(ProcMeshVertex, UV1), sizeof(ProcMeshVertex)); });
+		Report("interleaved map indices", ScalarMs, VectorMs, NumVertices * sizeof(float), bScalar && bVector && Matches());
+	}
+
+	return bAllMatched ? 0 : 1;
+}
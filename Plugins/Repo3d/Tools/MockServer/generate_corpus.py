@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+#
+#  Copyright (C) 2020 3D Repo Ltd
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU Affero General Public License as
+#  published by the Free Software Foundation, either version 3 of the
+#  License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Affero General Public License for more details.
+#
+#  You should have received a copy of the GNU Affero General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Writes a synthetic 3D Repo model for load testing the plugin offline.
+
+The output folder mirrors the routes under /api/ that the plugin requests,
+so it can be served as-is by mock_server.py:
+
+  <teamspace>/<model>.json                                  model settings
+  <teamspace>/<model>/revision/<revision>/srcAssets.json    asset list
+  <teamspace>/<model>/revision/master/head/srcAssets.json
+  <teamspace>/<model>/<asset>.json.mpc                      supermesh mapping
+  <teamspace>/<model>/<asset>.src.mpc                       supermesh geometry
+
+Each object is a box, subdivided so that it has the requested number of
+vertices, placed at random within the model's bounds. Objects are packed
+into the meshes of each SRC so that no mesh exceeds 65535 vertices, as the
+SRC indices are uint16 by default. With --uint32-indices, meshes may be up
+to --max-vertices-per-mesh. With --chunk-size, each bufferView is split into
+chunks of at most that many bytes.
+
+Example (12,000 objects, 20% of them transparent):
+
+  generate_corpus.py --out corpus --assets 24 --objects-per-asset 500 \
+      --materials 32 --transparent-fraction 0.2
+"""
+
+import argparse
+import array
+import json
+import math
+import os
+import random
+import struct
+import sys
+import uuid
+import zlib
+
+SRC_MAGIC_UNCOMPRESSED = 23
+SRC_MAGIC_COMPRESSED = 24
+SRC_VERSION = 42
+COMPONENT_TYPE_UINT16 = 5123
+COMPONENT_TYPE_UINT32 = 5125
+COMPONENT_TYPE_FLOAT = 5126
+MAX_VERTICES_PER_MESH = 65535
+
+
+def box(subdivisions):
+    """Returns the positions, normals, texcoords and indices of a unit box centred on the origin."""
+
+    positions = []
+    normals = []
+    texcoords = []
+    indices = []
+
+    steps = subdivisions + 1
+    faces = [
+        ((1, 0, 0), (0, 1, 0), (0, 0, 1)),
+        ((-1, 0, 0), (0, 0, 1), (0, 1, 0)),
+        ((0, 1, 0), (0, 0, 1), (1, 0, 0)),
+        ((0, -1, 0), (1, 0, 0), (0, 0, 1)),
+        ((0, 0, 1), (1, 0, 0), (0, 1, 0)),
+        ((0, 0, -1), (0, 1, 0), (1, 0, 0)),
+    ]
+
+    for normal, u, v in faces:
+        base = len(positions)
+        for j in range(steps + 1):
+            for i in range(steps + 1):
+                s = i / steps
+                t = j / steps
+                positions.append(tuple(0.5 * normal[k] + (s - 0.5) * u[k] + (t - 0.5) * v[k] for k in range(3)))
+                normals.append(normal)
+                texcoords.append((s, t))
+        for j in range(steps):
+            for i in range(steps):
+                a = base + j * (steps + 1) + i
+                b = a + 1
+                c = a + steps + 1
+                d = c + 1
+                indices.extend((a, b, d, a, d, c))
+
+    return positions, normals, texcoords, indices
+
+
+class SrcWriter:
+    """Builds the header and buffer of one SRC file."""
+
+    def __init__(self, uint32_indices=False, chunk_size=0):
+        self.uint32_indices = uint32_indices
+        self.chunk_size = chunk_size
+        self.header = {
+            "meshes": {},
+            "accessors": {"indexViews": {}, "attributeViews": {}},
+            "bufferViews": {},
+            "bufferChunks": {},
+        }
+        self.buffer = bytearray()
+
+    def add_view(self, name, data):
+        # Chunks are padded to 4 bytes, so a view made of several chunks is not necessarily contiguous
+        size = self.chunk_size if self.chunk_size > 0 else max(1, len(data))
+        chunks = []
+        for i, first in enumerate(range(0, max(1, len(data)), size)):
+            while len(self.buffer) % 4:
+                self.buffer.append(0)
+            chunk = "%s_%d" % (name, i)
+            part = data[first:first + size]
+            self.header["bufferChunks"][chunk] = {"byteOffset": len(self.buffer), "byteLength": len(part)}
+            self.buffer += part
+            chunks.append(chunk)
+        self.header["bufferViews"][name] = {"chunks": chunks}
+
+    def add_mesh(self, name, positions, normals, texcoords, ids, indices):
+        accessors = self.header["accessors"]
+
+        data = array.array("I" if self.uint32_indices else "H", indices).tobytes()
+        self.add_view(name + "_indices", data)
+        accessors["indexViews"][name + "_indices"] = {
+            "bufferView": name + "_indices",
+            "byteOffset": 0,
+            "componentType": COMPONENT_TYPE_UINT32 if self.uint32_indices else COMPONENT_TYPE_UINT16,
+            "count": len(indices),
+        }
+
+        attributes = {}
+        for attribute, values, components, kind in (
+                ("position", positions, 3, "VEC3"),
+                ("normal", normals, 3, "VEC3"),
+                ("texcoord", texcoords, 2, "VEC2"),
+                ("id", ids, 1, "SCALAR")):
+            view = "%s_%s" % (name, attribute)
+            data = array.array("f", values).tobytes()
+            self.add_view(view, data)
+            accessors["attributeViews"][view] = {
+                "bufferView": view,
+                "byteOffset": 0,
+                "byteStride": components * 4,
+                "componentType": COMPONENT_TYPE_FLOAT,
+                "type": kind,
+                "count": len(values) // components,
+                "decodeOffset": [0.0] * components,
+                "decodeScale": [1.0] * components,
+            }
+            attributes[attribute] = view
+
+        self.header["meshes"][name] = {"indices": name + "_indices", "attributes": attributes, "primitive": 4}
+
+    def write(self, path, compressed):
+        header = json.dumps(self.header, separators=(",", ":")).encode("utf-8")
+        if compressed:
+            body = struct.pack("<I", len(self.buffer)) + zlib.compress(bytes(self.buffer))
+            magic = SRC_MAGIC_COMPRESSED
+        else:
+            body = bytes(self.buffer)
+            magic = SRC_MAGIC_UNCOMPRESSED
+        with open(path, "wb") as f:
+            f.write(struct.pack("<III", magic, SRC_VERSION, len(header)))
+            f.write(header)
+            f.write(body)
+        return 12 + len(header) + len(body)
+
+
+def colour(rng):
+    return "%.3f %.3f %.3f" % (rng.random(), rng.random(), rng.random())
+
+
+def generate_asset(args, rng, directory, asset, materials, template, extent):
+    positions, normals, texcoords, indices = template
+    vertices_per_object = len(positions)
+    max_vertices = args.max_vertices_per_mesh if args.uint32_indices else MAX_VERTICES_PER_MESH
+    objects_per_mesh = max(1, max_vertices // vertices_per_object)
+
+    mapping = []
+    src = SrcWriter(args.uint32_indices, args.chunk_size)
+
+    objects = list(range(args.objects_per_asset))
+    for mesh_index, first in enumerate(range(0, len(objects), objects_per_mesh)):
+        mesh_positions = []
+        mesh_normals = []
+        mesh_texcoords = []
+        mesh_ids = []
+        mesh_indices = []
+
+        for local_id in objects[first:first + objects_per_mesh]:
+            centre = [rng.uniform(-extent, extent) for _ in range(3)]
+            size = [rng.uniform(args.min_object_size, args.max_object_size) for _ in range(3)]
+            base = len(mesh_ids)
+            for p in positions:
+                mesh_positions.extend(centre[k] + p[k] * size[k] for k in range(3))
+            for n in normals:
+                mesh_normals.extend(n)
+            for t in texcoords:
+                mesh_texcoords.extend(t)
+            mesh_ids.extend([float(local_id)] * vertices_per_object)
+            mesh_indices.extend(base + i for i in indices)
+
+            material = rng.choice(materials)
+            lo = [centre[k] - size[k] * 0.5 for k in range(3)]
+            hi = [centre[k] + size[k] * 0.5 for k in range(3)]
+            mapping.append({
+                "name": "object_%d" % local_id,
+                "sharedID": str(uuid.UUID(int=rng.getrandbits(128))),
+                "Name": str(uuid.UUID(int=rng.getrandbits(128))),  # In the .json.mpc format, Name is the id
+                "appearance": material["name"],
+                "min": lo,
+                "max": hi,
+                "usage": ["%s_%d" % (asset, mesh_index)],
+            })
+
+        src.add_mesh("%s_%d" % (asset, mesh_index), mesh_positions, mesh_normals, mesh_texcoords, mesh_ids, mesh_indices)
+
+    used = {m["appearance"] for m in mapping}
+    document = {
+        "numberOfIDs": len(mapping),
+        "maxGeoCount": objects_per_mesh * vertices_per_object,
+        "mapping": mapping,
+        "appearance": [m for m in materials if m["name"] in used],
+    }
+    with open(os.path.join(directory, asset + ".json.mpc"), "w") as f:
+        json.dump(document, f, separators=(",", ":"))
+
+    compressed = rng.random() < args.compressed_fraction
+    size = src.write(os.path.join(directory, asset + ".src.mpc"), compressed)
+    return size, compressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--out", required=True, help="Folder to write the corpus to")
+    parser.add_argument("--teamspace", default="loadtest")
+    parser.add_argument("--models", type=int, default=1, help="Number of models (each a separate srcAssets.json)")
+    parser.add_argument("--revision", default="00000000-0000-0000-0000-000000000001")
+    parser.add_argument("--units", default="mm", choices=["mm", "cm", "m", "km"])
+    parser.add_argument("--assets", type=int, default=20, help="SRC assets per model")
+    parser.add_argument("--objects-per-asset", type=int, default=500, help="Objects (ids) per SRC asset")
+    parser.add_argument("--subdivisions", type=int, default=0, help="Subdivisions of each box face; each object has 6*(n+2)^2 vertices")
+    parser.add_argument("--materials", type=int, default=16, help="Materials per model")
+    parser.add_argument("--transparent-fraction", type=float, default=0.1, help="Fraction of materials that are transparent")
+    parser.add_argument("--compressed-fraction", type=float, default=1.0, help="Fraction of SRCs written with zlib compression (magic 24)")
+    parser.add_argument("--uint32-indices", action="store_true", help="Write uint32 (componentType 5125) indices")
+    parser.add_argument("--max-vertices-per-mesh", type=int, default=1000000, help="Vertex limit of each SRC mesh when --uint32-indices is set")
+    parser.add_argument("--chunk-size", type=int, default=0, help="Split each bufferView into chunks of at most this many bytes (0 is one chunk per view)")
+    parser.add_argument("--extent", type=float, default=50000.0, help="Half-size of the model bounds")
+    parser.add_argument("--min-object-size", type=float, default=100.0)
+    parser.add_argument("--max-object-size", type=float, default=2000.0)
+    parser.add_argument("--seed", type=int, default=1, help="The corpus is deterministic for a given seed and set of arguments")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    template = box(args.subdivisions)
+    if len(template[0]) > (args.max_vertices_per_mesh if args.uint32_indices else MAX_VERTICES_PER_MESH):
+        sys.exit("An object with %d subdivisions does not fit in a single SRC mesh." % args.subdivisions)
+
+    total_objects = 0
+    total_triangles = 0
+    total_bytes = 0
+
+    for m in range(args.models):
+        model = str(uuid.UUID(int=rng.getrandbits(128)))
+        model_directory = os.path.join(args.out, args.teamspace, model)
+        os.makedirs(model_directory, exist_ok=True)
+
+        with open(os.path.join(args.out, args.teamspace, model + ".json"), "w") as f:
+            json.dump({"name": "Load Test %d" % m, "properties": {"unit": args.units}}, f)
+
+        materials = []
+        for i in range(args.materials):
+            transparency = rng.uniform(0.2, 0.8) if i < round(args.materials * args.transparent_fraction) else 0.0
+            materials.append({
+                "name": "material_%d" % i,
+                "material": {
+                    "diffuseColor": colour(rng),
+                    "specularColor": colour(rng),
+                    "shininess": "0.5",
+                    "transparency": "%.3f" % transparency,
+                },
+            })
+
+        assets = []
+        for a in range(args.assets):
+            asset = str(uuid.UUID(int=rng.getrandbits(128)))
+            size, compressed = generate_asset(args, rng, model_directory, asset, materials, template, args.extent)
+            assets.append(asset)
+            total_bytes += size
+            total_objects += args.objects_per_asset
+            total_triangles += args.objects_per_asset * len(template[3]) // 3
+            print("%s/%s/%s.src.mpc: %d bytes%s" % (args.teamspace, model, asset, size, " (compressed)" if compressed else ""))
+
+        offset = [rng.uniform(-1000, 1000) for _ in range(3)]
+        assets_json = {"models": [{"database": args.teamspace, "model": model, "assets": assets, "offset": offset}]}
+        for revision in (args.revision, "master/head"):
+            revision_directory = os.path.join(model_directory, "revision", revision)
+            os.makedirs(revision_directory, exist_ok=True)
+            with open(os.path.join(revision_directory, "srcAssets.json"), "w") as f:
+                json.dump(assets_json, f)
+
+        print("Model %s/%s revision %s" % (args.teamspace, model, args.revision))
+
+    print("%d objects, %d triangles, %.1f MB of SRC" % (total_objects, total_triangles, total_bytes / 1e6))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+#
+#  Copyright (C) 2020 3D Repo Ltd
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU Affero General Public License as
+#  published by the Free Software Foundation, either version 3 of the
+#  License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Affero General Public License for more details.
+#
+#  You should have received a copy of the GNU Affero General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Serves a corpus written by generate_corpus.py over the routes under /api/
+that RepoWebRequestManager requests, so that the plugin can be load tested
+without a live 3D Repo instance.
+
+  /api/version                   answered with the plugin's own version
+  /api/<path>?key=<api key>      answered with <corpus>/<path>
+
+Every response can be delayed by a fixed latency (plus random jitter), and
+throttled to a bandwidth, to reproduce a remote server. Set the plugin's
+host to <address>:<port>, e.g.
+
+  mock_server.py --corpus corpus --port 8080 --latency-ms 80 --bandwidth-mbps 50
+
+and then call SetHost("localhost:8080") with any API key (or the one given
+with --api-key). A summary of the requests served is printed on exit.
+"""
+
+import argparse
+import json
+import os
+import random
+import signal
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, unquote, urlparse
+
+CONTENT_TYPES = {
+    ".json": "application/json",
+    ".mpc": "application/octet-stream",
+}
+
+
+def plugin_version():
+    """Reads the VersionName of the plugin this script is shipped with."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "Repo3d.uplugin")
+    try:
+        with open(path) as f:
+            return json.load(f)["VersionName"]
+    except (OSError, KeyError, ValueError):
+        return "1.0.0"
+
+
+class Statistics:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.requests = 0
+        self.errors = 0
+        self.bytes = 0
+        self.active = 0
+        self.peak_active = 0
+        self.started = time.monotonic()
+
+    def begin(self):
+        with self.lock:
+            self.requests += 1
+            self.active += 1
+            self.peak_active = max(self.peak_active, self.active)
+
+    def end(self, size, error):
+        with self.lock:
+            self.active -= 1
+            self.bytes += size
+            if error:
+                self.errors += 1
+
+    def summary(self):
+        elapsed = time.monotonic() - self.started
+        return "%d requests (%d errors), %.1f MB in %.1f s, peak concurrency %d" % (
+            self.requests, self.errors, self.bytes / 1e6, elapsed, self.peak_active)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Keep-alive, as the engine's HTTP module reuses connections
+
+    def log_message(self, format, *args):
+        if self.server.options.verbose:
+            super().log_message(format, *args)
+
+    def do_GET(self):
+        options = self.server.options
+        stats = self.server.stats
+        stats.begin()
+        size = 0
+        error = True
+        try:
+            url = urlparse(self.path)
+            path = unquote(url.path)
+
+            if not path.startswith("/api/"):
+                self.send_error(404)
+                return
+            route = path[len("/api/"):]
+
+            if options.fail_rate > 0 and random.random() < options.fail_rate:
+                self.send_error(503, "Injected failure")
+                return
+
+            if route == "version":
+                body = json.dumps({"unreal": {"current": options.version, "supported": [options.version]}}).encode()
+                content_type = "application/json"
+            else:
+                key = parse_qs(url.query).get("key", [None])[0]
+                if options.api_key and key != options.api_key:
+                    self.send_error(401)
+                    return
+                body, content_type = self.read_corpus(route)
+                if body is None:
+                    self.send_error(404)
+                    return
+
+            self.delay()
+
+            self.send_response(200)
+            self.send_header("Content-Type", content_type)
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.send_throttled(body)
+
+            size = len(body)
+            error = False
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        finally:
+            stats.end(size, error)
+
+    def read_corpus(self, route):
+        root = os.path.realpath(self.server.options.corpus)
+        path = os.path.realpath(os.path.join(root, route))
+        if not path.startswith(root + os.sep) or not os.path.isfile(path):
+            return None, None
+        with open(path, "rb") as f:
+            body = f.read()
+        return body, CONTENT_TYPES.get(os.path.splitext(path)[1], "application/octet-stream")
+
+    def delay(self):
+        options = self.server.options
+        latency = options.latency_ms + random.uniform(0, options.jitter_ms)
+        if latency > 0:
+            time.sleep(latency / 1000.0)
+
+    def send_throttled(self, body):
+        rate = self.server.options.bandwidth_mbps * 1e6 / 8  # Per connection, in bytes per second
+        if rate <= 0:
+            self.wfile.write(body)
+            return
+
+        chunk = max(1024, int(rate / 50))  # Roughly 20 ms per chunk
+        started = time.monotonic()
+        sent = 0
+        while sent < len(body):
+            self.wfile.write(body[sent:sent + chunk])
+            sent += chunk
+            ahead = sent / rate - (time.monotonic() - started)
+            if ahead > 0:
+                time.sleep(ahead)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--corpus", required=True, help="Folder written by generate_corpus.py")
+    parser.add_argument("--address", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--api-key", default="", help="If set, requests must have this key")
+    parser.add_argument("--version", default=plugin_version(), help="Version reported by /api/version")
+    parser.add_argument("--latency-ms", type=float, default=0.0, help="Delay before each response")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="Random additional delay, up to this value")
+    parser.add_argument("--bandwidth-mbps", type=float, default=0.0, help="Per-connection bandwidth in megabits per second (0 is unlimited)")
+    parser.add_argument("--fail-rate", type=float, default=0.0, help="Fraction of requests answered with 503")
+    parser.add_argument("--seed", type=int, default=None, help="Seed for the jitter and injected failures")
+    parser.add_argument("--verbose", action="store_true", help="Log every request")
+    options = parser.parse_args()
+
+    if options.seed is not None:
+        random.seed(options.seed)
+
+    server = ThreadingHTTPServer((options.address, options.port), Handler)
+    server.daemon_threads = True
+    server.options = options
+    server.stats = Statistics()
+
+    def stop(signum, frame):
+        raise KeyboardInterrupt
+    signal.signal(signal.SIGTERM, stop)  # Print the summary when stopped by a load test script, too
+
+    print("Serving %s on http://%s:%d/api/ (version %s)" % (options.corpus, options.address, options.port, options.version))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+        print(server.stats.summary())
+
+
+if __name__ == "__main__":
+    main()
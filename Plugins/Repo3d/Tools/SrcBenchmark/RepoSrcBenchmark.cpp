@@ -0,0 +1,561 @@
+/*
+ *	Copyright (C) 2020 3D Repo Ltd
+ *
+ *	This program is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Affero General Public License as
+ *	published by the Free Software Foundation, either version 3 of the
+ *	License, or (at your option) any later version.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Affero General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Affero General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RepoSrcBenchmark runs the engine-independent SRC decoder over a set of
+ * captured SRC files, and reports the throughput of each stage.
+ *
+ * Usage: RepoSrcBenchmark [--iterations N] <file or folder>...
+ *
+ * Folders are scanned (non-recursively) for files ending in .src or .src.mpc.
+ * Every file is decoded N times (default 5), after one untimed warm-up pass.
+ * If an SRC has its .json.mpc supermesh mapping alongside it, the mapping is
+ * parsed too, both as JSON and in the binary form the plugin caches it in.
+ * The decoded geometry is also loaded from the geometry file the plugin
+ * caches it in, which is reported separately, as it replaces the decode.
+ * So is the vertex buffer written by the scalar reference kernels, to
+ * compare with the vector kernels the plugin uses.
+ */
+
+#include "Decoder/RepoSrcDecoder.h"
+#include "Decoder/RepoSrcGeometryFile.h"
+#include "Decoder/RepoSrcKernels.h"
+#include "Decoder/RepoSrcMapping.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum Stage
+{
+	StageMapping,
+	StageMappingBinary,
+	StageHeader,
+	StageInflate,
+	StageResolve,
+	StageWiden,
+	StageTransform,
+	StageIdMaps,
+	StageGeometryCache,
+	StageTransformScalar,
+	NumStages
+};
+
+static const char* StageNames[NumStages] = {
+	"mapping parse",
+	"mapping binary",
+	"header parse",
+	"inflate",
+	"resolve",
+	"widen indices",
+	"vertex buffer",
+	"id maps",
+	"geometry cache",
+	"scalar vertices"
+};
+
+struct StageTotals
+{
+	double Seconds = 0;
+	double Bytes = 0; // The bytes the stage consumes
+};
+
+struct SrcFile
+{
+	std::string Path;
+	std::vector<uint8_t> Data;
+	std::vector<uint8_t> Mapping; // Empty if the SRC has no mapping alongside it
+	std::vector<uint8_t> MappingBinary;
+	std::vector<uint32_t> LocalToActor; // Identity, sized to the largest id in the file
+	std::vector<uint8_t> Geometry; // The decoded meshes, as a geometry file
+	uint64_t NumTriangles = 0;
+};
+
+// The same layout as the engine's FProcMeshVertex, which the plugin decodes the vertices into
+struct ProcMeshVertex
+{
+	float Position[3] = { 0, 0, 0 };
+	float Normal[3] = { 0, 0, 1 };
+	float TangentX[3] = { 1, 0, 0 };
+	bool bFlipTangentY = false;
+	uint8_t Color[4] = { 255, 255, 255, 255 };
+	float UV0[2] = { 0, 0 };
+	float UV1[2] = { 0, 0 };
+	float UV2[2] = { 0, 0 };
+	float UV3[2] = { 0, 0 };
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point Start)
+{
+	return std::chrono::duration<double>(Clock::now() - Start).count();
+}
+
+static bool EndsWith(const std::string& s, const char* Suffix)
+{
+	auto Length = strlen(Suffix);
+	return s.size() >= Length && s.compare(s.size() - Length, Length, Suffix) == 0;
+}
+
+static void CollectFiles(const std::string& Path, std::vector<std::string>& Files)
+{
+	struct stat Info;
+	if (stat(Path.c_str(), &Info) != 0)
+	{
+		fprintf(stderr, "Cannot open %s\n", Path.c_str());
+		return;
+	}
+
+	if (!S_ISDIR(Info.st_mode))
+	{
+		Files.push_back(Path);
+		return;
+	}
+
+	auto Directory = opendir(Path.c_str());
+	if (!Directory)
+	{
+		fprintf(stderr, "Cannot open %s\n", Path.c_str());
+		return;
+	}
+
+	std::vector<std::string> Found;
+	while (auto Entry = readdir(Directory))
+	{
+		std::string Name = Entry->d_name;
+		if (EndsWith(Name, ".src") || EndsWith(Name, ".src.mpc"))
+		{
+			Found.push_back(Path + "/" + Name);
+		}
+	}
+	closedir(Directory);
+
+	std::sort(Found.begin(), Found.end());
+	Files.insert(Files.end(), Found.begin(), Found.end());
+}
+
+static bool ReadFile(const std::string& Path, std::vector<uint8_t>& Data)
+{
+	auto File = fopen(Path.c_str(), "rb");
+	if (!File)
+	{
+		return false;
+	}
+	fseek(File, 0, SEEK_END);
+	auto Size = ftell(File);
+	fseek(File, 0, SEEK_SET);
+	Data.resize(Size > 0 ? (size_t)Size : 0);
+	auto Read = fread(Data.data(), 1, Data.size(), File);
+	fclose(File);
+	return Read == Data.size();
+}
+
+// Builds the identity map the ids are resolved through. In the plugin this comes from the .json.mpc mapping.
+static bool Prepare(SrcFile& File)
+{
+	RepoSrcDecoder Decoder;
+	auto Status = Decoder.Decode(File.Data.data(), File.Data.size());
+	if (Status != RepoSrcStatus::Ok)
+	{
+		fprintf(stderr, "Skipping %s: %s\n", File.Path.c_str(), RepoSrcStatusToString(Status));
+		return false;
+	}
+
+	uint32_t NumIds = 0;
+	for (auto& Mesh : Decoder.GetMeshes())
+	{
+		File.NumTriangles += Mesh.Indices.Count / 3;
+		if (Mesh.Ids.IsValid())
+		{
+			std::vector<float> Ids(Mesh.Ids.Count);
+			RepoSrcKernels::CopyFloats(Mesh.Ids, 1, Ids.data());
+			for (auto Id : Ids)
+			{
+				NumIds = std::max(NumIds, (uint32_t)Id + 1);
+			}
+		}
+	}
+
+	File.LocalToActor.resize(NumIds);
+	for (uint32_t i = 0; i < NumIds; i++)
+	{
+		File.LocalToActor[i] = i;
+	}
+
+	// The geometry file holds what the importer would decode: the indices widened, the vectors converted, and the ids
+	// of each vertex. As here, each mesh without translucent submeshes has one section.
+
+	RepoSrcGeometryWriter Writer;
+	for (auto& Mesh : Decoder.GetMeshes())
+	{
+		std::vector<int32_t> Triangles(Mesh.Indices.Count);
+		RepoSrcKernels::WidenIndices(Mesh.Indices, Triangles.data());
+		std::vector<float> Positions((size_t)Mesh.Positions.Count * 3);
+		std::vector<float> Normals((size_t)Mesh.Normals.Count * 3);
+		std::vector<float> Ids(Mesh.Ids.Count);
+
+		RepoSrcGeometryMesh Geometry;
+		Geometry.Sections.resize(1);
+		auto& Section = Geometry.Sections[0];
+		Section.Indices = { (const uint8_t*)Triangles.data(), Mesh.Indices.Count, sizeof(int32_t), RepoSrcDecoder::ComponentTypeUInt32 };
+		if (Mesh.Positions.IsValid())
+		{
+			RepoSrcKernels::UnityToUnreal(Mesh.Positions, Positions.data());
+			Section.Positions = { (const uint8_t*)Positions.data(), Mesh.Positions.Count, sizeof(float) * 3, RepoSrcDecoder::ComponentTypeFloat };
+		}
+		if (Mesh.Normals.IsValid())
+		{
+			RepoSrcKernels::UnityToUnreal(Mesh.Normals, Normals.data());
+			Section.Normals = { (const uint8_t*)Normals.data(), Mesh.Normals.Count, sizeof(float) * 3, RepoSrcDecoder::ComponentTypeFloat };
+		}
+		Section.Texcoords = Mesh.Texcoords;
+		if (Mesh.Ids.IsValid())
+		{
+			RepoSrcKernels::CopyFloats(Mesh.Ids, 1, Ids.data());
+			Section.Ids = { (const uint8_t*)Ids.data(), Mesh.Ids.Count, sizeof(float), RepoSrcDecoder::ComponentTypeFloat };
+		}
+		Writer.AddMesh(Geometry);
+	}
+
+	File.Geometry.resize(Writer.GetSize());
+	Writer.Write(File.Geometry.data());
+
+	return true;
+}
+
+// Loads the meshes from the geometry file into the layouts the importer hands to Unreal, as the decode task does for
+// SRCs whose geometry is in the cache
+static bool LoadGeometry(const SrcFile& File)
+{
+	RepoSrcGeometryFile Geometry;
+	auto Status = Geometry.Open(File.Geometry.data(), File.Geometry.size());
+	if (Status != RepoSrcStatus::Ok)
+	{
+		fprintf(stderr, "%s: the geometry file is malformed: %s\n", File.Path.c_str(), RepoSrcStatusToString(Status));
+		return false;
+	}
+
+	RepoSrcGeometryMesh Mesh;
+	for (size_t m = 0; m < Geometry.GetNumMeshes(); m++)
+	{
+		Geometry.GetMesh(m, Mesh);
+		for (auto& Section : Mesh.Sections)
+		{
+			std::vector<int32_t> Triangles(Section.Indices.Count);
+			RepoSrcKernels::WidenIndices(Section.Indices, Triangles.data());
+			for (auto Index : Triangles)
+			{
+				if ((uint32_t)Index >= Section.Positions.Count)
+				{
+					fprintf(stderr, "%s: the geometry file has an index out of range\n", File.Path.c_str());
+					return false;
+				}
+			}
+
+			std::vector<ProcMeshVertex> Vertices(Section.Positions.Count);
+			auto VertexData = (uint8_t*)Vertices.data();
+			RepoSrcKernels::CopyFloatsInterleaved(Section.Positions, 3, VertexData + offsetof(ProcMeshVertex, Position), sizeof(ProcMeshVertex));
+			if (Section.Normals.IsValid())
+			{
+				RepoSrcKernels::CopyFloatsInterleaved(Section.Normals, 3, VertexData + offsetof(ProcMeshVertex, Normal), sizeof(ProcMeshVertex));
+			}
+			if (Section.Texcoords.IsValid())
+			{
+				RepoSrcKernels::CopyFloatsInterleaved(Section.Texcoords, 2, VertexData + offsetof(ProcMeshVertex, UV0), sizeof(ProcMeshVertex));
+			}
+			if (Section.Ids.IsValid())
+			{
+				auto Ids = (const float*)Section.Ids.Data;
+				std::vector<int32_t> TriangleIdMap(Triangles.size() / 3);
+				if (!RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(Ids, Section.Ids.Count, File.LocalToActor.data(), File.LocalToActor.size(), VertexData + offsetof(ProcMeshVertex, UV1), sizeof(ProcMeshVertex)) ||
+					!RepoSrcKernels::GenerateTriangleIdMap(Triangles.data(), Triangles.size(), Ids, Section.Ids.Count, File.LocalToActor.data(), File.LocalToActor.size(), TriangleIdMap.data()))
+				{
+					fprintf(stderr, "%s: the geometry file has an id or index out of range\n", File.Path.c_str());
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool Run(const SrcFile& File, StageTotals* Totals)
+{
+	if (!File.Mapping.empty())
+	{
+		auto Start = Clock::now();
+		RepoSrcMapping Mapping;
+		bool bParsed = Mapping.Parse((const char*)File.Mapping.data(), File.Mapping.size());
+		Totals[StageMapping].Seconds += SecondsSince(Start);
+		Totals[StageMapping].Bytes += File.Mapping.size();
+
+		if (!bParsed)
+		{
+			fprintf(stderr, "%s: the mapping is malformed\n", File.Path.c_str());
+			return false;
+		}
+
+		Start = Clock::now();
+		bParsed = Mapping.Parse((const char*)File.MappingBinary.data(), File.MappingBinary.size());
+		Totals[StageMappingBinary].Seconds += SecondsSince(Start);
+		Totals[StageMappingBinary].Bytes += File.MappingBinary.size();
+
+		if (!bParsed)
+		{
+			fprintf(stderr, "%s: the binary mapping is malformed\n", File.Path.c_str());
+			return false;
+		}
+	}
+
+	auto Start = Clock::now();
+	bool bLoaded = LoadGeometry(File);
+	Totals[StageGeometryCache].Seconds += SecondsSince(Start);
+	Totals[StageGeometryCache].Bytes += File.Geometry.size();
+
+	if (!bLoaded)
+	{
+		return false;
+	}
+
+	RepoSrcDecoder Decoder;
+
+	Start = Clock::now();
+	auto Status = Decoder.ReadPreamble(File.Data.data(), File.Data.size());
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Status = Decoder.ParseHeader();
+	}
+	Totals[StageHeader].Seconds += SecondsSince(Start);
+	Totals[StageHeader].Bytes += Decoder.GetHeaderSize();
+
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Start = Clock::now();
+		Status = Decoder.Inflate();
+		Totals[StageInflate].Seconds += SecondsSince(Start);
+		Totals[StageInflate].Bytes += Decoder.GetBufferSize();
+	}
+
+	if (Status == RepoSrcStatus::Ok)
+	{
+		Start = Clock::now();
+		Status = Decoder.ResolveMeshes();
+		Totals[StageResolve].Seconds += SecondsSince(Start);
+		Totals[StageResolve].Bytes += Decoder.GetHeaderSize();
+	}
+
+	if (Status != RepoSrcStatus::Ok)
+	{
+		fprintf(stderr, "%s: %s\n", File.Path.c_str(), RepoSrcStatusToString(Status));
+		return false;
+	}
+
+	// The kernels write into freshly allocated arrays, as the importer does, so allocation is part of their cost
+
+	for (auto& Mesh : Decoder.GetMeshes())
+	{
+		Start = Clock::now();
+		std::vector<int32_t> Triangles(Mesh.Indices.Count);
+		RepoSrcKernels::WidenIndices(Mesh.Indices, Triangles.data());
+		Totals[StageWiden].Seconds += SecondsSince(Start);
+		Totals[StageWiden].Bytes += (double)Mesh.Indices.Count * Mesh.Indices.Stride;
+
+		auto VertexBytes = (double)Mesh.Positions.Count * Mesh.Positions.Stride + (double)Mesh.Normals.Count * Mesh.Normals.Stride + (double)Mesh.Texcoords.Count * Mesh.Texcoords.Stride;
+		Start = Clock::now();
+		std::vector<ProcMeshVertex> Vertices(Mesh.Positions.Count);
+		auto VertexData = (uint8_t*)Vertices.data();
+		float Bounds[6];
+		if (Mesh.Positions.IsValid())
+		{
+			RepoSrcKernels::UnityToUnrealInterleaved(Mesh.Positions, VertexData + offsetof(ProcMeshVertex, Position), sizeof(ProcMeshVertex), Bounds);
+		}
+		if (Mesh.Normals.IsValid() && Mesh.Normals.Count == Vertices.size())
+		{
+			RepoSrcKernels::UnityToUnrealInterleaved(Mesh.Normals, VertexData + offsetof(ProcMeshVertex, Normal), sizeof(ProcMeshVertex), nullptr);
+		}
+		if (Mesh.Texcoords.IsValid() && Mesh.Texcoords.Count == Vertices.size())
+		{
+			RepoSrcKernels::CopyFloatsInterleaved(Mesh.Texcoords, 2, VertexData + offsetof(ProcMeshVertex, UV0), sizeof(ProcMeshVertex));
+		}
+		Totals[StageTransform].Seconds += SecondsSince(Start);
+		Totals[StageTransform].Bytes += VertexBytes;
+
+		// The same vertex buffer, written by the scalar kernels the vector kernels are checked against
+		Start = Clock::now();
+		std::vector<ProcMeshVertex> ScalarVertices(Mesh.Positions.Count);
+		auto ScalarVertexData = (uint8_t*)ScalarVertices.data();
+		if (Mesh.Positions.IsValid())
+		{
+			RepoSrcScalarKernels::UnityToUnrealInterleaved(Mesh.Positions, ScalarVertexData + offsetof(ProcMeshVertex, Position), sizeof(ProcMeshVertex), Bounds);
+		}
+		if (Mesh.Normals.IsValid() && Mesh.Normals.Count == ScalarVertices.size())
+		{
+			RepoSrcScalarKernels::UnityToUnrealInterleaved(Mesh.Normals, ScalarVertexData + offsetof(ProcMeshVertex, Normal), sizeof(ProcMeshVertex), nullptr);
+		}
+		if (Mesh.Texcoords.IsValid() && Mesh.Texcoords.Count == ScalarVertices.size())
+		{
+			RepoSrcScalarKernels::CopyFloatsInterleaved(Mesh.Texcoords, 2, ScalarVertexData + offsetof(ProcMeshVertex, UV0), sizeof(ProcMeshVertex));
+		}
+		Totals[StageTransformScalar].Seconds += SecondsSince(Start);
+		Totals[StageTransformScalar].Bytes += VertexBytes;
+
+		if (Mesh.Ids.IsValid())
+		{
+			Start = Clock::now();
+			std::vector<float> Ids(Mesh.Ids.Count);
+			std::vector<int32_t> TriangleIdMap(Triangles.size() / 3);
+			RepoSrcKernels::CopyFloats(Mesh.Ids, 1, Ids.data());
+			bool bMapped =
+				(Ids.size() != Vertices.size() || RepoSrcKernels::GenerateSupermeshMapIndicesInterleaved(Ids.data(), Ids.size(), File.LocalToActor.data(), File.LocalToActor.size(), VertexData + offsetof(ProcMeshVertex, UV1), sizeof(ProcMeshVertex))) &&
+				RepoSrcKernels::GenerateTriangleIdMap(Triangles.data(), Triangles.size(), Ids.data(), Ids.size(), File.LocalToActor.data(), File.LocalToActor.size(), TriangleIdMap.data());
+			Totals[StageIdMaps].Seconds += SecondsSince(Start);
+			Totals[StageIdMaps].Bytes += (double)Mesh.Ids.Count * Mesh.Ids.Stride;
+
+			if (!bMapped)
+			{
+				fprintf(stderr, "%s: mesh %s has an id or index out of range\n", File.Path.c_str(), Mesh.Name.c_str());
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int Iterations = 5;
+	std::vector<std::string> Files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			Iterations = std::max(1, atoi(argv[++i]));
+		}
+		else
+		{
+			CollectFiles(argv[i], Files);
+		}
+	}
+
+	if (Files.empty())
+	{
+		fprintf(stderr, "Usage: %s [--iterations N] <file or folder>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<SrcFile> Srcs;
+	double InputBytes = 0;
+	uint64_t Triangles = 0;
+
+	for (auto& Path : Files)
+	{
+		SrcFile File;
+		File.Path = Path;
+		if (!ReadFile(Path, File.Data))
+		{
+			fprintf(stderr, "Cannot read %s\n", Path.c_str());
+			continue;
+		}
+		if (!Prepare(File))
+		{
+			continue;
+		}
+		auto bMpc = EndsWith(Path, ".src.mpc");
+		RepoSrcMapping Mapping;
+		if (ReadFile(Path.substr(0, Path.size() - (bMpc ? 8 : 4)) + (bMpc ? ".json.mpc" : ".json"), File.Mapping) &&
+			Mapping.Parse((const char*)File.Mapping.data(), File.Mapping.size()))
+		{
+			File.MappingBinary.resize(Mapping.GetBinarySize());
+			Mapping.WriteBinary(File.MappingBinary.data());
+		}
+		else
+		{
+			File.Mapping.clear();
+		}
+		InputBytes += File.Data.size();
+		Triangles += File.NumTriangles;
+		Srcs.push_back(std::move(File));
+	}
+
+	if (Srcs.empty())
+	{
+		fprintf(stderr, "No decodable SRC files were found.\n");
+		return 1;
+	}
+
+	StageTotals WarmUp[NumStages];
+	for (auto& File : Srcs)
+	{
+		Run(File, WarmUp);
+	}
+
+	StageTotals Totals[NumStages];
+	bool bSucceeded = true;
+	for (int i = 0; i < Iterations; i++)
+	{
+		for (auto& File : Srcs)
+		{
+			bSucceeded &= Run(File, Totals);
+		}
+	}
+
+	printf("%zu files, %.2f MB, %llu triangles, %d iterations\n\n", Srcs.size(), InputBytes / 1e6, (unsigned long long)Triangles, Iterations);
+	printf("%-16s %12s %12s %16s\n", "stage", "ms/iter", "MB/s", "Mtriangles/s");
+
+	double TotalSeconds = 0;
+	for (int s = 0; s < StageGeometryCache; s++)
+	{
+		auto Seconds = Totals[s].Seconds;
+		TotalSeconds += Seconds;
+		printf("%-16s %12.3f %12.1f %16.2f\n",
+			StageNames[s],
+			Seconds * 1000.0 / Iterations,
+			Seconds > 0 ? Totals[s].Bytes / 1e6 / Seconds : 0.0,
+			Seconds > 0 ? (double)Triangles * Iterations / 1e6 / Seconds : 0.0);
+	}
+	printf("%-16s %12.3f %12.1f %16.2f\n",
+		"total",
+		TotalSeconds * 1000.0 / Iterations,
+		InputBytes * Iterations / 1e6 / TotalSeconds,
+		(double)Triangles * Iterations / 1e6 / TotalSeconds);
+
+	// Loading the cached geometry takes the place of every stage above but the mapping, and the scalar vertex buffer
+	// is only a reference for the vector kernels, so neither is part of the total
+
+	printf("\n");
+	for (int s = StageGeometryCache; s < NumStages; s++)
+	{
+		auto Seconds = Totals[s].Seconds;
+		printf("%-16s %12.3f %12.1f %16.2f\n",
+			StageNames[s],
+			Seconds * 1000.0 / Iterations,
+			Seconds > 0 ? Totals[s].Bytes / 1e6 / Seconds : 0.0,
+			Seconds > 0 ? (double)Triangles * Iterations / 1e6 / Seconds : 0.0);
+	}
+
+	return bSucceeded ? 0 : 1;
+}